@@ -20,12 +20,13 @@ class VNSOpen(LTMessage):
     def get_type():
         return 1
 
-    def __init__(self, topo_id, virtualHostID, UID, pw):
+    def __init__(self, topo_id, virtualHostID, UID, pw, caps=0):
         LTMessage.__init__(self)
         self.topo_id = int(topo_id)
         self.vhost = str(virtualHostID)
         self.user = str(UID)
         self.pw = str(pw)
+        self.caps = int(caps)
 
     def length(self):
         return VNSOpen.SIZE
@@ -34,18 +35,18 @@ class VNSOpen(LTMessage):
     SIZE = struct.calcsize(FORMAT)
 
     def pack(self):
-        return struct.pack(VNSOpen.FORMAT, self.topo_id, 0, self.vhost, self.user, self.pw)
+        return struct.pack(VNSOpen.FORMAT, self.topo_id, self.caps, self.vhost, self.user, self.pw)
 
     @staticmethod
     def unpack(body):
-        t = struct.unpack(VNSOpen.FORMAT, body) # t[1] is pad => ignored
+        t = struct.unpack(VNSOpen.FORMAT, body) # t[1] is caps, 0 from old clients
         vhost = strip_null_chars(t[2])
         user = strip_null_chars(t[3])
         pw = strip_null_chars(t[4])
-        return VNSOpen(t[0], vhost, user, pw)
+        return VNSOpen(t[0], vhost, user, pw, t[1])
 
     def __str__(self):
-        return 'OPEN: topo_id=%u host=%s user=%s' % (self.topo_id, self.vhost, self.user)
+        return 'OPEN: topo_id=%u host=%s user=%s caps=%#x' % (self.topo_id, self.vhost, self.user, self.caps)
 VNS_MESSAGES.append(VNSOpen)
 
 class VNSClose(LTMessage):
@@ -381,6 +382,151 @@ class VNSAuthStatus(LTMessage):
         return 'AUTH_STATUS: ' + ' auth_ok=%s msg=%s' % (str(self.auth_ok), self.msg)
 VNS_MESSAGES.append(VNSAuthStatus)
 
+class VNSShmOpen(LTMessage):
+    @staticmethod
+    def get_type():
+        return 1024
+
+    def __init__(self, pid, fd, size):
+        LTMessage.__init__(self)
+        self.pid = pid
+        self.fd = fd
+        self.size = size
+
+    def length(self):
+        return VNSShmOpen.SIZE
+
+    FORMAT = '> 3I'
+    SIZE = struct.calcsize(FORMAT)
+
+    def pack(self):
+        return struct.pack(VNSShmOpen.FORMAT, self.pid, self.fd, self.size)
+
+    @staticmethod
+    def unpack(body):
+        t = struct.unpack(VNSShmOpen.FORMAT, body[:VNSShmOpen.SIZE])
+        return VNSShmOpen(t[0], t[1], t[2])
+
+    def __str__(self):
+        return 'SHM_OPEN: pid=%u fd=%u size=%uB' % (self.pid, self.fd, self.size)
+VNS_MESSAGES.append(VNSShmOpen)
+
+class VNSShmStatus(LTMessage):
+    @staticmethod
+    def get_type():
+        return 2048
+
+    def __init__(self, shm_ok, msg):
+        LTMessage.__init__(self)
+        self.shm_ok = bool(shm_ok)
+        self.msg = msg
+
+    def length(self):
+        return 1 + len(self.msg)
+
+    def pack(self):
+        return struct.pack('>B', self.shm_ok) + self.msg
+
+    @staticmethod
+    def unpack(body):
+        shm_ok = struct.unpack('>B', body[:1])[0]
+        return VNSShmStatus(shm_ok, body[1:])
+
+    def __str__(self):
+        return 'SHM_STATUS: shm_ok=%s msg=%s' % (str(self.shm_ok), self.msg)
+VNS_MESSAGES.append(VNSShmStatus)
+
+class VNSShmDoorbell(LTMessage):
+    @staticmethod
+    def get_type():
+        return 4096
+
+    def __init__(self, ring):
+        LTMessage.__init__(self)
+        self.ring = ring
+
+    def length(self):
+        return 4
+
+    def pack(self):
+        return struct.pack('>I', self.ring)
+
+    @staticmethod
+    def unpack(body):
+        return VNSShmDoorbell(struct.unpack('>I', body[:4])[0])
+
+    def __str__(self):
+        return 'SHM_DOORBELL: ring=%u' % self.ring
+VNS_MESSAGES.append(VNSShmDoorbell)
+
+VNS_CAP_BATCH = 0x0001   # VNSPacketBatch in both directions
+VNS_BATCH_MAX = 65536    # largest VNSPacketBatch message, header included
+
+class VNSCaps(LTMessage):
+    @staticmethod
+    def get_type():
+        return 8192
+
+    def __init__(self, caps):
+        LTMessage.__init__(self)
+        self.caps = caps
+
+    def length(self):
+        return 4
+
+    def pack(self):
+        return struct.pack('>I', self.caps)
+
+    @staticmethod
+    def unpack(body):
+        return VNSCaps(struct.unpack('>I', body[:4])[0])
+
+    def __str__(self):
+        return 'CAPS: %#x' % self.caps
+VNS_MESSAGES.append(VNSCaps)
+
+class VNSPacketBatch(LTMessage):
+    @staticmethod
+    def get_type():
+        return 16384
+
+    def __init__(self, packets):
+        """packets is a list of (intf_name, ethernet_frame) tuples."""
+        LTMessage.__init__(self)
+        self.packets = packets
+
+    ENTRY_FORMAT = '> H16s'
+    ENTRY_SIZE = struct.calcsize(ENTRY_FORMAT)
+
+    @staticmethod
+    def entry_length(ethernet_frame):
+        return VNSPacketBatch.ENTRY_SIZE + len(ethernet_frame)
+
+    def length(self):
+        return 4 + sum(VNSPacketBatch.entry_length(f) for _,f in self.packets)
+
+    def pack(self):
+        return struct.pack('>I', len(self.packets)) + ''.join(
+            struct.pack(VNSPacketBatch.ENTRY_FORMAT, len(f), str(n)) + str(f) for n,f in self.packets)
+
+    @staticmethod
+    def unpack(body):
+        count = struct.unpack('>I', body[:4])[0]
+        off = 4
+        packets = []
+        for i in range(count):
+            flen, intf_name = struct.unpack(VNSPacketBatch.ENTRY_FORMAT, body[off:off+VNSPacketBatch.ENTRY_SIZE])
+            off += VNSPacketBatch.ENTRY_SIZE
+            if off + flen > len(body):
+                raise VNSProtocolException('truncated packet batch')
+            packets.append((strip_null_chars(intf_name), body[off:off+flen]))
+            off += flen
+        return VNSPacketBatch(packets)
+
+    def __str__(self):
+        return 'PACKET_BATCH: %u frames' % len(self.packets)
+VNS_MESSAGES.append(VNSPacketBatch)
+
 VNS_PROTOCOL = LTProtocol(VNS_MESSAGES, 'I', 'I')
 
 def create_vns_server(port, recv_callback, new_conn_callback, lost_conn_callback, verbose=True):
@@ -12,6 +12,8 @@ import asyncore
 import collections
 import logging
 import socket
+import mmap
+import struct
 
 # Required for VNS
 import sys
@@ -20,12 +22,19 @@ from twisted.python import threadable
 from threading import Thread
 
 from twisted.internet import reactor
-from VNSProtocol import VNS_DEFAULT_PORT, create_vns_server
+from twisted.internet.task import LoopingCall
+from VNSProtocol import VNS_DEFAULT_PORT, create_vns_server, strip_null_chars
 from VNSProtocol import VNSOpen, VNSClose, VNSPacket, VNSOpenTemplate, VNSBanner
 from VNSProtocol import VNSRtable, VNSAuthRequest, VNSAuthReply, VNSAuthStatus, VNSInterface, VNSHardwareInfo
+from VNSProtocol import VNSShmOpen, VNSShmStatus, VNSShmDoorbell
+from VNSProtocol import VNSCaps, VNSPacketBatch, VNS_CAP_BATCH, VNS_BATCH_MAX
 
 log = core.getLogger()
 
+# frames for a client that arrive within this many seconds of each other go
+# out as one VNSPacketBatch
+BATCH_WINDOW = 0.001
+
 def pack_mac(macaddr):
   octets = macaddr.split(':')
   ret = ''
@@ -40,6 +49,73 @@ def pack_ip(ipaddr):
     ret += chr(int(byte))
   return ret
 
+class SRShmRings(object):
+  ''' Frame rings shared with an sr client on this host, see sr_shm.h '''
+  MAGIC = 0x53524d31
+  VERSION = 1
+  HDR_SIZE = 4096
+  SLOT_HDR = 20
+  TO_SERVER = 0
+  TO_ROUTER = 1
+
+  def __init__(self, pid, fd, size):
+    # the memfd is not passed over the socket, open the client's descriptor
+    f = open('/proc/%u/fd/%u' % (pid, fd), 'r+b')
+    try:
+      self.mem = mmap.mmap(f.fileno(), size)
+    finally:
+      f.close()
+    magic, version, self.nslots, self.slot_size = struct.unpack_from('=4I', self.mem, 0)
+    if (magic != SRShmRings.MAGIC or version != SRShmRings.VERSION or
+        size < SRShmRings.HDR_SIZE + 2 * self.nslots * self.slot_size):
+      self.mem.close()
+      raise ValueError('bad ring header (magic=%#x version=%u)' % (magic, version))
+
+  # indices are only ever written by their owner; x86 keeps the stores in
+  # order so a plain read of the other side's index is enough here
+  def _get(self, off):
+    return struct.unpack_from('=I', self.mem, off)[0]
+
+  def _set(self, off, val):
+    struct.pack_into('=I', self.mem, off, val & 0xffffffff)
+
+  def _slot(self, ring, idx):
+    return SRShmRings.HDR_SIZE + (ring * self.nslots + idx % self.nslots) * self.slot_size
+
+  def push(self, ring, intfname, frame):
+    ''' 1 if the ring was empty (send a doorbell), 0 if not, -1 if full '''
+    prod_off = 64 + ring * 128
+    cons_off = prod_off + 64
+    if len(frame) > self.slot_size - SRShmRings.SLOT_HDR:
+      return -1
+    prod = self._get(prod_off)
+    if (prod - self._get(cons_off)) & 0xffffffff >= self.nslots:
+      return -1
+    off = self._slot(ring, prod)
+    struct.pack_into('=I16s', self.mem, off, len(frame), intfname)
+    off += SRShmRings.SLOT_HDR
+    self.mem[off:off + len(frame)] = frame
+    self._set(prod_off, prod + 1)
+    return 1 if self._get(cons_off) == prod else 0
+
+  def pop_all(self, ring):
+    prod_off = 64 + ring * 128
+    cons_off = prod_off + 64
+    frames = []
+    cons = self._get(cons_off)
+    while cons != self._get(prod_off):
+      off = self._slot(ring, cons)
+      length, intfname = struct.unpack_from('=I16s', self.mem, off)
+      if length <= self.slot_size - SRShmRings.SLOT_HDR:
+        off += SRShmRings.SLOT_HDR
+        frames.append((strip_null_chars(intfname), self.mem[off:off + length]))
+      cons = (cons + 1) & 0xffffffff
+      self._set(cons_off, cons)
+    return frames
+
+  def close(self):
+    self.mem.close()
+
 class SRServerListener(EventMixin):
   ''' TCP Server to handle connection to SR '''
   def __init__ (self, address=('127.0.0.1', 8888)):
@@ -49,6 +125,10 @@ class SRServerListener(EventMixin):
     self.listen_port = port
     self.intfname_to_port = {}
     self.port_to_intfname = {}
+    self.shm_rings = {}
+    self.shm_poll = None
+    self.batches = {}   # conn -> [frames, bytes] for clients that take batches
+    self.batch_lock = threading.Lock()
     self.server = create_vns_server(port,
                                     self._handle_recv_msg,
                                     self._handle_new_client,
@@ -59,8 +139,53 @@ class SRServerListener(EventMixin):
   def broadcast(self, message):
     log.debug('Broadcasting message: %s', message)
     for client in self.srclients:
+      rings = self.shm_rings.get(client)
+      if rings is not None and isinstance(message, VNSPacket):
+        ret = rings.push(SRShmRings.TO_ROUTER, message.intf_name, message.ethernet_frame)
+        if ret == 1:
+          client.send(VNSShmDoorbell(SRShmRings.TO_ROUTER))
+        if ret >= 0:
+          continue
+        # ring full, this one goes over TCP
+      if isinstance(message, VNSPacket) and self._batch_packet(client, message):
+        continue
       client.send(message)
 
+  def _batch_packet(self, conn, message):
+    # called from the POX thread, the batch is sent from the reactor
+    size = VNSPacketBatch.entry_length(message.ethernet_frame)
+    full = None
+    with self.batch_lock:
+      pending = self.batches.get(conn)
+      if pending is None:
+        return False
+      if pending[0] and 12 + pending[1] + size > VNS_BATCH_MAX:
+        full = pending[0]
+        pending[0], pending[1] = [], 0
+      start = not pending[0]
+      pending[0].append((message.intf_name, message.ethernet_frame))
+      pending[1] += size
+    if full:
+      reactor.callFromThread(self._send_batch, conn, full)
+    if start and not full:
+      reactor.callFromThread(reactor.callLater, BATCH_WINDOW, self._flush_batch, conn)
+    return True
+
+  def _flush_batch(self, conn):
+    with self.batch_lock:
+      pending = self.batches.get(conn)
+      if pending is None or not pending[0]:
+        return
+      frames = pending[0]
+      pending[0], pending[1] = [], 0
+    self._send_batch(conn, frames)
+
+  def _send_batch(self, conn, frames):
+    if len(frames) == 1:
+      conn.send(VNSPacket(frames[0][0], frames[0][1]))
+    else:
+      conn.send(VNSPacketBatch(frames))
+
   def _handle_SRPacketIn(self, event):
     #log.debug("SRServerListener catch SRPacketIn event, port=%d, pkt=%r" % (event.port, event.pkt))
     try:
@@ -103,6 +228,13 @@ class SRServerListener(EventMixin):
       self._handle_close_msg(conn)
     elif vns_msg.get_type() == VNSPacket.get_type():
       self._handle_packet_msg(conn, vns_msg)
+    elif vns_msg.get_type() == VNSPacketBatch.get_type():
+      for out_intf, pkt in vns_msg.packets:
+        self._packet_out(out_intf, pkt)
+    elif vns_msg.get_type() == VNSShmDoorbell.get_type():
+      self._handle_shm_doorbell(conn)
+    elif vns_msg.get_type() == VNSShmOpen.get_type():
+      self._handle_shm_open_msg(conn, vns_msg)
     elif vns_msg.get_type() == VNSOpenTemplate.get_type():
       # TODO: see if this is needed...
       self._handle_open_template_msg(conn, vns_msg)
@@ -124,12 +256,21 @@ class SRServerListener(EventMixin):
 
   def _handle_client_disconnected(self, conn):
     log.info("disconnected")
+    rings = self.shm_rings.pop(conn, None)
+    if rings is not None:
+      rings.close()
+    with self.batch_lock:
+      self.batches.pop(conn, None)
     conn.transport.loseConnection()
     return
 
   def _handle_open_msg(self, conn, vns_msg):
     # client wants to connect to some topology.
     log.debug("open-msg: %s, %s" % (vns_msg.topo_id, vns_msg.vhost))
+    if vns_msg.caps & VNS_CAP_BATCH:
+      with self.batch_lock:
+        self.batches[conn] = [[], 0]
+      conn.send(VNSCaps(VNS_CAP_BATCH))
     try:
       conn.send(VNSHardwareInfo(self.interfaces))
     except:
@@ -141,14 +282,40 @@ class SRServerListener(EventMixin):
     conn.transport.loseConnection()
     return
 
+  def _handle_shm_open_msg(self, conn, vns_msg):
+    # client on the same host offers its frame rings
+    try:
+      rings = SRShmRings(vns_msg.pid, vns_msg.fd, vns_msg.size)
+    except (IOError, OSError, ValueError, mmap.error) as e:
+      log.info('shared memory declined: %s' % e)
+      conn.send(VNSShmStatus(False, str(e)))
+      return
+    self.shm_rings[conn] = rings
+    conn.send(VNSShmStatus(True, 'mapped %uB' % vns_msg.size))
+    # doorbells are only sent on empty -> non-empty, poll to cover the race
+    if self.shm_poll is None:
+      self.shm_poll = LoopingCall(self._poll_shm_rings)
+      self.shm_poll.start(0.01, now=False)
+
+  def _handle_shm_doorbell(self, conn):
+    rings = self.shm_rings.get(conn)
+    if rings is None:
+      return
+    for out_intf, pkt in rings.pop_all(SRShmRings.TO_SERVER):
+      self._packet_out(out_intf, pkt)
+
+  def _poll_shm_rings(self):
+    for conn in self.shm_rings.keys():
+      self._handle_shm_doorbell(conn)
+
   def _handle_packet_msg(self, conn, vns_msg):
-    out_intf = vns_msg.intf_name
-    pkt = vns_msg.ethernet_frame
+    self._packet_out(vns_msg.intf_name, vns_msg.ethernet_frame)
 
+  def _packet_out(self, out_intf, pkt):
     try:
       out_port = self.intfname_to_port[out_intf]
     except KeyError:
-      log.debug('packet-out through wrong port number %s' % out_port)
+      log.debug('packet-out through wrong interface %s' % out_intf)
       return
     log.debug("packet-out %s: %r" % (out_intf, pkt))
     #log.debug("packet-out %s: " % ethernet(raw=pkt))
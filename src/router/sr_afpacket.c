@@ -0,0 +1,556 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.c
+ *
+ * Description:
+ *
+ * PACKET_MMAP (TPACKET_V3) backend.  Each router interface owns one
+ * AF_PACKET socket bound to a host device with an RX ring of retired blocks
+ * and a TX ring of fixed size frames, both in a single mapping.
+ *
+ * The host devices should be up and carry no addresses of their own so that
+ * the host stack leaves ARP and ICMP to the router.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "sr_afpacket.h"
+#include "sr_transport.h"
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_pkt.h"
+#include "sr_stats.h"
+
+#ifdef _LINUX_
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+
+struct sr_afp_if
+{
+    int      fd;
+    char     name[sr_IFACE_NAMELEN];   /* router interface name */
+    char     dev[sr_IFACE_NAMELEN];    /* host device */
+    unsigned char addr[ETHER_ADDR_LEN];
+    int      promisc;                  /* addr differs from the device's */
+    uint8_t* map;
+    size_t   map_len;
+    uint8_t* tx_ring;                  /* map + RX ring size */
+    unsigned int rx_block;             /* next RX block to look at */
+    unsigned int tx_frame;             /* next TX frame to fill */
+    unsigned int tx_frame_nr;
+    unsigned int tx_pending;           /* frames queued but not kicked */
+    pthread_mutex_t tx_lock;
+};
+
+struct sr_afpacket
+{
+    int n;
+    struct sr_afp_if ifs[SR_AFP_MAX_IFS];   /* by ifindex */
+    struct pollfd    pfds[SR_AFP_MAX_IFS];
+};
+
+static void sr_afpacket_close(struct sr_instance* sr);
+static void sr_afpacket_flush(struct sr_instance* sr);
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afp_setup_if(..)
+ * Scope: Local
+ *
+ * Create the socket and rings for a single interface.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afp_setup_if(struct sr_afp_if* afp, struct sr_if_spec* spec)
+{
+    struct ifreq ifr;
+    struct sockaddr_ll sll;
+    struct tpacket_req3 rx_req;
+    struct tpacket_req3 tx_req;
+    struct packet_mreq mreq;
+    int version = TPACKET_V3;
+    int one = 1;
+    int ifindex;
+
+    memset(afp, 0, sizeof(struct sr_afp_if));
+    afp->fd = -1;
+    strncpy(afp->name, spec->name, sr_IFACE_NAMELEN);
+    strncpy(afp->dev, spec->dev, sr_IFACE_NAMELEN);
+    pthread_mutex_init(&afp->tx_lock, 0);
+
+    if((afp->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)
+    {
+        perror("socket(..):sr_afpacket.c::sr_afp_setup_if(..)");
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, afp->dev, IFNAMSIZ - 1);
+    if(ioctl(afp->fd, SIOCGIFINDEX, &ifr) < 0)
+    {
+        fprintf(stderr, "sr_afpacket: no such device %s\n", afp->dev);
+        return -1;
+    }
+    ifindex = ifr.ifr_ifindex;
+
+    if(ioctl(afp->fd, SIOCGIFHWADDR, &ifr) < 0)
+    {
+        perror("ioctl(SIOCGIFHWADDR):sr_afpacket.c::sr_afp_setup_if(..)");
+        return -1;
+    }
+    if(spec->has_addr)
+    {
+        memcpy(afp->addr, spec->addr, ETHER_ADDR_LEN);
+        afp->promisc = memcmp(afp->addr, ifr.ifr_hwaddr.sa_data,
+                              ETHER_ADDR_LEN) != 0;
+    }
+    else
+    { memcpy(afp->addr, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN); }
+
+    if(setsockopt(afp->fd, SOL_PACKET, PACKET_VERSION,
+                  &version, sizeof(version)) < 0)
+    {
+        perror("setsockopt(PACKET_VERSION):sr_afpacket.c");
+        return -1;
+    }
+
+#ifdef PACKET_IGNORE_OUTGOING
+    /* -- frames we transmit are logged by sr_send_packet already -- */
+    (void)setsockopt(afp->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING,
+                     &one, sizeof(one));
+#endif
+#ifdef PACKET_QDISC_BYPASS
+    (void)setsockopt(afp->fd, SOL_PACKET, PACKET_QDISC_BYPASS,
+                     &one, sizeof(one));
+#endif
+
+    memset(&rx_req, 0, sizeof(rx_req));
+    rx_req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    rx_req.tp_block_nr   = SR_AFP_RX_BLOCK_NR;
+    rx_req.tp_frame_size = SR_AFP_FRAME_SIZE;
+    rx_req.tp_frame_nr   = (SR_AFP_BLOCK_SIZE / SR_AFP_FRAME_SIZE) *
+                           SR_AFP_RX_BLOCK_NR;
+    rx_req.tp_retire_blk_tov = SR_AFP_BLOCK_TOV_MS;
+    if(setsockopt(afp->fd, SOL_PACKET, PACKET_RX_RING,
+                  &rx_req, sizeof(rx_req)) < 0)
+    {
+        perror("setsockopt(PACKET_RX_RING):sr_afpacket.c");
+        return -1;
+    }
+
+    memset(&tx_req, 0, sizeof(tx_req));
+    tx_req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    tx_req.tp_block_nr   = SR_AFP_TX_BLOCK_NR;
+    tx_req.tp_frame_size = SR_AFP_FRAME_SIZE;
+    tx_req.tp_frame_nr   = (SR_AFP_BLOCK_SIZE / SR_AFP_FRAME_SIZE) *
+                           SR_AFP_TX_BLOCK_NR;
+    if(setsockopt(afp->fd, SOL_PACKET, PACKET_TX_RING,
+                  &tx_req, sizeof(tx_req)) < 0)
+    {
+        perror("setsockopt(PACKET_TX_RING):sr_afpacket.c");
+        return -1;
+    }
+    afp->tx_frame_nr = tx_req.tp_frame_nr;
+
+    afp->map_len = (size_t)SR_AFP_BLOCK_SIZE *
+                   (SR_AFP_RX_BLOCK_NR + SR_AFP_TX_BLOCK_NR);
+    afp->map = mmap(0, afp->map_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_LOCKED | MAP_POPULATE, afp->fd, 0);
+    if(afp->map == MAP_FAILED)
+    {
+        /* -- MAP_LOCKED needs RLIMIT_MEMLOCK headroom, retry without -- */
+        afp->map = mmap(0, afp->map_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, afp->fd, 0);
+    }
+    if(afp->map == MAP_FAILED)
+    {
+        perror("mmap(..):sr_afpacket.c::sr_afp_setup_if(..)");
+        afp->map = 0;
+        return -1;
+    }
+    afp->tx_ring = afp->map + (size_t)SR_AFP_BLOCK_SIZE * SR_AFP_RX_BLOCK_NR;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex  = ifindex;
+    if(bind(afp->fd, (struct sockaddr*)&sll, sizeof(sll)) < 0)
+    {
+        perror("bind(..):sr_afpacket.c::sr_afp_setup_if(..)");
+        return -1;
+    }
+
+    if(afp->promisc)
+    {
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = ifindex;
+        mreq.mr_type    = PACKET_MR_PROMISC;
+        if(setsockopt(afp->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                      &mreq, sizeof(mreq)) < 0)
+        {
+            perror("setsockopt(PACKET_ADD_MEMBERSHIP):sr_afpacket.c");
+            return -1;
+        }
+    }
+
+    return 0;
+} /* -- sr_afp_setup_if -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_open(..)
+ * Scope: Local
+ *
+ * Bind every interface spec to its device.  This takes the place of the
+ * VNSHWINFO message, so interfaces are added to sr here.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afpacket_open(struct sr_instance* sr,
+                            struct sr_transport_opts* opts)
+{
+    struct sr_afpacket* afp = 0;
+    struct sr_if_spec* specs = opts->ifspecs;
+    int n = opts->num_ifspecs;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if(n <= 0 || n > SR_AFP_MAX_IFS)
+    {
+        fprintf(stderr, "sr_afpacket: between 1 and %d interfaces supported\n",
+                SR_AFP_MAX_IFS);
+        return -1;
+    }
+
+    afp = (struct sr_afpacket*)calloc(1, sizeof(struct sr_afpacket));
+    assert(afp);
+    sr->transport_state = afp;
+
+    for(i = 0; i < n; i++)
+    {
+        if(specs[i].dev[0] == '\0')
+        {
+            fprintf(stderr, "sr_afpacket: interface %s has no device\n",
+                    specs[i].name);
+            sr_afpacket_close(sr);
+            return -1;
+        }
+        if(sr_afp_setup_if(&afp->ifs[i], &specs[i]) != 0)
+        {
+            afp->n = i + 1;
+            sr_afpacket_close(sr);
+            return -1;
+        }
+        afp->n = i + 1;
+        afp->pfds[i].fd = afp->ifs[i].fd;
+        afp->pfds[i].events = POLLIN | POLLERR;
+
+        /* -- the list starts out empty, ifs[i] is ifindex i -- */
+        sr_add_interface(sr, specs[i].name);
+        sr_set_ether_addr(sr, afp->ifs[i].addr);
+        sr_set_ether_ip(sr, specs[i].ip);
+        assert(sr->ifs[i]->ifindex == i);
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+
+    return 0;
+} /* -- sr_afpacket_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afp_kick(..)
+ * Scope: Local
+ *
+ * Ask the kernel to transmit every frame marked TP_STATUS_SEND_REQUEST.
+ * Called with tx_lock held.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afp_kick(struct sr_afp_if* afp)
+{
+    if(afp->tx_pending == 0)
+    { return; }
+
+    if(send(afp->fd, 0, 0, MSG_DONTWAIT) < 0 &&
+       errno != EAGAIN && errno != ENOBUFS)
+    { perror("send(..):sr_afpacket.c::sr_afp_kick(..)"); }
+    afp->tx_pending = 0;
+} /* -- sr_afp_kick -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afp_rx_ready(..)
+ * Scope: Local
+ *
+ * Handle every retired block on one interface's RX ring.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afp_rx_ready(struct sr_instance* sr, struct sr_afp_if* afp,
+                            struct sr_if* iface)
+{
+    struct sr_pkt pkt;
+    struct tpacket_block_desc* bd = 0;
+    struct tpacket3_hdr* ppd = 0;
+    struct sockaddr_ll* sll = 0;
+    struct sr_ethernet_hdr* e_hdr = 0;
+    uint8_t* frame = 0;
+    unsigned int i, num_pkts;
+
+    while(1)
+    {
+        bd = (struct tpacket_block_desc*)(afp->map +
+                (size_t)afp->rx_block * SR_AFP_BLOCK_SIZE);
+        if((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+            TP_STATUS_USER) == 0)
+        { break; }
+
+        num_pkts = bd->hdr.bh1.num_pkts;
+        ppd = (struct tpacket3_hdr*)((uint8_t*)bd +
+                bd->hdr.bh1.offset_to_first_pkt);
+
+        for(i = 0; i < num_pkts; i++)
+        {
+            sll = (struct sockaddr_ll*)((uint8_t*)ppd +
+                    TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+            frame = (uint8_t*)ppd + ppd->tp_mac;
+            e_hdr = (struct sr_ethernet_hdr*)frame;
+
+            if(sll->sll_pkttype != PACKET_OUTGOING &&
+               ppd->tp_snaplen >= sizeof(struct sr_ethernet_hdr) &&
+               (!afp->promisc || (e_hdr->ether_dhost[0] & 1) ||
+                memcmp(e_hdr->ether_dhost, afp->addr, ETHER_ADDR_LEN) == 0))
+            {
+                sr_pkt_parse(&pkt, frame, ppd->tp_snaplen, iface);
+                sr_receive_pkt(sr, &pkt);
+            }
+
+            ppd = (struct tpacket3_hdr*)((uint8_t*)ppd + ppd->tp_next_offset);
+        }
+
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                         __ATOMIC_RELEASE);
+        afp->rx_block = (afp->rx_block + 1) % SR_AFP_RX_BLOCK_NR;
+    }
+} /* -- sr_afp_rx_ready -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_poll(..)
+ * Scope: Local
+ *
+ * One iteration of the main loop when running on host devices.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afpacket_poll(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = (struct sr_afpacket*)sr->transport_state;
+    int i, ret;
+
+    /* REQUIRES */
+    assert(afp);
+
+    if((ret = poll(afp->pfds, afp->n, -1)) < 0)
+    {
+        if(errno == EINTR)
+        { return 1; }
+        perror("poll(..):sr_afpacket.c::sr_afpacket_poll(..)");
+        return -1;
+    }
+
+    /* -- sends from sr_handlepacket() are kicked once per batch instead of
+          once per frame -- */
+    sr_tx_hold = 1;
+    for(i = 0; i < afp->n; i++)
+    {
+        if(afp->pfds[i].revents & POLLERR)
+        {
+            fprintf(stderr, "sr_afpacket: error on device %s\n",
+                    afp->ifs[i].dev);
+            sr_tx_hold = 0;
+            return -1;
+        }
+        /* -- look at every ring, a poll wakeup can cover frames that
+              arrived on several devices -- */
+        sr_afp_rx_ready(sr, &afp->ifs[i], sr->ifs[i]);
+    }
+    sr_tx_hold = 0;
+
+    sr_afpacket_flush(sr);
+
+    return 1;
+} /* -- sr_afpacket_poll -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_flush(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afpacket_flush(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = (struct sr_afpacket*)sr->transport_state;
+    int i;
+
+    for(i = 0; i < afp->n; i++)
+    {
+        pthread_mutex_lock(&afp->ifs[i].tx_lock);
+        sr_afp_kick(&afp->ifs[i]);
+        pthread_mutex_unlock(&afp->ifs[i].tx_lock);
+    }
+} /* -- sr_afpacket_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_send(..)
+ * Scope: Local
+ *
+ * Copy a frame into the next free TX ring slot.  Frames queued from inside
+ * the RX loop are flushed together at the end of the batch; frames from
+ * other threads (the ARP sweeper) are flushed right away.  A slot the
+ * kernel rejected (TP_STATUS_WRONG_FORMAT) is reused.  If no slot comes
+ * back within SR_AFP_TX_WAIT_MS, say the link is down, the frame is
+ * dropped and counted.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afpacket_send(struct sr_instance* sr, uint8_t* buf,
+                            unsigned int len, int ifindex)
+{
+    struct sr_afpacket* afp = (struct sr_afpacket*)sr->transport_state;
+    struct sr_afp_if* aif = 0;
+    struct tpacket3_hdr* hdr = 0;
+    struct pollfd pfd;
+    unsigned int status;
+    int waited = 0;
+    unsigned int data_off = TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+
+    /* REQUIRES */
+    assert(afp);
+
+    if(ifindex < 0 || ifindex >= afp->n)
+    {
+        fprintf(stderr, "** Error, interface %d, does not exist\n", ifindex);
+        return -1;
+    }
+    aif = &afp->ifs[ifindex];
+    if(len > SR_AFP_FRAME_SIZE - data_off)
+    {
+        fprintf(stderr, "** Error: frame of %u bytes too large for TX ring\n",
+                len);
+        return -1;
+    }
+
+    pthread_mutex_lock(&aif->tx_lock);
+
+    hdr = (struct tpacket3_hdr*)(aif->tx_ring +
+            (size_t)aif->tx_frame * SR_AFP_FRAME_SIZE);
+    pfd.fd = aif->fd;
+    pfd.events = POLLOUT;
+    while((status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE)) !=
+          TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT)
+    {
+        /* -- ring full: push out what is queued and wait for the slot,
+              kicking again each time in case a send was refused -- */
+        if(waited >= SR_AFP_TX_WAIT_MS)
+        {
+            pthread_mutex_unlock(&aif->tx_lock);
+            sr_stats_drop(SR_DROP_TX_FULL);
+            return -1;
+        }
+        aif->tx_pending = 1;
+        sr_afp_kick(aif);
+        if(poll(&pfd, 1, 10) < 0 && errno != EINTR)
+        {
+            pthread_mutex_unlock(&aif->tx_lock);
+            return -1;
+        }
+        waited += 10;
+    }
+
+    memcpy((uint8_t*)hdr + data_off, buf, len);
+    hdr->tp_len = len;
+    hdr->tp_snaplen = len;
+    hdr->tp_next_offset = 0;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    aif->tx_frame = (aif->tx_frame + 1) % aif->tx_frame_nr;
+    aif->tx_pending++;
+
+    if(!sr_tx_hold)
+    { sr_afp_kick(aif); }
+
+    pthread_mutex_unlock(&aif->tx_lock);
+
+    return 0;
+} /* -- sr_afpacket_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_close(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afpacket_close(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = (struct sr_afpacket*)sr->transport_state;
+    int i;
+
+    if(afp == 0)
+    { return; }
+
+    for(i = 0; i < afp->n; i++)
+    {
+        if(afp->ifs[i].map)
+        { munmap(afp->ifs[i].map, afp->ifs[i].map_len); }
+        if(afp->ifs[i].fd >= 0)
+        { close(afp->ifs[i].fd); }
+        pthread_mutex_destroy(&afp->ifs[i].tx_lock);
+    }
+
+    free(afp);
+    sr->transport_state = 0;
+} /* -- sr_afpacket_close -- */
+
+const struct sr_transport sr_afpacket_transport =
+{
+    "afpacket",
+    sr_afpacket_open,
+    sr_afpacket_poll,
+    sr_afpacket_send,
+    sr_afpacket_flush,
+    sr_afpacket_close
+};
+
+#else /* _LINUX_ */
+
+static int sr_afpacket_open(struct sr_instance* sr,
+                            struct sr_transport_opts* opts)
+{
+    fprintf(stderr, "sr_afpacket: AF_PACKET rings are only available on Linux\n");
+    return -1;
+}
+
+const struct sr_transport sr_afpacket_transport =
+{
+    "afpacket",
+    sr_afpacket_open,
+    0,
+    0,
+    0,
+    0
+};
+
+#endif /* _LINUX_ */
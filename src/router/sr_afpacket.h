@@ -0,0 +1,30 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.h
+ *
+ * Description:
+ *
+ * Alternative to the VNS server connection: every router interface is bound
+ * to a host network device (e.g. one end of a veth pair) through an AF_PACKET
+ * socket with TPACKET_V3 RX and TX rings mapped into the router's memory.
+ * Received frames are handed to sr_handlepacket() straight out of the ring.
+ *
+ * Linux only.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_AFPACKET_H
+#define SR_AFPACKET_H
+
+#define SR_AFP_MAX_IFS      32
+
+/* RX ring: SR_AFP_RX_BLOCK_NR blocks of SR_AFP_BLOCK_SIZE bytes each */
+#define SR_AFP_BLOCK_SIZE   (1 << 18)
+#define SR_AFP_RX_BLOCK_NR  16
+#define SR_AFP_TX_BLOCK_NR  4
+#define SR_AFP_FRAME_SIZE   2048
+#define SR_AFP_BLOCK_TOV_MS 1
+#define SR_AFP_TX_WAIT_MS   100     /* wait for a TX slot, then drop */
+
+/* the backend itself is sr_afpacket_transport in sr_transport.h */
+
+#endif /* -- SR_AFPACKET_H -- */
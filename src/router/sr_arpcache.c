@@ -11,94 +11,127 @@
 #include "sr_if.h"
 #include "sr_protocol.h"
 #include "sr_utils.h"
+#include "sr_cksum.h"
+#include "sr_prof.h"
+#include "sr_stats.h"
 /*
   This function gets called every second. For each request sent out, we keep
   checking whether we should resend an request or destroy the arp request.
   See the comments in the header file for an idea of what it should look like.
+  It takes the cache lock only to decide, the ARP requests and ICMP errors go
+  out after it lets go.
 */
 void sr_arpcache_sweepreqs(struct sr_instance *sr) {
-    struct sr_arpreq *req = sr->cache.requests;
+    struct sr_arpreq *req;
     struct sr_arpreq *next_req;
+    struct sr_arpreq_todo todo, *copy, *todos = NULL;
 
-    while (req) {
+    pthread_mutex_lock(&(sr->cache.lock));
+    for (req = sr->cache.requests; req; req = next_req) {
         next_req = req->next;//use next so that we are fine even if handle destroys the current request
-        handle_arpreq(sr, req);
-        req = next_req;
+        handle_arpreq(sr, req, &todo);
+        if (todo.ifindex >= 0 || todo.expired) {//keep it for after the unlock, most requests need nothing
+            copy = (struct sr_arpreq_todo *) malloc(sizeof(struct sr_arpreq_todo));
+            *copy = todo;
+            copy->next = todos;
+            todos = copy;
+        }
+    }
+    pthread_mutex_unlock(&(sr->cache.lock));
+
+    while (todos) {
+        copy = todos;
+        todos = copy->next;
+        sr_arpreq_todo_run(sr, copy);
+        free(copy);
     }
 }
 
-void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *request) {
+//call with the cache lock held, only decides what to do and marks the request:
+//sent now, or taken off the queue when we give up. todo says what to send,
+//pass it to sr_arpreq_todo_run once the lock is released
+void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *request, struct sr_arpreq_todo *todo) {
     time_t now = time(NULL); // Current time
-    
+
+    todo->ip = request->ip;
+    todo->ifindex = -1;
+    todo->expired = NULL;
+    todo->next = NULL;
+
     if (difftime(now, request->sent) > 1.0) {
-        if(request->times_sent >= 5){
-            //send icmp host unreachable to source addr of all pkts waiting
-            struct sr_packet *pkt = request->packets;
-            while (pkt) {
-                sr_send_icmp(sr, pkt->buf, pkt->len, pkt->iface, 3, 1);
-                pkt = pkt->next;
-            }
-            sr_arpreq_destroy(&sr->cache, request);
-        } else {
-            //send request
-            struct sr_if *out_iface = sr_get_interface(sr, request->packets->iface);
-            if (out_iface) {
-                uint8_t *arp_req = (uint8_t *) malloc(sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t));
-                sr_ethernet_hdr_t *eth_hdr = (sr_ethernet_hdr_t *) arp_req;
-                sr_arp_hdr_t *arp_hdr = (sr_arp_hdr_t *) (arp_req + sizeof(sr_ethernet_hdr_t));
-                
-                memset(eth_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN); //broadcast
-                memcpy(eth_hdr->ether_shost, out_iface->addr, ETHER_ADDR_LEN);//source being our out interface
-                eth_hdr->ether_type = htons(ethertype_arp);
-                
-                //ARP header
-                arp_hdr->ar_hrd = htons(arp_hrd_ethernet);
-                arp_hdr->ar_pro = htons(ethertype_ip);
-                arp_hdr->ar_hln = ETHER_ADDR_LEN;
-                arp_hdr->ar_pln = sizeof(uint32_t);
-                arp_hdr->ar_op = htons(arp_op_request);
-                memcpy(arp_hdr->ar_sha, out_iface->addr, ETHER_ADDR_LEN);//same, set source mac to be the outgoing interface
-                arp_hdr->ar_sip = out_iface->ip;  //IP is just the router's IP
-                memset(arp_hdr->ar_tha, 0xff, ETHER_ADDR_LEN);
-                arp_hdr->ar_tip = request->ip;//target ip
-                
-                sr_send_packet(sr, arp_req, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t), out_iface->name);
-                free(arp_req);
-                
-                //update the sent time and number of sent
-                request->sent = now;
-                request->times_sent++;
-            }
+        if(request->times_sent >= sr->cache.retries){
+            //all pkts waiting get an icmp host unreachable, the request is gone
+            todo->expired = sr_arpreq_detach(&sr->cache, request);
+        } else if (request->packets && sr->ifs[request->packets->ifindex]) {
+            //ask on the interface the packets are waiting to go out of
+            todo->ifindex = request->packets->ifindex;
+            //update the sent time and number of sent
+            request->sent = now;
+            request->times_sent++;
         }
     }
 }
 
+//carry out what handle_arpreq decided, without the cache lock
+void sr_arpreq_todo_run(struct sr_instance *sr, struct sr_arpreq_todo *todo) {
+    struct sr_packet *pkt;
+
+    if (todo->ifindex >= 0) {
+        //send request, the transport copies it
+        struct sr_if *out_iface = sr->ifs[todo->ifindex];
+        uint8_t arp_req[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+        sr_ethernet_hdr_t *eth_hdr = (sr_ethernet_hdr_t *) arp_req;
+        sr_arp_hdr_t *arp_hdr = (sr_arp_hdr_t *) (arp_req + sizeof(sr_ethernet_hdr_t));
+
+        memset(eth_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN); //broadcast
+        memcpy(eth_hdr->ether_shost, out_iface->addr, ETHER_ADDR_LEN);//source being our out interface
+        eth_hdr->ether_type = htons(ethertype_arp);
+
+        //ARP header
+        arp_hdr->ar_hrd = htons(arp_hrd_ethernet);
+        arp_hdr->ar_pro = htons(ethertype_ip);
+        arp_hdr->ar_hln = ETHER_ADDR_LEN;
+        arp_hdr->ar_pln = sizeof(uint32_t);
+        arp_hdr->ar_op = htons(arp_op_request);
+        memcpy(arp_hdr->ar_sha, out_iface->addr, ETHER_ADDR_LEN);//same, set source mac to be the outgoing interface
+        arp_hdr->ar_sip = out_iface->ip;  //IP is just the router's IP
+        memset(arp_hdr->ar_tha, 0xff, ETHER_ADDR_LEN);
+        arp_hdr->ar_tip = todo->ip;//target ip
+
+        sr_send_packet_if(sr, arp_req, sizeof(arp_req), out_iface->ifindex);
+    }
+
+    //send icmp host unreachable to source addr of all pkts that were waiting
+    for (pkt = todo->expired; pkt; pkt = pkt->next) {
+        sr_stats_drop(SR_DROP_ARP);
+        sr_send_icmp(sr, pkt->buf, pkt->len, sr->ifs[pkt->ifindex], 3, 1);
+    }
+    sr_arpreq_free_packets(todo->expired);
+    todo->expired = NULL;
+}
+
 /* You should not need to touch the rest of this code. */
 
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
-    pthread_mutex_lock(&(cache->lock));
+   Copies it to *entry and returns 1 if it is there, 0 if not. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip, struct sr_arpentry *entry) {
+    int found = 0;
 
-    struct sr_arpentry *entry = NULL, *copy = NULL;
+    /* Copied out under the read lock b/c another thread could jump in and
+       modify table after we return. */
+    pthread_rwlock_rdlock(&(cache->entries_lock));
 
     int i;
     for (i = 0; i < SR_ARPCACHE_SZ; i++) {
         if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+            memcpy(entry, &(cache->entries[i]), sizeof(struct sr_arpentry));
+            found = 1;
         }
     }
 
-    /* Must return a copy b/c another thread could jump in and modify
-       table after we return. */
-    if (entry) {
-        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
-    }
+    pthread_rwlock_unlock(&(cache->entries_lock));
 
-    pthread_mutex_unlock(&(cache->lock));
-
-    return copy;
+    return found;
 }
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
@@ -111,7 +144,7 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
                                        uint8_t *packet,           /* borrowed */
                                        unsigned int packet_len,
-                                       char *iface)
+                                       int ifindex)
 {
     pthread_mutex_lock(&(cache->lock));
 
@@ -130,17 +163,22 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         cache->requests = req;
     }
 
-    /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
+    /* Add the packet to the list of packets for this request, a next hop
+       that does not answer must not hold an unbounded backlog */
+    if (packet && packet_len && ifindex >= 0 &&
+        req->npackets >= cache->queue_cap) {
+        sr_stats_drop(SR_DROP_QUEUE);
+    }
+    else if (packet && packet_len && ifindex >= 0) {
         struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
 
         new_pkt->buf = (uint8_t *)malloc(packet_len);
         memcpy(new_pkt->buf, packet, packet_len);
         new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
+        new_pkt->ifindex = ifindex;
         new_pkt->next = req->packets;
         req->packets = new_pkt;
+        req->npackets++;
     }
 
     pthread_mutex_unlock(&(cache->lock));
@@ -175,6 +213,8 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
         prev = req;
     }
 
+    pthread_rwlock_wrlock(&(cache->entries_lock));
+
     int i;
     for (i = 0; i < SR_ARPCACHE_SZ; i++) {
         if (!(cache->entries[i].valid))
@@ -188,6 +228,7 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
         cache->entries[i].valid = 1;
     }
 
+    pthread_rwlock_unlock(&(cache->entries_lock));
     pthread_mutex_unlock(&(cache->lock));
 
     return req;
@@ -216,16 +257,7 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
             prev = req;
         }
 
-        struct sr_packet *pkt, *nxt;
-
-        for (pkt = entry->packets; pkt; pkt = nxt) {
-            nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
-        }
+        sr_arpreq_free_packets(entry->packets);
 
         free(entry);
     }
@@ -233,6 +265,41 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
     pthread_mutex_unlock(&(cache->lock));
 }
 
+/* Takes the packets waiting on this arp request, oldest first, and destroys
+   the request. The packets now belong to the caller, who can send them after
+   releasing the cache lock and then free them with sr_arpreq_free_packets. */
+struct sr_packet *sr_arpreq_detach(struct sr_arpcache *cache, struct sr_arpreq *entry) {
+    struct sr_packet *pkt, *nxt, *packets = NULL;
+
+    pthread_mutex_lock(&(cache->lock));
+
+    /* queued newest first, reverse */
+    for (pkt = entry->packets; pkt; pkt = nxt) {
+        nxt = pkt->next;
+        pkt->next = packets;
+        packets = pkt;
+    }
+    entry->packets = NULL;
+    entry->npackets = 0;
+    sr_arpreq_destroy(cache, entry);
+
+    pthread_mutex_unlock(&(cache->lock));
+
+    return packets;
+}
+
+/* Frees a list of packets, e.g. one returned by sr_arpreq_detach. */
+void sr_arpreq_free_packets(struct sr_packet *packets) {
+    struct sr_packet *pkt, *nxt;
+
+    for (pkt = packets; pkt; pkt = nxt) {
+        nxt = pkt->next;
+        if (pkt->buf)
+            free(pkt->buf);
+        free(pkt);
+    }
+}
+
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
@@ -256,26 +323,35 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
     /* Invalidate all entries */
     memset(cache->entries, 0, sizeof(cache->entries));
     cache->requests = NULL;
+    cache->timeout = SR_ARPCACHE_TO;
+    cache->retries = SR_ARPREQ_RETRIES;
+    cache->queue_cap = SR_ARPREQ_MAXPKTS;
 
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
     pthread_mutexattr_settype(&(cache->attr), PTHREAD_MUTEX_RECURSIVE);
     int success = pthread_mutex_init(&(cache->lock), &(cache->attr));
+    if (success == 0)
+        success = pthread_rwlock_init(&(cache->entries_lock), NULL);
 
     return success;
 }
 
 /* Destroys table + table lock. Returns 0 on success. */
 int sr_arpcache_destroy(struct sr_arpcache *cache) {
-    return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
+    int failed = pthread_rwlock_destroy(&(cache->entries_lock));
+    failed |= pthread_mutex_destroy(&(cache->lock));
+    failed |= pthread_mutexattr_destroy(&(cache->attr));
+    return failed;
 }
 
 /* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+   more than cache->timeout (SR_ARPCACHE_TO) seconds ago. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
     struct sr_arpcache *cache = &(sr->cache);
 
+    SR_PROF_THREAD("arp", -1);
     while (1) {
         //TODO: see if it is called
         sleep(1.0);
@@ -284,64 +360,98 @@ void *sr_arpcache_timeout(void *sr_ptr) {
 
         time_t curtime = time(NULL);
 
+        pthread_rwlock_wrlock(&(cache->entries_lock));
         int i;
         for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
+            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > cache->timeout)) {
                 cache->entries[i].valid = 0;
             }
         }
-
-        sr_arpcache_sweepreqs(sr);
+        pthread_rwlock_unlock(&(cache->entries_lock));
 
         pthread_mutex_unlock(&(cache->lock));
+
+        sr_arpcache_sweepreqs(sr);
     }
 
     return NULL;
 }
 
 
-//send an icmp packet
-void sr_send_icmp(struct sr_instance* sr,uint8_t *packet,unsigned int len,char *interface,uint8_t icmp_type,uint8_t icmp_code){
+//send an icmp error about packet back to its sender, from iface
+void sr_send_icmp(struct sr_instance* sr,uint8_t *packet,unsigned int len,struct sr_if *iface,uint8_t icmp_type,uint8_t icmp_code){
 
     //get the headers
     sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*) packet;
     sr_ip_hdr_t* ip_hdr = (sr_ip_hdr_t*) (packet + sizeof(sr_ethernet_hdr_t));
 
-    //allocate the icmp packet
-    unsigned int icmp_packet_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_hdr_t);
-    uint8_t *icmp_packet = (uint8_t *) malloc(icmp_packet_len);
+    //ask the rate limiter before any work, a suppressed reply costs no copy or checksum
+    if (!sr_icmp_allow(&sr->icmp_limit, icmp_type, icmp_code, ip_hdr->ip_src)) {
+        return;
+    }
+
+    //start from the interface's template (sr_if_icmp_template), it has our MAC, IP, ttl and protocol
+    uint8_t icmp_packet[SR_ICMP_ERR_LEN];
+    memcpy(icmp_packet, iface->icmp_err, SR_ICMP_ERR_LEN);
 
-    //sender is the router, receiver is the original sender
+    //receiver is the original sender
     sr_ethernet_hdr_t *icmp_eth_hdr = (sr_ethernet_hdr_t *) icmp_packet;
     memcpy(icmp_eth_hdr->ether_dhost, eth_hdr->ether_shost, ETHER_ADDR_LEN);
-    memcpy(icmp_eth_hdr->ether_shost, sr_get_interface(sr, interface)->addr, ETHER_ADDR_LEN);
-    icmp_eth_hdr->ether_type = eth_hdr->ether_type;//still being ip not arp
 
-    //similarly, copy from ip and reverse the sender & receiver
+    //the template's header sum only lacks the destination
     sr_ip_hdr_t *icmp_ip_hdr = (sr_ip_hdr_t *)(icmp_packet + sizeof(sr_ethernet_hdr_t));
-    memcpy(icmp_ip_hdr, ip_hdr, sizeof(sr_ip_hdr_t));
     icmp_ip_hdr->ip_dst = ip_hdr->ip_src;
-    icmp_ip_hdr->ip_src = sr_get_interface(sr, interface)->ip;
-    icmp_ip_hdr->ip_len = htons(sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_hdr_t));//length is both ip and load(icmp)
-    icmp_ip_hdr->ip_p = ip_protocol_icmp;//protocol being ICMP
-    icmp_ip_hdr->ip_ttl = INIT_TTL;
-
-    //set checksum
-    icmp_ip_hdr->ip_sum = 0;
-    icmp_ip_hdr->ip_sum = cksum(icmp_ip_hdr, sizeof(sr_ip_hdr_t));
+    icmp_ip_hdr->ip_sum = sr_cksum_final(sr_cksum_add(&icmp_ip_hdr->ip_dst, 4, iface->icmp_err_sum));
 
     sr_icmp_hdr_t *icmp_hdr = (sr_icmp_hdr_t *) (icmp_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
     icmp_hdr->icmp_type = icmp_type;
     icmp_hdr->icmp_code = icmp_code;
-    icmp_hdr->icmp_sum = 0;
-    icmp_hdr->unused = 0;//default to be zero
-    memcpy(icmp_hdr->data, packet + sizeof(sr_ethernet_hdr_t), ICMP_DATA_SIZE);//include the cause of ICMP
+    //include the cause of ICMP, the template's zeros pad a packet shorter than that
+    unsigned int quoted = len - sizeof(sr_ethernet_hdr_t);
+    if (quoted > ICMP_DATA_SIZE) {
+        quoted = ICMP_DATA_SIZE;
+    }
+    memcpy(icmp_hdr->data, packet + sizeof(sr_ethernet_hdr_t), quoted);
+
+    //everything in the ICMP part varies, it is only 36 bytes
+    icmp_hdr->icmp_sum = sr_cksum_final(sr_cksum_add(icmp_hdr, sizeof(sr_icmp_hdr_t), 0));
+
+    //send the packet, the transport copies it
+    sr_send_packet_if(sr, icmp_packet, SR_ICMP_ERR_LEN, iface->ifindex);
+}
+
+//answer an echo request by turning the received frame around, payload and all
+//icmp_off is where the ICMP header starts, nothing is allocated or copied
+void sr_send_echo_reply(struct sr_instance* sr,uint8_t *packet,unsigned int len,struct sr_if *iface,unsigned int icmp_off){
+
+    sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*) packet;
+    sr_ip_hdr_t* ip_hdr = (sr_ip_hdr_t*) (packet + sizeof(sr_ethernet_hdr_t));
+    sr_icmp_hdr_t* icmp_hdr = (sr_icmp_hdr_t*) (packet + icmp_off);
 
-    //calculate checksum after evrything is in the packet header
-    icmp_hdr->icmp_sum = cksum(icmp_hdr, sizeof(sr_icmp_hdr_t));
+    if (!sr_icmp_allow(&sr->icmp_limit, 0, 0, ip_hdr->ip_src)) {
+        return;
+    }
 
-    //send the packet
-    sr_send_packet(sr, icmp_packet, icmp_packet_len, interface);
-    free(icmp_packet);
+    //back to whoever sent it, from the interface it came in on
+    memcpy(eth_hdr->ether_dhost, eth_hdr->ether_shost, ETHER_ADDR_LEN);
+    memcpy(eth_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+
+    //swapping the addresses leaves the header sum alone, only the ttl word changes
+    uint32_t addr = ip_hdr->ip_src;
+    ip_hdr->ip_src = ip_hdr->ip_dst;
+    ip_hdr->ip_dst = addr;
+    uint16_t old_w, new_w;
+    memcpy(&old_w, &ip_hdr->ip_ttl, 2);
+    ip_hdr->ip_ttl = INIT_TTL;
+    memcpy(&new_w, &ip_hdr->ip_ttl, 2);
+    ip_hdr->ip_sum = cksum_update16(ip_hdr->ip_sum, old_w, new_w);
+
+    //type 8 becomes 0, patch the ICMP sum for that word instead of summing the payload
+    memcpy(&old_w, &icmp_hdr->icmp_type, 2);
+    icmp_hdr->icmp_type = 0;
+    memcpy(&new_w, &icmp_hdr->icmp_type, 2);
+    icmp_hdr->icmp_sum = cksum_update16(icmp_hdr->icmp_sum, old_w, new_w);
+
+    sr_send_packet_if(sr, packet, len, iface->ifindex);
 }
 
@@ -73,11 +73,13 @@
 
 #define SR_ARPCACHE_SZ    100
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPREQ_MAXPKTS 1024     /* packets held per pending request */
+#define SR_ARPREQ_RETRIES 5        /* ARP requests sent before giving up */
 
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
+    int ifindex;                /* The outgoing interface */
     struct sr_packet *next;
 };
 
@@ -96,19 +98,29 @@ struct sr_arpreq {
     uint32_t times_sent;        /* Number of times this request was sent. You
                                    should update this. */
     struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
+    unsigned int npackets;      /* Length of that list, at most
+                                   queue_cap */
     struct sr_arpreq *next;
 };
 
 struct sr_arpcache {
     struct sr_arpentry entries[SR_ARPCACHE_SZ];
     struct sr_arpreq *requests;
-    pthread_mutex_t lock;
+    double timeout;             /* entry lifetime, SR_ARPCACHE_TO */
+    unsigned int retries;       /* SR_ARPREQ_RETRIES */
+    unsigned int queue_cap;     /* SR_ARPREQ_MAXPKTS */
+    pthread_mutex_t lock;       /* also guards the three settings above,
+                                   which the control socket may change */
     pthread_mutexattr_t attr;
+    pthread_rwlock_t entries_lock; /* guards entries, written with lock
+                                      held too, read on its own */
 };
 
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
+   Copies it to *entry and returns 1 if it is there, 0 if not. Only takes a
+   read lock on the entries, lookups from the workers do not wait for each
+   other or for the request queue. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip, struct sr_arpentry *entry);
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
@@ -121,7 +133,7 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
                          unsigned int packet_len,
-                         char *iface);
+                         int ifindex);
 
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
@@ -135,6 +147,14 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 
+/* Takes the packets waiting on this arp request, oldest first, and destroys
+   the request. The packets now belong to the caller, who can send them after
+   releasing the cache lock and then free them with sr_arpreq_free_packets. */
+struct sr_packet *sr_arpreq_detach(struct sr_arpcache *cache, struct sr_arpreq *entry);
+
+/* Frees a list of packets, e.g. one returned by sr_arpreq_detach. */
+void sr_arpreq_free_packets(struct sr_packet *packets);
+
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
@@ -146,8 +166,24 @@ void sr_arpcache_dump(struct sr_arpcache *cache);
 int   sr_arpcache_init(struct sr_arpcache *cache);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
-void sr_send_icmp(struct sr_instance* sr,uint8_t *packet,unsigned int len,char *interface,uint8_t icmp_type,uint8_t icmp_code);
-void handle_arpreq(struct sr_instance *, struct sr_arpreq *);
+void sr_send_icmp(struct sr_instance* sr,uint8_t *packet,unsigned int len,struct sr_if *iface,uint8_t icmp_type,uint8_t icmp_code);
+void sr_send_echo_reply(struct sr_instance* sr,uint8_t *packet,unsigned int len,struct sr_if *iface,unsigned int icmp_off);
+
+/* What handle_arpreq decided about a request, to be carried out by
+   sr_arpreq_todo_run after the cache lock is released. */
+struct sr_arpreq_todo {
+    uint32_t ip;                /* Address to ask for */
+    int ifindex;                /* Interface to ask on, -1 for no ARP request */
+    struct sr_packet *expired;  /* Given up on, each gets host unreachable */
+    struct sr_arpreq_todo *next;
+};
+
+/* Call with the cache lock held: marks the request sent or takes it off the
+   queue, and fills in todo. Nothing is sent. */
+void handle_arpreq(struct sr_instance *, struct sr_arpreq *, struct sr_arpreq_todo *);
+
+/* Sends what handle_arpreq decided, without the cache lock. */
+void sr_arpreq_todo_run(struct sr_instance *, struct sr_arpreq_todo *);
 
 /* IMPORTANT: To avoid circular dependencies, do a forward declaration of any
 methods from other files that you need to use. For example, if your sr_arpcache
@@ -0,0 +1,1254 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Description:
+ *
+ * Offline benchmark ("make sr_bench").  Links the router objects with a
+ * transport that only counts what the router sends, builds the router's
+ * interfaces, routes and ARP entries from a config file and hands frames
+ * to sr_handlepacket() back to back.  No network, no server, no threads
+ * besides the router's own ARP thread.
+ *
+ *     sr_bench [-c config] [-s scenario|all] [-R pcap] [-g mix] [-L]
+ *              [-n frames] [-f flows] [-b bytes] [-d frames] [-w warmup]
+ *
+ * Generated scenarios:
+ *
+ *     forward   UDP to a next hop in the ARP cache
+ *     arpmiss   UDP to a next hop not in the ARP cache, queued
+ *     ttl       UDP with TTL 1, answered with time exceeded
+ *     echo      ICMP echo requests for the router's own address
+ *     arpreply  SR_BENCH_ARPQ_FRAMES arpmiss frames queued behind one next
+ *               hop, then its ARP reply; reports how long the reply kept
+ *               cache.lock, and how long it would if the queued frames
+ *               were sent inside the lock
+ *     cksum     not a router scenario: every checksum kernel (sr_cksum.h)
+ *               against the byte at a time loop cksum() used to be, over
+ *               random lengths, alignments and contents (random, all 0x00,
+ *               all 0xff), then their GB/s at 20, 64, 576, 1500 and 9000
+ *               bytes; exits 1 on a mismatch
+ *
+ * -R replays the frames of a pcap file instead, each arriving on the
+ * interface its destination MAC belongs to (else the first one).  -g
+ * runs a traffic mix from sr_gen.h over the routes through the other
+ * interfaces, -d distinct frames of it cycled through.
+ *
+ * The config has one item per line, '#' starts a comment:
+ *
+ *     iface eth1,10.0.1.1,02:00:00:00:01:01      as for sr -I
+ *     route 10.0.1.100 10.0.1.100 255.255.255.255 eth1
+ *     arp 10.0.1.100 02:00:00:00:01:64
+ *
+ * Frames come in on the first interface from the first resolved next hop
+ * routed through it.  forward and ttl send to the first route through
+ * another interface with a resolved next hop, arpmiss to the first one
+ * without.  Without -c a built-in config has all of these.
+ *
+ * The router's ICMP rate limits (sr_ratelimit.h) apply as they would in
+ * sr, so ttl measures mostly suppressed replies; -L lifts them to time
+ * every reply being built.
+ *
+ * Reported per scenario: frames/s over the whole loop, ns per frame spent
+ * in sr_handlepacket() (percentiles), heap allocations per frame (malloc,
+ * calloc and realloc are wrapped at link time), the peak RSS, and the
+ * drops and ICMP messages sent or suppressed along the way.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_arpcache.h"
+#include "sr_protocol.h"
+#include "sr_transport.h"
+#include "sr_dumper.h"
+#include "sr_stats.h"
+#include "sr_utils.h"
+#include "sr_cksum.h"
+#include "sr_gen.h"
+
+#define SR_BENCH_FRAMES  1000000 /* timed frames per scenario */
+#define SR_BENCH_FLOWS   64      /* UDP flows in generated scenarios */
+#define SR_BENCH_BYTES   64      /* generated frame size */
+#define SR_BENCH_DISTINCT 65536  /* -g: frames generated, then cycled */
+#define SR_BENCH_MAXLEN  2048    /* largest frame handled */
+#define SR_BENCH_ARPQ    256     /* arpmiss: frames queued before dropping
+                                    the requests (outside the timing) */
+#define SR_BENCH_ARPQ_FRAMES 1000 /* arpreply: frames behind the next hop */
+#define SR_BENCH_ARPQ_ROUNDS 200  /* arpreply: replies timed, each way */
+#define SR_BENCH_CKSUM_CASES 300000 /* cksum: random buffers checked */
+#define SR_BENCH_CKSUM_BYTES (64 << 20) /* cksum: bytes timed per cell */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_bench_frame
+ *
+ * One input frame of the workload, the router gets a fresh copy of it
+ * each time since it rewrites frames in place.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_bench_frame
+{
+    uint8_t* buf;
+    unsigned int len;
+    int ifindex;                /* arrives on sr->ifs[ifindex] */
+};
+
+struct sr_bench_workload
+{
+    struct sr_bench_frame* frames;
+    int n;
+    int size;
+};
+
+static const char* sr_bench_default_config =
+    "iface eth1,10.0.1.1,02:00:00:00:01:01\n"
+    "iface eth2,192.168.2.1,02:00:00:00:02:01\n"
+    "route 10.0.1.100 10.0.1.100 255.255.255.255 eth1\n"
+    "route 192.168.2.2 192.168.2.2 255.255.255.255 eth2\n"
+    "route 172.16.0.0 192.168.2.3 255.255.0.0 eth2\n"
+    "arp 10.0.1.100 02:00:00:00:01:64\n"
+    "arp 192.168.2.2 02:00:00:00:02:02\n";
+
+static const char* sr_bench_scenarios[] =
+{ "forward", "arpmiss", "ttl", "echo", "arpreply", "cksum", 0 };
+
+/* -- what the router sent, by ifindex -- */
+static unsigned long sr_bench_sent[SR_MAX_IFACES];
+
+/* -- heap allocations made by the router, see the wrappers below -- */
+static unsigned long sr_bench_allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&sr_bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&sr_bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+    __atomic_add_fetch(&sr_bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+/* -- cache.lock hold times of the bench thread, pthread_mutex_lock and
+      pthread_mutex_unlock are wrapped at link time as well -- */
+static pthread_mutex_t* sr_bench_watch;
+static __thread int sr_bench_watching;
+static int sr_bench_depth;
+static uint64_t sr_bench_locked_at;
+static uint64_t sr_bench_held;          /* longest hold since reset */
+
+static uint64_t sr_bench_now(void);
+static void sr_bench_free(struct sr_bench_workload* wl);
+
+int __real_pthread_mutex_lock(pthread_mutex_t* m);
+int __real_pthread_mutex_unlock(pthread_mutex_t* m);
+
+int __wrap_pthread_mutex_lock(pthread_mutex_t* m)
+{
+    int rc = __real_pthread_mutex_lock(m);
+
+    /* -- the lock is recursive, time the outermost hold -- */
+    if(rc == 0 && m == sr_bench_watch && sr_bench_watching &&
+       sr_bench_depth++ == 0)
+    { sr_bench_locked_at = sr_bench_now(); }
+    return rc;
+}
+
+int __wrap_pthread_mutex_unlock(pthread_mutex_t* m)
+{
+    uint64_t held;
+
+    if(m == sr_bench_watch && sr_bench_watching && --sr_bench_depth == 0)
+    {
+        held = sr_bench_now() - sr_bench_locked_at;
+        if(held > sr_bench_held)
+        { sr_bench_held = held; }
+    }
+    return __real_pthread_mutex_unlock(m);
+}
+
+/* -- sr_vns_comm.o wants these from sr_main.o, which has the real main() -- */
+
+int sr_verify_routing_table(struct sr_instance* sr)
+{ return 0; }
+
+int sr_start_logger(struct sr_instance* sr)
+{ return 0; }
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_send(..)
+ * Scope: Local
+ *
+ * The bench transport: count and forget.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_send(struct sr_instance* sr, uint8_t* buf,
+                         unsigned int len, int ifindex)
+{
+    sr_bench_sent[ifindex]++;
+    return 0;
+} /* -- sr_bench_send -- */
+
+static const struct sr_transport sr_bench_transport =
+{ "bench", 0, 0, sr_bench_send, 0, 0 };
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_now(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint64_t sr_bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- sr_bench_now -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_parse_mac(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_parse_mac(const char* str, unsigned char* mac)
+{
+    unsigned int b[ETHER_ADDR_LEN];
+    int i;
+
+    if(sscanf(str, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4],
+              &b[5]) != ETHER_ADDR_LEN)
+    { return -1; }
+    for(i = 0; i < ETHER_ADDR_LEN; i++)
+    {
+        if(b[i] > 0xff)
+        { return -1; }
+        mac[i] = b[i];
+    }
+    return 0;
+} /* -- sr_bench_parse_mac -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_config(..)
+ * Scope: Local
+ *
+ * Set up interfaces and routes from the config text, ARP entries need the
+ * cache and are returned in arp_ip/arp_mac.  Returns the number of ARP
+ * entries or -1.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_config(struct sr_instance* sr, const char* text,
+                           uint32_t* arp_ip, unsigned char (*arp_mac)[6],
+                           int max_arp)
+{
+    char line[BUFSIZ];
+    char key[32], a[64], b[64], c[64], d[64];
+    struct sr_if_spec spec;
+    struct in_addr dest, gw, mask;
+    const char* next = 0;
+    int narp = 0;
+    int lineno = 0;
+    int n;
+    size_t len;
+
+    for(; *text; text = next)
+    {
+        next = strchr(text, '\n');
+        next = next ? next + 1 : text + strlen(text);
+        len = next - text < (long)sizeof(line) ? next - text : sizeof(line) - 1;
+        memcpy(line, text, len);
+        line[len] = 0;
+        lineno++;
+
+        if(strchr(line, '#'))
+        { *strchr(line, '#') = 0; }
+        if((n = sscanf(line, "%31s %63s %63s %63s %63s", key, a, b, c, d)) <= 0)
+        { continue; }
+
+        if(strcmp(key, "iface") == 0 && n == 2 &&
+           sr_parse_if_spec(a, &spec) == 0 && spec.has_addr)
+        {
+            sr_add_interface(sr, spec.name);
+            sr_set_ether_addr(sr, spec.addr);
+            sr_set_ether_ip(sr, spec.ip);
+        }
+        else if(strcmp(key, "route") == 0 && n == 5 &&
+                inet_pton(AF_INET, a, &dest) == 1 &&
+                inet_pton(AF_INET, b, &gw) == 1 &&
+                inet_pton(AF_INET, c, &mask) == 1)
+        {
+            if(sr_get_interface(sr, d) == 0)
+            {
+                fprintf(stderr, "config line %d: no interface %s\n", lineno, d);
+                return -1;
+            }
+            sr_add_rt_entry(sr, dest, gw, mask, d);
+        }
+        else if(strcmp(key, "arp") == 0 && n == 3 && narp < max_arp &&
+                inet_pton(AF_INET, a, &arp_ip[narp]) == 1 &&
+                sr_bench_parse_mac(b, arp_mac[narp]) == 0)
+        { narp++; }
+        else
+        {
+            fprintf(stderr, "config line %d not understood: %s\n", lineno, line);
+            return -1;
+        }
+    }
+
+    if(sr->num_ifs == 0)
+    {
+        fprintf(stderr, "config has no interfaces\n");
+        return -1;
+    }
+    return narp;
+} /* -- sr_bench_config -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_read_file(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint8_t* sr_bench_read_file(const char* path, size_t* size)
+{
+    FILE* fp = fopen(path, "rb");
+    uint8_t* data = 0;
+    long len;
+
+    if(fp == 0)
+    {
+        perror(path);
+        return 0;
+    }
+    if(fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < 0 ||
+       fseek(fp, 0, SEEK_SET) != 0)
+    {
+        perror(path);
+        fclose(fp);
+        return 0;
+    }
+    data = (uint8_t*)malloc(len + 1);
+    assert(data);
+    if(fread(data, 1, len, fp) != (size_t)len)
+    {
+        perror(path);
+        free(data);
+        fclose(fp);
+        return 0;
+    }
+    data[len] = 0;
+    fclose(fp);
+
+    *size = len;
+    return data;
+} /* -- sr_bench_read_file -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_add(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_bench_add(struct sr_bench_workload* wl, const uint8_t* buf,
+                         unsigned int len, int ifindex)
+{
+    struct sr_bench_frame* fr = 0;
+
+    if(wl->n == wl->size)
+    {
+        wl->size = wl->size ? 2 * wl->size : 256;
+        wl->frames = (struct sr_bench_frame*)
+            realloc(wl->frames, wl->size * sizeof(struct sr_bench_frame));
+        assert(wl->frames);
+    }
+    fr = &wl->frames[wl->n++];
+    fr->buf = (uint8_t*)malloc(len);
+    assert(fr->buf);
+    memcpy(fr->buf, buf, len);
+    fr->len = len;
+    fr->ifindex = ifindex;
+} /* -- sr_bench_add -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_load_pcap(..)
+ * Scope: Local
+ *
+ * Classic pcap, either byte order, micro or nanosecond stamps.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_load_pcap(struct sr_instance* sr, const char* path,
+                              struct sr_bench_workload* wl)
+{
+    struct pcap_file_header fh;
+    struct pcap_sf_pkthdr ph;
+    struct sr_ethernet_hdr* e_hdr = 0;
+    struct sr_if* iface = 0;
+    uint8_t* data = 0;
+    size_t size = 0;
+    size_t off;
+    uint32_t caplen;
+    int swapped;
+
+    if((data = sr_bench_read_file(path, &size)) == 0)
+    { return -1; }
+    if(size < sizeof(fh))
+    {
+        fprintf(stderr, "%s is not a pcap file\n", path);
+        free(data);
+        return -1;
+    }
+    memcpy(&fh, data, sizeof(fh));
+    swapped = fh.magic == __builtin_bswap32(TCPDUMP_MAGIC) ||
+              fh.magic == __builtin_bswap32(PCAP_NSEC_MAGIC);
+    if(!swapped && fh.magic != TCPDUMP_MAGIC && fh.magic != PCAP_NSEC_MAGIC)
+    {
+        fprintf(stderr, "%s is not a pcap file (pcapng is not read here)\n",
+                path);
+        free(data);
+        return -1;
+    }
+    if((swapped ? __builtin_bswap32(fh.linktype) : fh.linktype)
+       != LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "%s: only ethernet captures supported\n", path);
+        free(data);
+        return -1;
+    }
+
+    for(off = sizeof(fh); off + sizeof(ph) <= size; off += caplen)
+    {
+        memcpy(&ph, data + off, sizeof(ph));
+        off += sizeof(ph);
+        caplen = swapped ? __builtin_bswap32(ph.caplen) : ph.caplen;
+        if(caplen > size - off)
+        { break; }
+        if(caplen < sizeof(struct sr_ethernet_hdr) || caplen > SR_BENCH_MAXLEN)
+        { continue; }
+
+        e_hdr = (struct sr_ethernet_hdr*)(data + off);
+        if((iface = get_interface_from_eth(sr, e_hdr->ether_dhost)) == 0)
+        { iface = sr->ifs[0]; }
+        sr_bench_add(wl, data + off, caplen, iface->ifindex);
+    }
+    free(data);
+
+    if(wl->n == 0)
+    {
+        fprintf(stderr, "%s has no usable frames\n", path);
+        return -1;
+    }
+    return 0;
+} /* -- sr_bench_load_pcap -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_find_hop(..)
+ * Scope: Local
+ *
+ * First route whose next hop is (resolved) or is not in the ARP cache,
+ * through ifindex (out == 0) or through any other interface (out == 1).
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_rt* sr_bench_find_hop(struct sr_instance* sr, int ifindex,
+                                       int out, int resolved)
+{
+    struct sr_arpentry e;
+    struct sr_rt* rt = 0;
+
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        if(rt->ifindex < 0 || (rt->ifindex != ifindex) != out)
+        { continue; }
+        if(sr_arpcache_lookup(&sr->cache, rt->gw.s_addr, &e) == resolved)
+        { return rt; }
+    }
+    return 0;
+} /* -- sr_bench_find_hop -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_frame_ip(..)
+ * Scope: Local
+ *
+ * Ethernet and IPv4 header of a generated frame of len bytes, checksum
+ * included.  Returns the IPv4 header.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_ip_hdr* sr_bench_frame_ip(uint8_t* buf, unsigned int len,
+                                           const unsigned char* dmac,
+                                           const unsigned char* smac,
+                                           uint32_t src, uint32_t dst,
+                                           uint8_t proto, uint8_t ttl,
+                                           uint16_t id)
+{
+    struct sr_ethernet_hdr* e_hdr = (struct sr_ethernet_hdr*)buf;
+    struct sr_ip_hdr* ip_hdr =
+        (struct sr_ip_hdr*)(buf + sizeof(struct sr_ethernet_hdr));
+
+    memset(buf, 0, len);
+    memcpy(e_hdr->ether_dhost, dmac, ETHER_ADDR_LEN);
+    memcpy(e_hdr->ether_shost, smac, ETHER_ADDR_LEN);
+    e_hdr->ether_type = htons(ethertype_ip);
+
+    ip_hdr->ip_v = 4;
+    ip_hdr->ip_hl = sizeof(struct sr_ip_hdr) / 4;
+    ip_hdr->ip_len = htons(len - sizeof(struct sr_ethernet_hdr));
+    ip_hdr->ip_id = htons(id);
+    ip_hdr->ip_ttl = ttl;
+    ip_hdr->ip_p = proto;
+    ip_hdr->ip_src = src;
+    ip_hdr->ip_dst = dst;
+    ip_hdr->ip_sum = cksum(ip_hdr, sizeof(struct sr_ip_hdr));
+
+    return ip_hdr;
+} /* -- sr_bench_frame_ip -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_generate(..)
+ * Scope: Local
+ *
+ * One frame per flow for the named scenario.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_generate(struct sr_instance* sr, const char* scenario,
+                             int flows, unsigned int bytes,
+                             struct sr_bench_workload* wl)
+{
+    uint8_t buf[SR_BENCH_MAXLEN];
+    struct sr_if* in_if = sr->ifs[0];
+    struct sr_arpentry src_e;
+    struct sr_rt* src_rt = 0;
+    struct sr_rt* dst_rt = 0;
+    struct sr_ip_hdr* ip_hdr = 0;
+    uint8_t* l4 = 0;
+    uint32_t dst;
+    unsigned int l4_len;
+    int echo = strcmp(scenario, "echo") == 0;
+    int i;
+
+    if((src_rt = sr_bench_find_hop(sr, in_if->ifindex, 0, 1)) == 0)
+    {
+        fprintf(stderr, "config: no route through %s with a next hop in the "
+                "ARP cache to send from\n", in_if->name);
+        return -1;
+    }
+    sr_arpcache_lookup(&sr->cache, src_rt->gw.s_addr, &src_e);
+
+    if(echo)
+    { dst = in_if->ip; }
+    else
+    {
+        dst_rt = sr_bench_find_hop(sr, in_if->ifindex, 1,
+                                   strcmp(scenario, "arpmiss") != 0);
+        if(dst_rt == 0)
+        {
+            fprintf(stderr, "config: no route through another interface with "
+                    "a%s next hop for %s\n",
+                    strcmp(scenario, "arpmiss") ? " resolved" : "n unresolved",
+                    scenario);
+            return -1;
+        }
+        dst = dst_rt->dest.s_addr;
+    }
+
+    l4_len = bytes - sizeof(struct sr_ethernet_hdr) - sizeof(struct sr_ip_hdr);
+    for(i = 0; i < flows; i++)
+    {
+        ip_hdr = sr_bench_frame_ip(buf, bytes, in_if->addr, src_e.mac,
+                                   src_rt->gw.s_addr, dst,
+                                   echo ? ip_protocol_icmp : ip_protocol_udp,
+                                   strcmp(scenario, "ttl") == 0 ? 1 : 64, i);
+        l4 = (uint8_t*)(ip_hdr + 1);
+        if(echo)
+        {
+            l4[0] = 8;                                   /* echo request */
+            l4[4] = i >> 8;                              /* identifier */
+            l4[5] = i;
+            *(uint16_t*)(l4 + 2) = cksum(l4, l4_len);
+        }
+        else
+        {
+            *(uint16_t*)(l4 + 0) = htons(1024 + i);      /* source port */
+            *(uint16_t*)(l4 + 2) = htons(9);             /* discard */
+            *(uint16_t*)(l4 + 4) = htons(l4_len);
+        }
+        sr_bench_add(wl, buf, bytes, in_if->ifindex);
+    }
+
+    return 0;
+} /* -- sr_bench_generate -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_generate_mix(..)
+ * Scope: Local
+ *
+ * n frames of a traffic mix, sent from the first resolved next hop behind
+ * the first interface, to the routes through the other interfaces.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_generate_mix(struct sr_instance* sr,
+                                 struct sr_gen_opts* opts, long n,
+                                 struct sr_bench_workload* wl)
+{
+    uint8_t buf[SR_GEN_MAXLEN];
+    struct sr_if* in_if = sr->ifs[0];
+    struct sr_gen_route* routes = 0;
+    struct sr_arpentry src_e;
+    struct sr_rt* src_rt = 0;
+    struct sr_rt* rt = 0;
+    struct sr_gen* gen = 0;
+    int nroutes = 0;
+    long i;
+
+    if((src_rt = sr_bench_find_hop(sr, in_if->ifindex, 0, 1)) == 0)
+    {
+        fprintf(stderr, "config: no route through %s with a next hop in the "
+                "ARP cache to send from\n", in_if->name);
+        return -1;
+    }
+    sr_arpcache_lookup(&sr->cache, src_rt->gw.s_addr, &src_e);
+    memcpy(opts->dst_mac, in_if->addr, ETHER_ADDR_LEN);
+    memcpy(opts->src_mac, src_e.mac, ETHER_ADDR_LEN);
+    opts->src_net = src_rt->dest.s_addr & src_rt->mask.s_addr;
+    opts->src_mask = src_rt->mask.s_addr;
+
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    { nroutes++; }
+    routes = (struct sr_gen_route*)calloc(nroutes + 1, sizeof(*routes));
+    assert(routes);
+    nroutes = 0;
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        if(rt->ifindex < 0 || rt->ifindex == in_if->ifindex)
+        { continue; }
+        routes[nroutes].dest = rt->dest.s_addr & rt->mask.s_addr;
+        routes[nroutes].mask = rt->mask.s_addr;
+        routes[nroutes].gw = rt->gw.s_addr;
+        nroutes++;
+    }
+
+    gen = sr_gen_create(opts, routes, nroutes);
+    free(routes);
+    if(gen == 0)
+    {
+        fprintf(stderr, "config: no routes through other interfaces than "
+                "%s for the mix\n", in_if->name);
+        return -1;
+    }
+    for(i = 0; i < n; i++)
+    { sr_bench_add(wl, buf, sr_gen_next(gen, buf), in_if->ifindex); }
+    sr_gen_destroy(gen);
+
+    return 0;
+} /* -- sr_bench_generate_mix -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_flush_arpq(..)
+ * Scope: Local
+ *
+ * Drop every pending ARP request with its frames, as if the next hops had
+ * timed out, so that arpmiss keeps queueing instead of hitting the cap.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_bench_flush_arpq(struct sr_instance* sr)
+{
+    pthread_mutex_lock(&sr->cache.lock);
+    while(sr->cache.requests)
+    { sr_arpreq_destroy(&sr->cache, sr->cache.requests); }
+    pthread_mutex_unlock(&sr->cache.lock);
+} /* -- sr_bench_flush_arpq -- */
+
+static int sr_bench_cmp(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_cksum_old(..)
+ * Scope: Local
+ *
+ * cksum() as it was before sr_cksum.h, the reference for the kernels.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint16_t sr_bench_cksum_old(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    uint32_t sum;
+
+    for(sum = 0; len >= 2; data += 2, len -= 2)
+    { sum += data[0] << 8 | data[1]; }
+    if(len > 0)
+    { sum += data[0] << 8; }
+    while(sum > 0xffff)
+    { sum = (sum >> 16) + (sum & 0xffff); }
+    sum = htons(~sum);
+    return sum ? sum : 0xffff;
+} /* -- sr_bench_cksum_old -- */
+
+static uint64_t sr_bench_rand(uint64_t* s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dull;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_cksum(..)
+ * Scope: Local
+ *
+ * Kernel i is sr_cksum_kernel(names[i]), the last column is cksum()
+ * itself (scalar below 128 bytes, the picked kernel above).  Returns -1
+ * if any of them ever disagrees with the old loop.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_cksum(void)
+{
+    static const char* names[] = { "scalar", "sse2", "avx2" };
+    static const int sizes[] = { 20, 64, 576, 1500, 9000 };
+    const int nk = sizeof(names) / sizeof(names[0]);
+    sr_cksum_fn fns[sizeof(names) / sizeof(names[0])];
+    uint8_t* mem = 0;
+    uint8_t* data = 0;
+    uint64_t seed = 1;
+    uint64_t start;
+    unsigned long bad = 0, folded0 = 0;
+    volatile uint64_t sink = 0;
+    uint16_t want, got;
+    long iters, it;
+    int c, k, s, len, fill;
+    size_t i;
+
+    mem = (uint8_t*)malloc(65536 + 64);
+    assert(mem);
+    for(k = 0; k < nk; k++)
+    {
+        if((fns[k] = sr_cksum_kernel(names[k])) == 0)
+        { printf("cksum: no %s kernel on this cpu, skipped\n", names[k]); }
+    }
+
+    for(c = 0; c < SR_BENCH_CKSUM_CASES; c++)
+    {
+        /* -- mostly packet sizes, now and then up to 64k -- */
+        len = c % 16 ? sr_bench_rand(&seed) % 9200
+                     : sr_bench_rand(&seed) % 65537;
+        data = mem + sr_bench_rand(&seed) % 64;
+        fill = c % 3;
+        if(fill == 0)
+        {
+            for(i = 0; i < (size_t)len; i++)
+            { data[i] = sr_bench_rand(&seed); }
+        }
+        else
+        { memset(data, fill == 1 ? 0x00 : 0xff, len); }
+
+        want = sr_bench_cksum_old(data, len);
+        folded0 += (uint16_t)~sr_cksum_fold(sr_cksum_add(data, len, 0)) == 0;
+        for(k = 0; k <= nk; k++)
+        {
+            if(k < nk && fns[k] == 0)
+            { continue; }
+            if(k < nk)
+            { got = sr_cksum_final(fns[k](data, len)); }
+            else
+            { got = cksum(data, len); }
+            if(got != want && bad++ < 10)
+            {
+                printf("cksum: %s gives %04x, old loop %04x (%d bytes at "
+                       "offset %d, %s)\n", k < nk ? names[k] : "cksum()",
+                       got, want, len, (int)(data - mem),
+                       fill == 0 ? "random" : fill == 1 ? "0x00" : "0xff");
+            }
+        }
+    }
+    printf("cksum: %d buffers of 0-65536 bytes, %lu folded to 0 and were "
+           "reported as 0xffff, %lu mismatches\n", SR_BENCH_CKSUM_CASES,
+           folded0, bad);
+
+#ifndef __OPTIMIZE__
+    printf("  (built without -O, the kernels are several times faster "
+           "with it)\n");
+#endif
+    printf("  cksum() uses the %s kernel\n", sr_cksum_name());
+    printf("  GB/s   %8s %8s %8s %8s %8s\n", "old", names[0], names[1],
+           names[2], "cksum()");
+    for(i = 0; i < 65536; i++)
+    { mem[i] = sr_bench_rand(&seed); }
+    for(s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+    {
+        len = sizes[s];
+        iters = SR_BENCH_CKSUM_BYTES / len;
+        printf("  %5d", len);
+        for(k = -1; k <= nk; k++)
+        {
+            if(k >= 0 && k < nk && fns[k] == 0)
+            {
+                printf(" %8s", "-");
+                continue;
+            }
+            start = sr_bench_now();
+            for(it = 0; it < iters; it++)
+            {
+                /* -- step through the buffer so every call loads -- */
+                data = mem + (it * 64) % (65536 - 9000);
+                if(k < 0)
+                { sink += sr_bench_cksum_old(data, len); }
+                else if(k < nk)
+                { sink += fns[k](data, len); }
+                else
+                { sink += cksum(data, len); }
+            }
+            printf(" %8.1f", (double)iters * len / (sr_bench_now() - start));
+        }
+        printf("\n");
+    }
+
+    free(mem);
+    return bad ? -1 : 0;
+} /* -- sr_bench_cksum -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_arpreply(..)
+ * Scope: Local
+ *
+ * Each round forgets the next hop, queues SR_BENCH_ARPQ_FRAMES frames
+ * behind it and hands the router the hop's ARP reply, timing the longest
+ * cache.lock hold while the reply is handled.  The second half of the
+ * rounds holds cache.lock around the whole reply, which is how long the
+ * lock was held when the queued frames were sent inside it.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_arpreply(struct sr_instance* sr, unsigned int bytes)
+{
+    static const unsigned char hop_mac[ETHER_ADDR_LEN] =
+    { 0x02, 0x00, 0x00, 0x00, 0xee, 0x01 };
+    uint8_t buf[SR_BENCH_MAXLEN];
+    uint8_t reply[sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr)];
+    struct sr_ethernet_hdr* e_hdr = (struct sr_ethernet_hdr*)reply;
+    struct sr_arp_hdr* a_hdr =
+        (struct sr_arp_hdr*)(reply + sizeof(struct sr_ethernet_hdr));
+    struct sr_bench_workload wl;
+    struct sr_if* out_if = 0;
+    struct sr_rt* rt = 0;
+    uint32_t held[2][SR_BENCH_ARPQ_ROUNDS];
+    unsigned long sent[2] = { 0, 0 };
+    unsigned long before;
+    int inside, round, i, k;
+
+    memset(&wl, 0, sizeof(wl));
+    if(sr_bench_generate(sr, "arpmiss", 1, bytes, &wl) != 0)
+    { return -1; }
+    rt = sr_bench_find_hop(sr, sr->ifs[0]->ifindex, 1, 0);
+    out_if = sr->ifs[rt->ifindex];
+
+    memset(reply, 0, sizeof(reply));
+    memcpy(e_hdr->ether_dhost, out_if->addr, ETHER_ADDR_LEN);
+    memcpy(e_hdr->ether_shost, hop_mac, ETHER_ADDR_LEN);
+    e_hdr->ether_type = htons(ethertype_arp);
+    a_hdr->ar_hrd = htons(arp_hrd_ethernet);
+    a_hdr->ar_pro = htons(ethertype_ip);
+    a_hdr->ar_hln = ETHER_ADDR_LEN;
+    a_hdr->ar_pln = 4;
+    a_hdr->ar_op = htons(arp_op_reply);
+    memcpy(a_hdr->ar_sha, hop_mac, ETHER_ADDR_LEN);
+    a_hdr->ar_sip = rt->gw.s_addr;
+    memcpy(a_hdr->ar_tha, out_if->addr, ETHER_ADDR_LEN);
+    a_hdr->ar_tip = out_if->ip;
+
+    pthread_mutex_lock(&sr->cache.lock);
+    if(sr->cache.queue_cap < SR_BENCH_ARPQ_FRAMES)
+    { sr->cache.queue_cap = SR_BENCH_ARPQ_FRAMES; }
+    pthread_mutex_unlock(&sr->cache.lock);
+
+    sr_bench_watch = &sr->cache.lock;
+    for(inside = 0; inside < 2; inside++)
+    {
+        for(round = 0; round < SR_BENCH_ARPQ_ROUNDS; round++)
+        {
+            /* -- forget the hop so the frames queue again -- */
+            pthread_mutex_lock(&sr->cache.lock);
+            pthread_rwlock_wrlock(&sr->cache.entries_lock);
+            for(i = 0; i < SR_ARPCACHE_SZ; i++)
+            {
+                if(sr->cache.entries[i].ip == rt->gw.s_addr)
+                { sr->cache.entries[i].valid = 0; }
+            }
+            pthread_rwlock_unlock(&sr->cache.entries_lock);
+            pthread_mutex_unlock(&sr->cache.lock);
+
+            for(i = 0; i < SR_BENCH_ARPQ_FRAMES; i++)
+            {
+                memcpy(buf, wl.frames[0].buf, wl.frames[0].len);
+                sr_handlepacket(sr, buf, wl.frames[0].len,
+                                sr->ifs[wl.frames[0].ifindex]->name);
+            }
+
+            before = sr_bench_sent[out_if->ifindex];
+            sr_bench_held = 0;
+            sr_bench_watching = 1;
+            if(inside)
+            { pthread_mutex_lock(&sr->cache.lock); }
+            memcpy(buf, reply, sizeof(reply));
+            sr_handlepacket(sr, buf, sizeof(reply), out_if->name);
+            if(inside)
+            { pthread_mutex_unlock(&sr->cache.lock); }
+            sr_bench_watching = 0;
+            held[inside][round] = sr_bench_held;
+            sent[inside] += sr_bench_sent[out_if->ifindex] - before;
+        }
+    }
+    sr_bench_watch = 0;
+
+    printf("arpreply: %d frames queued behind %s, %d replies each way\n",
+           SR_BENCH_ARPQ_FRAMES, inet_ntoa(rt->gw), SR_BENCH_ARPQ_ROUNDS);
+    for(k = 0; k < 2; k++)
+    {
+        qsort(held[k], SR_BENCH_ARPQ_ROUNDS, sizeof(uint32_t), sr_bench_cmp);
+        printf("  cache.lock held ns, %s  p50 %u  p90 %u  max %u  "
+               "(%.0f frames sent per reply)\n",
+               k ? "frames sent inside the lock " :
+                   "frames sent after unlocking",
+               held[k][SR_BENCH_ARPQ_ROUNDS / 2],
+               held[k][SR_BENCH_ARPQ_ROUNDS * 9 / 10],
+               held[k][SR_BENCH_ARPQ_ROUNDS - 1],
+               (double)sent[k] / SR_BENCH_ARPQ_ROUNDS);
+    }
+
+    sr_bench_free(&wl);
+    return 0;
+} /* -- sr_bench_arpreply -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_run(..)
+ * Scope: Local
+ *
+ * warmup untimed frames, then n timed ones, cycling through the workload.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_bench_run(struct sr_instance* sr, const char* name,
+                         const struct sr_bench_workload* wl, long n,
+                         long warmup, int arpmiss)
+{
+    static struct sr_if_stats ifs[SR_MAX_IFACES];
+    uint64_t drops0[SR_DROP_NREASONS], drops1[SR_DROP_NREASONS];
+    uint64_t icmp0[SR_ICMP_NKINDS], icmp1[SR_ICMP_NKINDS];
+    uint64_t quiet0[SR_ICMP_NKINDS], quiet1[SR_ICMP_NKINDS];
+    uint8_t buf[SR_BENCH_MAXLEN];
+    const struct sr_bench_frame* fr = 0;
+    uint32_t* ns = 0;
+    unsigned long sent = 0;
+    unsigned long allocs;
+    uint64_t start, end, t0, t1, sum = 0;
+    struct rusage ru;
+    long i;
+    int k;
+
+    ns = (uint32_t*)malloc(n * sizeof(uint32_t));
+    assert(ns);
+
+    for(i = 0; i < warmup; i++)
+    {
+        fr = &wl->frames[i % wl->n];
+        memcpy(buf, fr->buf, fr->len);
+        sr_handlepacket(sr, buf, fr->len, sr->ifs[fr->ifindex]->name);
+        if(arpmiss && i % SR_BENCH_ARPQ == SR_BENCH_ARPQ - 1)
+        { sr_bench_flush_arpq(sr); }
+    }
+    if(arpmiss)
+    { sr_bench_flush_arpq(sr); }
+
+    sr_stats_sum(ifs, drops0);
+    sr_stats_sum_icmp(icmp0, quiet0);
+    memset(sr_bench_sent, 0, sizeof(sr_bench_sent));
+    allocs = __atomic_load_n(&sr_bench_allocs, __ATOMIC_RELAXED);
+
+    start = sr_bench_now();
+    for(i = 0; i < n; i++)
+    {
+        fr = &wl->frames[i % wl->n];
+        memcpy(buf, fr->buf, fr->len);
+
+        t0 = sr_bench_now();
+        sr_handlepacket(sr, buf, fr->len, sr->ifs[fr->ifindex]->name);
+        t1 = sr_bench_now();
+        ns[i] = t1 - t0 > UINT32_MAX ? UINT32_MAX : t1 - t0;
+        sum += ns[i];
+
+        if(arpmiss && i % SR_BENCH_ARPQ == SR_BENCH_ARPQ - 1)
+        { sr_bench_flush_arpq(sr); }
+    }
+    end = sr_bench_now();
+
+    allocs = __atomic_load_n(&sr_bench_allocs, __ATOMIC_RELAXED) - allocs;
+    sr_stats_sum(ifs, drops1);
+    sr_stats_sum_icmp(icmp1, quiet1);
+    for(k = 0; k < sr->num_ifs; k++)
+    { sent += sr_bench_sent[k]; }
+    if(arpmiss)
+    { sr_bench_flush_arpq(sr); }
+
+    qsort(ns, n, sizeof(uint32_t), sr_bench_cmp);
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("%s: %ld frames (%d distinct), %lu sent\n", name, n, wl->n, sent);
+    printf("  %.0f frames/s, %.3f s\n", n / ((end - start) / 1e9),
+           (end - start) / 1e9);
+    printf("  ns/frame  mean %.0f  p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+           (double)sum / n, ns[n / 2], ns[n * 9 / 10], ns[n * 99 / 100],
+           ns[n * 999 / 1000], ns[n - 1]);
+    printf("  allocs/frame %.2f  peak RSS %ld kB\n", (double)allocs / n,
+           ru.ru_maxrss);
+    for(k = 0; k < SR_DROP_NREASONS; k++)
+    {
+        if(drops1[k] != drops0[k])
+        {
+            printf("  dropped %s %llu\n", sr_stats_drop_name(k),
+                   (unsigned long long)(drops1[k] - drops0[k]));
+        }
+    }
+    for(k = 0; k < SR_ICMP_NKINDS; k++)
+    {
+        if(icmp1[k] != icmp0[k] || quiet1[k] != quiet0[k])
+        {
+            printf("  icmp %s sent %llu suppressed %llu\n",
+                   sr_stats_icmp_name(k),
+                   (unsigned long long)(icmp1[k] - icmp0[k]),
+                   (unsigned long long)(quiet1[k] - quiet0[k]));
+        }
+    }
+
+    free(ns);
+} /* -- sr_bench_run -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_free(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_bench_free(struct sr_bench_workload* wl)
+{
+    int i;
+
+    for(i = 0; i < wl->n; i++)
+    { free(wl->frames[i].buf); }
+    free(wl->frames);
+    memset(wl, 0, sizeof(*wl));
+} /* -- sr_bench_free -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-c config] [-s scenario|all] [-R pcap] [-n frames]\n",
+           argv0);
+    printf("           [-g mix] [-L] [-f flows] [-b bytes] [-d frames] [-w warmup]\n");
+    printf("           [-k kernel]\n");
+    printf("   scenarios: forward arpmiss ttl echo arpreply cksum "
+           "(default all)\n");
+    printf("   -n timed frames per scenario (%d), -w untimed ones first\n",
+           SR_BENCH_FRAMES);
+    printf("   -f UDP flows (%d) and -b frame size (%d) of generated frames\n",
+           SR_BENCH_FLOWS, SR_BENCH_BYTES);
+    printf("   -R replays a pcap file instead of generating frames\n");
+    printf("   -g runs a traffic mix (see sr_gen.h) of -d distinct frames (%d)\n",
+           SR_BENCH_DISTINCT);
+    printf("   -L lifts the router's ICMP rate limits\n");
+    printf("   -k makes the router checksum with scalar, sse2 or avx2\n");
+    printf("   the config format is described at the top of sr_bench.c\n");
+}
+
+int main(int argc, char** argv)
+{
+    static uint32_t arp_ip[SR_ARPCACHE_SZ];
+    static unsigned char arp_mac[SR_ARPCACHE_SZ][6];
+    struct sr_instance sr;
+    struct sr_bench_workload wl;
+    const char* config = sr_bench_default_config;
+    const char* scenario = "all";
+    const char* replay = 0;
+    struct sr_gen_opts mix;
+    int use_mix = 0;
+    int unlimited = 0;
+    long distinct = SR_BENCH_DISTINCT;
+    uint8_t* text = 0;
+    size_t size;
+    long n = SR_BENCH_FRAMES;
+    long warmup = -1;
+    int flows = SR_BENCH_FLOWS;
+    unsigned int bytes = SR_BENCH_BYTES;
+    unsigned int min_bytes;
+    int narp, found = 0;
+    int c, i;
+
+    while((c = getopt(argc, argv, "hc:s:R:g:Ln:f:b:d:w:k:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'c':
+                if((text = sr_bench_read_file(optarg, &size)) == 0)
+                { exit(1); }
+                config = (const char*)text;
+                break;
+            case 's':
+                scenario = optarg;
+                break;
+            case 'R':
+                replay = optarg;
+                break;
+            case 'g':
+                sr_gen_defaults(&mix);
+                if(sr_gen_parse(&mix, optarg) != 0)
+                { exit(1); }
+                use_mix = 1;
+                break;
+            case 'd':
+                distinct = atol(optarg);
+                break;
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 'f':
+                flows = atoi(optarg);
+                break;
+            case 'b':
+                bytes = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atol(optarg);
+                break;
+            case 'L':
+                unlimited = 1;
+                break;
+            case 'k':
+                if(sr_cksum_select(optarg) != 0)
+                {
+                    fprintf(stderr, "no %s checksum kernel on this cpu\n",
+                            optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+
+    min_bytes = sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr) + 8;
+    if(n <= 0 || flows <= 0 || distinct <= 0 || bytes < min_bytes ||
+       bytes > SR_BENCH_MAXLEN)
+    {
+        fprintf(stderr, "need -n > 0, -f > 0, -d > 0 and %u <= -b <= %d\n",
+                min_bytes, SR_BENCH_MAXLEN);
+        exit(1);
+    }
+    if(warmup < 0)
+    { warmup = n / 10; }
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    sr.transport = &sr_bench_transport;
+    sr_log_level = SR_LOG_ERROR;
+
+    if((narp = sr_bench_config(&sr, config, arp_ip, arp_mac,
+                               SR_ARPCACHE_SZ)) < 0)
+    { exit(1); }
+    free(text);
+
+    sr_init(&sr);
+    for(i = 0; unlimited && i <= SR_ICMP_NKINDS; i++)
+    { sr_icmp_limit_set(&sr.icmp_limit, i, 0, 1); }
+    for(i = 0; i < narp; i++)
+    { sr_arpcache_insert(&sr.cache, arp_mac[i], arp_ip[i]); }
+
+    /* -- the static entries must outlive the run; the sweeper thread is
+     *    already up and reads timeout under the lock -- */
+    pthread_mutex_lock(&sr.cache.lock);
+    sr.cache.timeout = 1e9;
+    pthread_mutex_unlock(&sr.cache.lock);
+
+    memset(&wl, 0, sizeof(wl));
+    if(replay)
+    {
+        if(sr_bench_load_pcap(&sr, replay, &wl) != 0)
+        { exit(1); }
+        sr_bench_run(&sr, replay, &wl, n, warmup, 0);
+        sr_bench_free(&wl);
+        return 0;
+    }
+    if(use_mix)
+    {
+        if(sr_bench_generate_mix(&sr, &mix, distinct, &wl) != 0)
+        { exit(1); }
+        /* -- new next hops never resolve here, keep their queues short -- */
+        sr_bench_run(&sr, "mix", &wl, n, warmup, 1);
+        sr_bench_free(&wl);
+        return 0;
+    }
+
+    for(i = 0; sr_bench_scenarios[i]; i++)
+    {
+        if(strcmp(scenario, "all") && strcmp(scenario, sr_bench_scenarios[i]))
+        { continue; }
+        found = 1;
+        if(strcmp(sr_bench_scenarios[i], "cksum") == 0)
+        {
+            if(sr_bench_cksum() != 0)
+            { exit(1); }
+            continue;
+        }
+        if(strcmp(sr_bench_scenarios[i], "arpreply") == 0)
+        {
+            if(sr_bench_arpreply(&sr, bytes) != 0)
+            { exit(1); }
+            continue;
+        }
+        if(sr_bench_generate(&sr, sr_bench_scenarios[i], flows, bytes, &wl) != 0)
+        { exit(1); }
+        sr_bench_run(&sr, sr_bench_scenarios[i], &wl, n, warmup,
+                     strcmp(sr_bench_scenarios[i], "arpmiss") == 0);
+        sr_bench_free(&wl);
+    }
+    if(!found)
+    {
+        fprintf(stderr, "unknown scenario %s\n", scenario);
+        exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.c
+ *
+ * Description:
+ *
+ * Internet checksum kernels, see sr_cksum.h.
+ *
+ * The vector kernels split every 16 bit word into its own 32 bit lane and
+ * add lanes, so a lane can take 32768 blocks before it might carry out.
+ * They spill to the 64 bit scalar sum well before that.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "sr_cksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SR_CKSUM_X86
+#include <immintrin.h>
+#endif
+
+/* blocks per lane before the vector kernels spill */
+#define SR_CKSUM_SPILL 16384
+
+/* below this many bytes the vector kernels lose to the scalar loop */
+#define SR_CKSUM_VEC_MIN 128
+
+struct sr_cksum_kernel
+{
+    const char* name;
+    sr_cksum_fn fn;
+    int (*usable)(void);
+};
+
+static uint64_t sr_cksum_resolve(const uint8_t* data, int len);
+
+static sr_cksum_fn sr_cksum_impl = sr_cksum_resolve;
+static const char* sr_cksum_impl_name = "unresolved";
+
+static inline uint64_t sr_cksum_add64(uint64_t sum, uint64_t v)
+{
+    sum += v;
+    return sum + (sum < v);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_scalar(..)
+ * Scope:  Local
+ *
+ * 8 bytes per step with end around carry, then the tail.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_cksum_scalar(const uint8_t* data, int len)
+{
+    uint64_t sum = 0;
+    uint64_t w64;
+    uint32_t w32;
+    uint16_t w16;
+
+    while(len >= 32)
+    {
+        memcpy(&w64, data, 8);      sum = sr_cksum_add64(sum, w64);
+        memcpy(&w64, data + 8, 8);  sum = sr_cksum_add64(sum, w64);
+        memcpy(&w64, data + 16, 8); sum = sr_cksum_add64(sum, w64);
+        memcpy(&w64, data + 24, 8); sum = sr_cksum_add64(sum, w64);
+        data += 32;
+        len -= 32;
+    }
+    while(len >= 8)
+    {
+        memcpy(&w64, data, 8);
+        sum = sr_cksum_add64(sum, w64);
+        data += 8;
+        len -= 8;
+    }
+    if(len >= 4)
+    {
+        memcpy(&w32, data, 4);
+        sum = sr_cksum_add64(sum, w32);
+        data += 4;
+        len -= 4;
+    }
+    if(len >= 2)
+    {
+        memcpy(&w16, data, 2);
+        sum = sr_cksum_add64(sum, w16);
+        data += 2;
+        len -= 2;
+    }
+    if(len > 0)
+    {
+        /* -- odd byte is the first byte of a zero padded word -- */
+        w16 = 0;
+        memcpy(&w16, data, 1);
+        sum = sr_cksum_add64(sum, w16);
+    }
+    return sum;
+} /* -- sr_cksum_scalar -- */
+
+static int sr_cksum_always(void) { return 1; }
+
+#ifdef SR_CKSUM_X86
+
+__attribute__ ((target ("sse2")))
+static uint64_t sr_cksum_sse2(const uint8_t* data, int len)
+{
+    const __m128i lo16 = _mm_set1_epi32(0xffff);
+    uint64_t sum = 0;
+    uint32_t lane[4];
+
+    while(len >= 16)
+    {
+        __m128i acc = _mm_setzero_si128();
+        int n = 0;
+
+        while(len >= 16 && n < SR_CKSUM_SPILL)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)data);
+            acc = _mm_add_epi32(acc, _mm_and_si128(v, lo16));
+            acc = _mm_add_epi32(acc, _mm_srli_epi32(v, 16));
+            data += 16;
+            len -= 16;
+            n++;
+        }
+
+        _mm_storeu_si128((__m128i*)lane, acc);
+        sum += (uint64_t)lane[0] + lane[1] + lane[2] + lane[3];
+    }
+    return sr_cksum_add64(sum, sr_cksum_scalar(data, len));
+}
+
+static int sr_cksum_has_sse2(void)
+{ return __builtin_cpu_supports("sse2"); }
+
+__attribute__ ((target ("avx2")))
+static uint64_t sr_cksum_avx2(const uint8_t* data, int len)
+{
+    const __m256i lo16 = _mm256_set1_epi32(0xffff);
+    uint64_t sum = 0;
+    uint32_t lane[8];
+    int i;
+
+    while(len >= 32)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        int n = 0;
+
+        while(len >= 64 && n < SR_CKSUM_SPILL)
+        {
+            __m256i v0 = _mm256_loadu_si256((const __m256i*)data);
+            __m256i v1 = _mm256_loadu_si256((const __m256i*)(data + 32));
+            acc = _mm256_add_epi32(acc, _mm256_and_si256(v0, lo16));
+            acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v0, 16));
+            acc = _mm256_add_epi32(acc, _mm256_and_si256(v1, lo16));
+            acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v1, 16));
+            data += 64;
+            len -= 64;
+            n += 2;
+        }
+        if(len >= 32 && n < SR_CKSUM_SPILL)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*)data);
+            acc = _mm256_add_epi32(acc, _mm256_and_si256(v, lo16));
+            acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v, 16));
+            data += 32;
+            len -= 32;
+        }
+
+        _mm256_storeu_si256((__m256i*)lane, acc);
+        for(i = 0; i < 8; i++)
+        { sum += lane[i]; }
+    }
+    return sr_cksum_add64(sum, sr_cksum_scalar(data, len));
+}
+
+static int sr_cksum_has_avx2(void)
+{ return __builtin_cpu_supports("avx2"); }
+
+#endif /* SR_CKSUM_X86 */
+
+/* -- best first -- */
+static const struct sr_cksum_kernel sr_cksum_kernels[] =
+{
+#ifdef SR_CKSUM_X86
+    { "avx2",   sr_cksum_avx2,   sr_cksum_has_avx2 },
+    { "sse2",   sr_cksum_sse2,   sr_cksum_has_sse2 },
+#endif /* SR_CKSUM_X86 */
+    { "scalar", sr_cksum_scalar, sr_cksum_always },
+    { 0, 0, 0 }
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_probe(..)
+ * Scope:  Local
+ *
+ * Install the best kernel the cpu has.  Threads racing here all store
+ * the same kernel, so no lock is needed.
+ *
+ *---------------------------------------------------------------------*/
+
+static sr_cksum_fn sr_cksum_probe(void)
+{
+    const struct sr_cksum_kernel* k = sr_cksum_kernels;
+
+#ifdef SR_CKSUM_X86
+    __builtin_cpu_init();
+#endif /* SR_CKSUM_X86 */
+
+    while(!k->usable())
+    { k++; }
+
+    sr_cksum_impl_name = k->name;
+    __atomic_store_n(&sr_cksum_impl, k->fn, __ATOMIC_RELEASE);
+
+    return k->fn;
+} /* -- sr_cksum_probe -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_resolve(..)
+ * Scope:  Local
+ *
+ * First call through sr_cksum_impl.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_cksum_resolve(const uint8_t* data, int len)
+{
+    return sr_cksum_probe()(data, len);
+} /* -- sr_cksum_resolve -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_cksum_add(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+uint64_t sr_cksum_add(const void* data, int len, uint64_t sum)
+{
+    if(len <= 0)
+    { return sum; }
+    if(len < SR_CKSUM_VEC_MIN)
+    { return sr_cksum_add64(sum, sr_cksum_scalar(data, len)); }
+
+    return sr_cksum_add64(sum,
+            __atomic_load_n(&sr_cksum_impl, __ATOMIC_ACQUIRE)(data, len));
+} /* -- sr_cksum_add -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_cksum_select(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_cksum_select(const char* name)
+{
+    const struct sr_cksum_kernel* k = 0;
+
+#ifdef SR_CKSUM_X86
+    __builtin_cpu_init();
+#endif /* SR_CKSUM_X86 */
+
+    for(k = sr_cksum_kernels; k->name; k++)
+    {
+        if(strcmp(k->name, name) == 0 && k->usable())
+        {
+            sr_cksum_impl_name = k->name;
+            __atomic_store_n(&sr_cksum_impl, k->fn, __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+    return -1;
+} /* -- sr_cksum_select -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_cksum_kernel(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+sr_cksum_fn sr_cksum_kernel(const char* name)
+{
+    const struct sr_cksum_kernel* k = 0;
+
+#ifdef SR_CKSUM_X86
+    __builtin_cpu_init();
+#endif /* SR_CKSUM_X86 */
+
+    for(k = sr_cksum_kernels; k->name; k++)
+    {
+        if(strcmp(k->name, name) == 0 && k->usable())
+        { return k->fn; }
+    }
+    return 0;
+} /* -- sr_cksum_kernel -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_cksum_name(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+const char* sr_cksum_name(void)
+{
+    if(__atomic_load_n(&sr_cksum_impl, __ATOMIC_ACQUIRE) == sr_cksum_resolve)
+    { sr_cksum_probe(); }
+
+    return sr_cksum_impl_name;
+} /* -- sr_cksum_name -- */
@@ -0,0 +1,63 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.h
+ *
+ * Description:
+ *
+ * Internet checksum (RFC 1071) kernels.  Words are summed in host byte
+ * order, the ones' complement sum does not care about byte order as long
+ * as the folded result is stored back to memory unchanged (RFC 1071 2.B).
+ * On x86 an SSE2 or AVX2 kernel is picked at first use from what CPUID
+ * reports, everything else uses a 64 bit scalar loop.  cksum() in
+ * sr_utils.c is built on top of these.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CKSUM_H
+#define SR_CKSUM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+/* Add the len bytes at data to the running sum, not folded.  data must
+   start at an even offset of the area being checksummed, only the last
+   piece may have an odd length. */
+uint64_t sr_cksum_add(const void* data, int len, uint64_t sum);
+
+/* Fold a running sum down to 16 bits, not complemented. */
+static inline uint16_t sr_cksum_fold(uint64_t sum)
+{
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return (uint16_t)sum;
+}
+
+/* The checksum to store for a running sum: folded and complemented, with
+   0 given as 0xffff as cksum() always has. */
+static inline uint16_t sr_cksum_final(uint64_t sum)
+{
+    uint16_t c = ~sr_cksum_fold(sum);
+    return c ? c : 0xffff;
+}
+
+typedef uint64_t (*sr_cksum_fn)(const uint8_t* data, int len);
+
+/* The kernel called name, 0 if it is unknown or the cpu lacks it.  It
+   returns the unfolded sum of len bytes, as sr_cksum_add(data, len, 0)
+   does, but is used at any length.  For benchmarks and cross checks. */
+sr_cksum_fn sr_cksum_kernel(const char* name);
+
+/* Force a kernel ("scalar", "sse2", "avx2"), 0 on success, -1 if it is
+   unknown or the cpu lacks it.  For benchmarks and cross checks. */
+int sr_cksum_select(const char* name);
+
+/* Name of the kernel in use. */
+const char* sr_cksum_name(void);
+
+#endif /* -- SR_CKSUM_H -- */
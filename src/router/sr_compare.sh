@@ -0,0 +1,108 @@
+#!/bin/bash
+#------------------------------------------------------------------------------
+# File: sr_compare.sh ("make compare")
+#
+# Runs ./sr and the reference router (../sr_solution, or
+# ../sr_solution_macm on aarch64) one after the other against sr_vnsd with
+# the same workload and prints them side by side, one table per offered
+# rate:
+#
+#   fwd/s      frames forwarded per second
+#   lost       frames sent but not forwarded
+#   p50..max   one way latency through the router, microseconds
+#   arp_ms     from the first frame to the router's ARP request for the
+#              destination
+#   first_ms   from the first frame to the first one forwarded
+#   cpu_ns     router CPU time (user + sys, whole run) per frame sent
+#
+# Usage: ./sr_compare.sh [-r "rate ..."] [-T seconds] [-b bytes] [-f flows]
+#                        [-t ttl] [-p port] [router ...]
+#
+# Routers given on the command line replace the default pair.
+#------------------------------------------------------------------------------
+
+RATES="10000 50000 100000"
+SECONDS_PER_RUN=5
+BYTES=64
+FLOWS=1
+TTL=64
+PORT=8890
+
+while getopts "r:T:b:f:t:p:h" opt; do
+    case $opt in
+        r) RATES=$OPTARG ;;
+        T) SECONDS_PER_RUN=$OPTARG ;;
+        b) BYTES=$OPTARG ;;
+        f) FLOWS=$OPTARG ;;
+        t) TTL=$OPTARG ;;
+        p) PORT=$OPTARG ;;
+        *) sed -n '2,22p' "$0" | sed 's/^# \{0,1\}//'; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+cd "$(dirname "$0")" || exit 1
+
+if [ $# -gt 0 ]; then
+    ROUTERS="$*"
+else
+    case $(uname -m) in
+        aarch64|arm64) ROUTERS="./sr ../sr_solution_macm" ;;
+        *)             ROUTERS="./sr ../sr_solution" ;;
+    esac
+fi
+
+make -s sr sr_vnsd || exit 1
+
+# -- the reference binaries are checked in without the exec bit --
+TMP=$(mktemp -d /tmp/sr_compare.XXXXXX)
+trap 'pkill -P $$ 2>/dev/null; rm -rf "$TMP"' EXIT
+
+# run_one ROUTER RATE: one sr_vnsd run, prints a table row
+run_one() {
+    local router=$1 rate=$2 bin out
+    bin="$TMP/$(basename "$router")"
+    cp "$router" "$bin" && chmod +x "$bin"
+
+    ./sr_vnsd -p "$PORT" -r "$rate" -T "$SECONDS_PER_RUN" -b "$BYTES" \
+              -f "$FLOWS" -t "$TTL" > "$TMP/vnsd.out" 2>&1 &
+    local vnsd=$!
+    sleep 0.3
+
+    # -- bash's time gives the CPU the router used over its whole life --
+    ( TIMEFORMAT='%U %S'
+      time "$bin" -p "$PORT" -r ../rtable > "$TMP/router.out" 2>&1 ) \
+        2> "$TMP/cpu.out"
+    wait $vnsd
+
+    awk -v name="$(basename "$router")" -v cpu="$(tail -1 "$TMP/cpu.out")" '
+        /^sent /            { sent = $2 }
+        /^forwarded /       { fwd = $4; lost = $6 }
+        /^latency_ns /      { p50 = $5; p90 = $7; p99 = $9; p999 = $11; max = $13 }
+        /^arp_request_ns /  { arp = $2 / 1e6 }
+        /^first_forwarded_ns / { first = $2 / 1e6 }
+        END {
+            split(cpu, c, " ")
+            if (sent == "") { printf "%-18s did not run, see its output\n", name; exit }
+            printf "%-18s %9d %8d %8.1f %8.1f %8.1f %8.1f %9.1f %8.1f %8.1f %8.0f\n",
+                   name, fwd, lost, p50 / 1e3, p90 / 1e3, p99 / 1e3, p999 / 1e3,
+                   max / 1e3, arp, first, sent ? (c[1] + c[2]) * 1e9 / sent : 0
+        }' "$TMP/vnsd.out"
+    # -- sr_vnsd needs a moment to let go of the port --
+    sleep 0.2
+}
+
+for rate in $RATES; do
+    echo
+    echo "offered $rate frames/s of $BYTES bytes for $SECONDS_PER_RUN s," \
+         "$FLOWS flow(s), ttl $TTL"
+    printf "%-18s %9s %8s %8s %8s %8s %8s %9s %8s %8s %8s\n" router fwd/s lost \
+           p50_us p90_us p99_us p99.9_us max_us arp_ms first_ms cpu_ns
+    for router in $ROUTERS; do
+        if [ ! -f "$router" ]; then
+            printf "%-18s not found\n" "$(basename "$router")"
+            continue
+        fi
+        run_one "$router" "$rate"
+    done
+done
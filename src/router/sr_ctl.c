@@ -0,0 +1,733 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ *
+ * Description:
+ *
+ * Control socket, see sr_ctl.h.  One thread accepts and serves clients
+ * one at a time, a client that does not send its line within
+ * SR_CTL_TIMEOUT is dropped so it cannot hold the socket.  Replies are
+ * built in memory and written once the command is done.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "sr_ctl.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_arpcache.h"
+#include "sr_workers.h"
+#include "sr_stats.h"
+
+struct sr_ctl
+{
+    struct sr_instance* sr;
+    int fd;                     /* listening socket */
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    pthread_t thread;
+    int stop;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_ctl_cmd
+ *
+ * A command, run with the words of its line (argv[0] is the name) and
+ * writing its reply to out.  Returns 0, or -1 after writing an error.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_ctl_cmd
+{
+    const char* name;
+    const char* args;
+    const char* help;
+    int (*run)(struct sr_instance* sr, int argc, char** argv, FILE* out);
+};
+
+static int sr_ctl_show(struct sr_instance*, int, char**, FILE*);
+static int sr_ctl_stats(struct sr_instance*, int, char**, FILE*);
+static int sr_ctl_set(struct sr_instance*, int, char**, FILE*);
+static int sr_ctl_route(struct sr_instance*, int, char**, FILE*);
+static int sr_ctl_help(struct sr_instance*, int, char**, FILE*);
+
+static const struct sr_ctl_cmd sr_ctl_cmds[] =
+{
+    { "show",  "fib|arp|queues|config",  "tables and settings",  sr_ctl_show },
+    { "show",  "counters [json]",        "interface, drop and ICMP counters",
+      sr_ctl_show },
+    { "stats", "[text|json]",            "same as show counters", sr_ctl_stats },
+    { "set",   "arp-timeout SECONDS",    "ARP cache entry lifetime",
+      sr_ctl_set },
+    { "set",   "arp-retries N",          "ARP requests before giving up",
+      sr_ctl_set },
+    { "set",   "queue-cap N",            "frames held per unresolved next hop",
+      sr_ctl_set },
+    { "set",   "log-level quiet|error|debug", "what the router prints",
+      sr_ctl_set },
+    { "set",   "icmp-rate KIND RATE [BURST]", "ICMP sent per second, 0 no limit",
+      sr_ctl_set },
+    { "route", "add DEST GW MASK IFACE", "add a route",          sr_ctl_route },
+    { "route", "del DEST MASK",          "remove a route",       sr_ctl_route },
+    { "help",  "",                       "this list",            sr_ctl_help },
+    { 0, 0, 0, 0 }
+};
+
+static const char* sr_ctl_levels[] = { "quiet", "error", "debug" };
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_icmp_kind(..)
+ * Scope:  Local
+ *
+ * The ICMP kind named by str, SR_ICMP_NKINDS for "source", -1 if none.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_icmp_kind(const char* str)
+{
+    int i;
+
+    for(i = 0; i < SR_ICMP_NKINDS; i++)
+    {
+        if(strcmp(str, sr_stats_icmp_name(i)) == 0)
+        { return i; }
+    }
+    return strcmp(str, "source") == 0 ? SR_ICMP_NKINDS : -1;
+} /* -- sr_ctl_icmp_kind -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_uint(..)
+ * Scope:  Local
+ *
+ * 0 and the value in val if str is a decimal number up to max.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_uint(const char* str, unsigned long max, unsigned long* val)
+{
+    char* end = 0;
+
+    errno = 0;
+    *val = strtoul(str, &end, 10);
+    if(errno || end == str || *end || *str == '-' || *val > max)
+    { return -1; }
+    return 0;
+} /* -- sr_ctl_uint -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_show_fib(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_show_fib(struct sr_instance* sr, FILE* out)
+{
+    struct sr_rt* rt = 0;
+    char dest[INET_ADDRSTRLEN], gw[INET_ADDRSTRLEN], mask[INET_ADDRSTRLEN];
+
+    fprintf(out, "%-16s %-16s %-16s %s\n", "destination", "gateway", "mask",
+            "iface");
+
+    pthread_rwlock_rdlock(&sr->rt_lock);
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        inet_ntop(AF_INET, &rt->dest, dest, sizeof(dest));
+        inet_ntop(AF_INET, &rt->gw, gw, sizeof(gw));
+        inet_ntop(AF_INET, &rt->mask, mask, sizeof(mask));
+        fprintf(out, "%-16s %-16s %-16s %s%s\n", dest, gw, mask,
+                rt->interface, rt->ifindex < 0 ? " (no such interface)" : "");
+    }
+    pthread_rwlock_unlock(&sr->rt_lock);
+} /* -- sr_ctl_show_fib -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_show_arp(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_show_arp(struct sr_instance* sr, FILE* out)
+{
+    struct sr_arpcache* cache = &sr->cache;
+    struct sr_arpentry* e = 0;
+    char ip[INET_ADDRSTRLEN];
+    time_t now = time(0);
+    int i;
+
+    fprintf(out, "%-16s %-17s %s\n", "address", "mac", "age");
+
+    pthread_rwlock_rdlock(&cache->entries_lock);
+    for(i = 0; i < SR_ARPCACHE_SZ; i++)
+    {
+        e = &cache->entries[i];
+        if(!e->valid)
+        { continue; }
+        inet_ntop(AF_INET, &e->ip, ip, sizeof(ip));
+        fprintf(out, "%-16s %02x:%02x:%02x:%02x:%02x:%02x %.0fs\n", ip,
+                e->mac[0], e->mac[1], e->mac[2], e->mac[3], e->mac[4],
+                e->mac[5], difftime(now, e->added));
+    }
+    pthread_rwlock_unlock(&cache->entries_lock);
+} /* -- sr_ctl_show_arp -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_show_queues(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_show_queues(struct sr_instance* sr, FILE* out)
+{
+    struct sr_arpcache* cache = &sr->cache;
+    struct sr_arpreq* req = 0;
+    struct sr_if* iface = 0;
+    char ip[INET_ADDRSTRLEN];
+    time_t now = time(0);
+
+    fprintf(out, "%-16s %-8s %8s %8s %s\n", "next hop", "iface", "frames",
+            "requests", "last sent");
+
+    pthread_mutex_lock(&cache->lock);
+    for(req = cache->requests; req; req = req->next)
+    {
+        iface = req->packets && req->packets->ifindex < sr->num_ifs ?
+                sr->ifs[req->packets->ifindex] : 0;
+        inet_ntop(AF_INET, &req->ip, ip, sizeof(ip));
+        fprintf(out, "%-16s %-8s %8u %8u ", ip, iface ? iface->name : "-",
+                req->npackets, req->times_sent);
+        if(req->sent)
+        { fprintf(out, "%.0fs ago\n", difftime(now, req->sent)); }
+        else
+        { fprintf(out, "never\n"); }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if(sr->workers)
+    { sr_workers_print_stats(sr, out); }
+} /* -- sr_ctl_show_queues -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_show_config(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_show_config(struct sr_instance* sr, FILE* out)
+{
+    struct sr_arpcache* cache = &sr->cache;
+    int level = __atomic_load_n(&sr_log_level, __ATOMIC_RELAXED);
+    double rate, burst;
+    int i;
+
+    pthread_mutex_lock(&cache->lock);
+    fprintf(out, "arp-timeout %g\n", cache->timeout);
+    fprintf(out, "arp-retries %u\n", cache->retries);
+    fprintf(out, "queue-cap %u\n", cache->queue_cap);
+    pthread_mutex_unlock(&cache->lock);
+    fprintf(out, "log-level %s\n", sr_ctl_levels[level]);
+    for(i = 0; i <= SR_ICMP_NKINDS; i++)
+    {
+        sr_icmp_limit_get(&sr->icmp_limit, i, &rate, &burst);
+        fprintf(out, "icmp-rate %s %g %g\n",
+                i < SR_ICMP_NKINDS ? sr_stats_icmp_name(i) : "source",
+                rate, burst);
+    }
+} /* -- sr_ctl_show_config -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_show(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_show(struct sr_instance* sr, int argc, char** argv,
+                       FILE* out)
+{
+    if(argc == 2 && strcmp(argv[1], "fib") == 0)
+    { sr_ctl_show_fib(sr, out); }
+    else if(argc == 2 && strcmp(argv[1], "arp") == 0)
+    { sr_ctl_show_arp(sr, out); }
+    else if(argc == 2 && strcmp(argv[1], "queues") == 0)
+    { sr_ctl_show_queues(sr, out); }
+    else if(argc == 2 && strcmp(argv[1], "config") == 0)
+    { sr_ctl_show_config(sr, out); }
+    else if(argc == 2 && strcmp(argv[1], "counters") == 0)
+    { sr_stats_print(sr, out); }
+    else if(argc == 3 && strcmp(argv[1], "counters") == 0 &&
+            strcmp(argv[2], "json") == 0)
+    { sr_stats_print_json(sr, out); }
+    else
+    {
+        fprintf(out, "error: usage: show fib|arp|queues|config|"
+                "counters [json]\n");
+        return -1;
+    }
+    return 0;
+} /* -- sr_ctl_show -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_stats(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_stats(struct sr_instance* sr, int argc, char** argv,
+                        FILE* out)
+{
+    if(argc == 1 || (argc == 2 && strcmp(argv[1], "text") == 0))
+    {
+        sr_stats_print(sr, out);
+        return 0;
+    }
+    if(argc == 2 && strcmp(argv[1], "json") == 0)
+    {
+        sr_stats_print_json(sr, out);
+        return 0;
+    }
+
+    fprintf(out, "error: usage: stats [text|json]\n");
+    return -1;
+} /* -- sr_ctl_stats -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_set(..)
+ * Scope:  Local
+ *
+ * The ARP settings are read under the cache lock, so they change
+ * between two sweeps or lookups, never during one.  icmp-rate keeps
+ * the burst of the bucket unless one is given.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_set(struct sr_instance* sr, int argc, char** argv,
+                      FILE* out)
+{
+    struct sr_arpcache* cache = &sr->cache;
+    unsigned long val, burst;
+    double old_rate, old_burst;
+    int i;
+
+    if(argc >= 2 && strcmp(argv[1], "icmp-rate") == 0)
+    {
+        if(argc < 4 || argc > 5)
+        {
+            fprintf(out, "error: usage: set icmp-rate echo|unreach|"
+                    "port-unreach|ttl|source RATE [BURST]\n");
+            return -1;
+        }
+        if((i = sr_ctl_icmp_kind(argv[2])) < 0)
+        {
+            fprintf(out, "error: no ICMP kind %s\n", argv[2]);
+            return -1;
+        }
+        sr_icmp_limit_get(&sr->icmp_limit, i, &old_rate, &old_burst);
+        burst = old_burst;
+        if(sr_ctl_uint(argv[3], 1000000000, &val) != 0 ||
+           (argc == 5 && (sr_ctl_uint(argv[4], 1000000000, &burst) != 0 ||
+                          burst == 0)))
+        {
+            fprintf(out, "error: RATE is 0..1000000000, BURST 1..1000000000\n");
+            return -1;
+        }
+        sr_icmp_limit_set(&sr->icmp_limit, i, val, burst);
+        fprintf(out, "icmp-rate %s %lu %lu\n", argv[2], val, burst);
+        return 0;
+    }
+
+    if(argc != 3)
+    {
+        fprintf(out, "error: usage: set arp-timeout|arp-retries|queue-cap|"
+                "log-level|icmp-rate VALUE\n");
+        return -1;
+    }
+
+    if(strcmp(argv[1], "log-level") == 0)
+    {
+        for(i = SR_LOG_QUIET; i <= SR_LOG_DEBUG; i++)
+        {
+            if(strcmp(argv[2], sr_ctl_levels[i]) == 0)
+            {
+                __atomic_store_n(&sr_log_level, i, __ATOMIC_RELAXED);
+                fprintf(out, "log-level %s\n", sr_ctl_levels[i]);
+                return 0;
+            }
+        }
+        fprintf(out, "error: log-level is quiet, error or debug\n");
+        return -1;
+    }
+
+    if(sr_ctl_uint(argv[2], 1000000, &val) != 0)
+    {
+        fprintf(out, "error: %s is not a number (0..1000000)\n", argv[2]);
+        return -1;
+    }
+    if(strcmp(argv[1], "arp-timeout") == 0)
+    {
+        pthread_mutex_lock(&cache->lock);
+        cache->timeout = val;
+        pthread_mutex_unlock(&cache->lock);
+    }
+    else if(strcmp(argv[1], "arp-retries") == 0 && val > 0)
+    {
+        pthread_mutex_lock(&cache->lock);
+        cache->retries = val;
+        pthread_mutex_unlock(&cache->lock);
+    }
+    else if(strcmp(argv[1], "queue-cap") == 0 && val > 0)
+    {
+        pthread_mutex_lock(&cache->lock);
+        cache->queue_cap = val;
+        pthread_mutex_unlock(&cache->lock);
+    }
+    else
+    {
+        fprintf(out, "error: cannot set %s to %s\n", argv[1], argv[2]);
+        return -1;
+    }
+
+    fprintf(out, "%s %lu\n", argv[1], val);
+    return 0;
+} /* -- sr_ctl_set -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_route(..)
+ * Scope:  Local
+ *
+ * Lookups copy what they need out of a route before they drop the read
+ * lock (sr_handle_pkt()), so a route is freed as soon as it is unlinked.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_route(struct sr_instance* sr, int argc, char** argv,
+                        FILE* out)
+{
+    struct in_addr dest, gw, mask;
+    struct sr_rt* rt = 0;
+    struct sr_rt** link = 0;
+    uint32_t host_mask;
+    int add;
+
+    add = argc == 6 && strcmp(argv[1], "add") == 0;
+    if(!add && !(argc == 4 && strcmp(argv[1], "del") == 0))
+    {
+        fprintf(out, "error: usage: route add DEST GW MASK IFACE | "
+                "route del DEST MASK\n");
+        return -1;
+    }
+    if(inet_pton(AF_INET, argv[2], &dest) != 1 ||
+       inet_pton(AF_INET, argv[add ? 4 : 3], &mask) != 1 ||
+       (add && inet_pton(AF_INET, argv[3], &gw) != 1))
+    {
+        fprintf(out, "error: bad address\n");
+        return -1;
+    }
+    host_mask = ntohl(mask.s_addr);
+    if(host_mask & (~host_mask >> 1))
+    {
+        fprintf(out, "error: %s is not a prefix mask\n", argv[add ? 4 : 3]);
+        return -1;
+    }
+    if(add && sr_get_interface(sr, argv[5]) == 0)
+    {
+        fprintf(out, "error: no interface %s\n", argv[5]);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&sr->rt_lock);
+    for(link = &sr->routing_table; (rt = *link) != 0; link = &rt->next)
+    {
+        if(rt->dest.s_addr == dest.s_addr && rt->mask.s_addr == mask.s_addr)
+        { break; }
+    }
+    if(add && rt == 0)
+    { sr_add_rt_entry(sr, dest, gw, mask, argv[5]); }
+    else if(!add && rt != 0)
+    {
+        *link = rt->next;
+        free(rt);
+    }
+    pthread_rwlock_unlock(&sr->rt_lock);
+
+    if(add && rt)
+    {
+        fprintf(out, "error: route to %s/%s exists, delete it first\n",
+                argv[2], argv[4]);
+        return -1;
+    }
+    if(!add && !rt)
+    {
+        fprintf(out, "error: no route to %s/%s\n", argv[2], argv[3]);
+        return -1;
+    }
+    fprintf(out, "ok\n");
+    return 0;
+} /* -- sr_ctl_route -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_help(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_help(struct sr_instance* sr, int argc, char** argv,
+                       FILE* out)
+{
+    const struct sr_ctl_cmd* cmd = 0;
+    char usage[64];
+
+    for(cmd = sr_ctl_cmds; cmd->name; cmd++)
+    {
+        snprintf(usage, sizeof(usage), "%s %s", cmd->name, cmd->args);
+        fprintf(out, "%-34s %s\n", usage, cmd->help);
+    }
+    return 0;
+} /* -- sr_ctl_help -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_run(..)
+ * Scope:  Local
+ *
+ * Split line into words and run the command it names.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_run(struct sr_instance* sr, char* line, FILE* out)
+{
+    const struct sr_ctl_cmd* cmd = 0;
+    char* argv[SR_CTL_MAXARGS];
+    char* save = 0;
+    char* word = 0;
+    int argc = 0;
+
+    for(word = strtok_r(line, " \t\r\n", &save); word;
+        word = strtok_r(0, " \t\r\n", &save))
+    {
+        if(argc == SR_CTL_MAXARGS)
+        {
+            fprintf(out, "error: more than %d words\n", SR_CTL_MAXARGS);
+            return;
+        }
+        argv[argc++] = word;
+    }
+    if(argc == 0)
+    {
+        fprintf(out, "error: empty command, try help\n");
+        return;
+    }
+
+    for(cmd = sr_ctl_cmds; cmd->name; cmd++)
+    {
+        if(strcmp(cmd->name, argv[0]) == 0)
+        {
+            cmd->run(sr, argc, argv, out);
+            return;
+        }
+    }
+    fprintf(out, "error: unknown command %s, try help\n", argv[0]);
+} /* -- sr_ctl_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_read_line(..)
+ * Scope:  Local
+ *
+ * Read up to the first newline or the end of input.  Returns the length,
+ * -1 if the client timed out, went away or sent too much.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_read_line(int fd, char* line, int size)
+{
+    struct pollfd pfd;
+    int len = 0;
+    int n;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while(len < size - 1)
+    {
+        if(poll(&pfd, 1, SR_CTL_TIMEOUT) <= 0)
+        { return -1; }
+        if((n = read(fd, line + len, size - 1 - len)) < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            return -1;
+        }
+        if(n == 0)
+        { break; }
+        len += n;
+        if(memchr(line + len - n, '\n', n))
+        { break; }
+    }
+    if(len == size - 1 && !memchr(line, '\n', len))
+    { return -1; }
+
+    line[len] = 0;
+    return len;
+} /* -- sr_ctl_read_line -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_serve(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_serve(struct sr_ctl* ctl, int fd)
+{
+    char line[SR_CTL_LINE];
+    char* reply = 0;
+    size_t size = 0;
+    size_t off = 0;
+    ssize_t n;
+    FILE* out = 0;
+
+    if(sr_ctl_read_line(fd, line, sizeof(line)) < 0)
+    { return; }
+
+    if((out = open_memstream(&reply, &size)) == 0)
+    { return; }
+    sr_ctl_run(ctl->sr, line, out);
+    fclose(out);
+
+    /* -- MSG_NOSIGNAL: a client that left must not SIGPIPE the router -- */
+    while(off < size)
+    {
+        if((n = send(fd, reply + off, size - off, MSG_NOSIGNAL)) < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            break;
+        }
+        off += n;
+    }
+    free(reply);
+} /* -- sr_ctl_serve -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_main(..)
+ * Scope:  Local
+ *
+ * Wakes up every SR_CTL_TIMEOUT to look at the stop flag.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_ctl_main(void* arg)
+{
+    struct sr_ctl* ctl = (struct sr_ctl*)arg;
+    struct pollfd pfd;
+    int fd;
+
+    pfd.fd = ctl->fd;
+    pfd.events = POLLIN;
+
+    while(!__atomic_load_n(&ctl->stop, __ATOMIC_ACQUIRE))
+    {
+        if(poll(&pfd, 1, SR_CTL_TIMEOUT) <= 0)
+        { continue; }
+        if((fd = accept(ctl->fd, 0, 0)) < 0)
+        { continue; }
+        sr_ctl_serve(ctl, fd);
+        close(fd);
+    }
+
+    return 0;
+} /* -- sr_ctl_main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_start(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_ctl_start(struct sr_instance* sr, const char* path)
+{
+    struct sr_ctl* ctl = 0;
+    struct sockaddr_un addr;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(path);
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Control socket path too long: %s\n", path);
+        return -1;
+    }
+
+    ctl = (struct sr_ctl*)calloc(1, sizeof(struct sr_ctl));
+    assert(ctl);
+    ctl->sr = sr;
+    strcpy(ctl->path, path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if((ctl->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket(..):sr_ctl.c::sr_ctl_start(..)");
+        free(ctl);
+        return -1;
+    }
+
+    /* -- a socket file left by an earlier run would make bind fail -- */
+    unlink(path);
+    if(bind(ctl->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(ctl->fd, 8) < 0)
+    {
+        fprintf(stderr, "Control socket %s: %s\n", path, strerror(errno));
+        close(ctl->fd);
+        free(ctl);
+        return -1;
+    }
+
+    if(pthread_create(&ctl->thread, 0, sr_ctl_main, ctl) != 0)
+    {
+        perror("pthread_create(..):sr_ctl.c::sr_ctl_start(..)");
+        close(ctl->fd);
+        unlink(path);
+        free(ctl);
+        return -1;
+    }
+
+    sr->ctl = ctl;
+    return 0;
+} /* -- sr_ctl_start -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_stop(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_ctl_stop(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if((ctl = sr->ctl) == 0)
+    { return; }
+    sr->ctl = 0;
+
+    __atomic_store_n(&ctl->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(ctl->thread, 0);
+
+    close(ctl->fd);
+    unlink(ctl->path);
+    free(ctl);
+} /* -- sr_ctl_stop -- */
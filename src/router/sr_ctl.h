@@ -0,0 +1,56 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ *
+ * Description:
+ *
+ * Local control socket (-U path).  A Unix domain stream socket served by
+ * its own thread, away from the forwarding path.  A client connects,
+ * writes one command line, reads the reply until the router closes the
+ * connection:
+ *
+ *     echo "stats json" | nc -U /tmp/sr.sock
+ *
+ * Commands:
+ *
+ *     show fib                 routing table
+ *     show arp                 ARP cache
+ *     show queues              frames waiting for ARP, worker rings
+ *     show counters [json]     interface, drop and ICMP counters
+ *                              (sr_stats.h)
+ *     show config              the settings below
+ *     stats [text|json]        same as show counters
+ *     set arp-timeout SECONDS  ARP cache entry lifetime
+ *     set arp-retries N        ARP requests before giving up on a next hop
+ *     set queue-cap N          frames held per unresolved next hop
+ *     set log-level quiet|error|debug
+ *     set icmp-rate KIND RATE [BURST]
+ *                              ICMP messages sent per second, KIND is
+ *                              echo, unreach, port-unreach, ttl or
+ *                              source (errors to one host), 0 for no
+ *                              limit (sr_ratelimit.h)
+ *     route add DEST GW MASK IFACE
+ *     route del DEST MASK
+ *     help                     list the commands
+ *
+ * Settings and routes changed here last until the router exits.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+#define SR_CTL_LINE     512     /* longest command line */
+#define SR_CTL_MAXARGS  16      /* words in a command line */
+#define SR_CTL_TIMEOUT  1000    /* ms a client gets to send its line */
+
+struct sr_instance;
+struct sr_ctl;
+
+/* Listen on path (an old socket file there is replaced) and start the
+   control thread as sr->ctl.  Returns 0 on success. */
+int  sr_ctl_start(struct sr_instance* sr, const char* path);
+
+/* Stop the control thread and remove the socket file. */
+void sr_ctl_stop(struct sr_instance* sr);
+
+#endif /* -- SR_CTL_H -- */
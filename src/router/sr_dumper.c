@@ -2,6 +2,7 @@
 #include <sys/types.h>
 
 #include <stdio.h>
+#include <string.h>
 #include "sr_dumper.h"
 
 static void
@@ -69,3 +70,153 @@ sr_dump_close(FILE *fp)
   fclose(fp);
 }
 
+
+/*
+ * Classic header and records into memory.
+ */
+size_t
+sr_dump_hdr(unsigned char *out, int thiszone, int snaplen)
+{
+        struct pcap_file_header hdr;
+
+        hdr.magic = TCPDUMP_MAGIC;
+        hdr.version_major = PCAP_VERSION_MAJOR;
+        hdr.version_minor = PCAP_VERSION_MINOR;
+
+        hdr.thiszone = thiszone;
+        hdr.snaplen = snaplen;
+        hdr.sigfigs = 0;
+        hdr.linktype = LINKTYPE_ETHERNET;
+
+        memcpy(out, &hdr, sizeof(hdr));
+        return sizeof(hdr);
+}
+
+size_t
+sr_dump_rec(unsigned char *out, const struct pcap_pkthdr *h,
+            const unsigned char *sp)
+{
+        struct pcap_sf_pkthdr sf_hdr;
+
+        sf_hdr.ts.tv_sec  = h->ts.tv_sec;
+        sf_hdr.ts.tv_usec = h->ts.tv_usec;
+        sf_hdr.caplen     = h->caplen;
+        sf_hdr.len        = h->len;
+        memcpy(out, &sf_hdr, sizeof(sf_hdr));
+        memcpy(out + sizeof(sf_hdr), sp, h->caplen);
+        return sizeof(sf_hdr) + h->caplen;
+}
+
+/*
+ * pcapng.  A block is type, total length, body, total length again; an
+ * option is code, length, value padded to 32 bits.
+ */
+static size_t
+ng_u16(unsigned char *out, uint16_t v)
+{
+        memcpy(out, &v, 2);
+        return 2;
+}
+
+static size_t
+ng_u32(unsigned char *out, uint32_t v)
+{
+        memcpy(out, &v, 4);
+        return 4;
+}
+
+static size_t
+ng_opt(unsigned char *out, uint16_t code, const void *val, uint16_t len)
+{
+        size_t pad = (4 - (len & 3)) & 3;
+
+        ng_u16(out, code);
+        ng_u16(out + 2, len);
+        memcpy(out + 4, val, len);
+        memset(out + 4 + len, 0, pad);
+        return 4 + len + pad;
+}
+
+static size_t
+ng_close(unsigned char *out, uint32_t type, size_t len)
+{
+        /* -- len covers the body, add type, length and trailer -- */
+        len += 12;
+        ng_u32(out, type);
+        ng_u32(out + 4, len);
+        ng_u32(out + len - 4, len);
+        return len;
+}
+
+size_t
+sr_dump_ng_shb(unsigned char *out)
+{
+        unsigned char *p = out + 8;
+        uint64_t section_len = (uint64_t)-1;     /* unknown */
+
+        p += ng_u32(p, PCAPNG_BOM);
+        p += ng_u16(p, 1);                       /* major */
+        p += ng_u16(p, 0);                       /* minor */
+        memcpy(p, &section_len, 8);
+        p += 8;
+        return ng_close(out, PCAPNG_SHB, p - (out + 8));
+}
+
+size_t
+sr_dump_ng_idb(unsigned char *out, const char *name,
+               const unsigned char *mac, int snaplen)
+{
+        unsigned char *p = out + 8;
+        unsigned char tsresol = 9;
+        size_t name_len = strnlen(name, 32);
+
+        p += ng_u16(p, LINKTYPE_ETHERNET);
+        p += ng_u16(p, 0);
+        p += ng_u32(p, snaplen);
+        p += ng_opt(p, PCAPNG_IF_NAME, name, name_len);
+        if (mac)
+                p += ng_opt(p, PCAPNG_IF_MACADDR, mac, PCAP_ETHA_LEN);
+        p += ng_opt(p, PCAPNG_IF_TSRESOL, &tsresol, 1);
+        p += ng_opt(p, PCAPNG_OPT_END, "", 0);
+        return ng_close(out, PCAPNG_IDB, p - (out + 8));
+}
+
+size_t
+sr_dump_ng_epb(unsigned char *out, uint32_t if_id, uint64_t ts,
+               const unsigned char *sp, uint32_t caplen, uint32_t len,
+               uint32_t flags, uint64_t drops)
+{
+        unsigned char *p = out + 8;
+        size_t pad = (4 - (caplen & 3)) & 3;
+
+        p += ng_u32(p, if_id);
+        p += ng_u32(p, (uint32_t)(ts >> 32));
+        p += ng_u32(p, (uint32_t)ts);
+        p += ng_u32(p, caplen);
+        p += ng_u32(p, len);
+        memcpy(p, sp, caplen);
+        memset(p + caplen, 0, pad);
+        p += caplen + pad;
+        if (flags || drops) {
+                if (flags)
+                        p += ng_opt(p, PCAPNG_EPB_FLAGS, &flags, 4);
+                if (drops)
+                        p += ng_opt(p, PCAPNG_EPB_DROPCOUNT, &drops, 8);
+                p += ng_opt(p, PCAPNG_OPT_END, "", 0);
+        }
+        return ng_close(out, PCAPNG_EPB, p - (out + 8));
+}
+
+size_t
+sr_dump_ng_isb(unsigned char *out, uint32_t if_id, uint64_t ts,
+               uint64_t drops)
+{
+        unsigned char *p = out + 8;
+
+        p += ng_u32(p, if_id);
+        p += ng_u32(p, (uint32_t)(ts >> 32));
+        p += ng_u32(p, (uint32_t)ts);
+        p += ng_opt(p, PCAPNG_ISB_OSDROP, &drops, 8);
+        p += ng_opt(p, PCAPNG_OPT_END, "", 0);
+        return ng_close(out, PCAPNG_ISB, p - (out + 8));
+}
@@ -13,6 +13,7 @@
 #endif /* _DARWIN_ */
 
 #include <sys/time.h>
+#include <stdio.h>
 
 #define PCAP_VERSION_MAJOR 2
 #define PCAP_VERSION_MINOR 4
@@ -20,9 +21,35 @@
 #define PCAP_PROTO_LEN 2
 
 #define TCPDUMP_MAGIC 0xa1b2c3d4
+#define PCAP_NSEC_MAGIC 0xa1b23c4d  /* nanosecond timestamps */
 
 #define LINKTYPE_ETHERNET 1
 
+/* pcapng block types and options */
+#define PCAPNG_SHB       0x0A0D0D0A
+#define PCAPNG_IDB       0x00000001
+#define PCAPNG_SPB       0x00000003
+#define PCAPNG_ISB       0x00000005
+#define PCAPNG_EPB       0x00000006
+#define PCAPNG_BOM       0x1A2B3C4D
+#define PCAPNG_OPT_END   0
+#define PCAPNG_IF_NAME   2
+#define PCAPNG_IF_MACADDR 6
+#define PCAPNG_IF_TSRESOL 9
+#define PCAPNG_EPB_FLAGS 2
+#define PCAPNG_EPB_DROPCOUNT 4
+#define PCAPNG_ISB_OSDROP 7
+
+/* epb_flags direction bits */
+#define PCAPNG_EPB_INBOUND  1
+#define PCAPNG_EPB_OUTBOUND 2
+
+/* most bytes the sr_dump_ng_*() writers below produce */
+#define PCAPNG_SHB_MAX   28
+#define PCAPNG_IDB_MAX   96
+#define PCAPNG_ISB_MAX   40
+#define PCAPNG_EPB_MAX(caplen) (32 + (((caplen) + 3) & ~3) + 8 + 12 + 4)
+
 #define min(a,b) ( (a) < (b) ? (a) : (b) )
 
 /* file header */
@@ -77,3 +104,26 @@ void sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp);
  * Close the file
  */
 void sr_dump_close(FILE *fp);
+
+/**
+ * The same into memory, for writers doing their own buffering.  Each
+ * returns the number of bytes put at out.
+ */
+size_t sr_dump_hdr(unsigned char *out, int thiszone, int snaplen);
+size_t sr_dump_rec(unsigned char *out, const struct pcap_pkthdr *h,
+                   const unsigned char *sp);
+
+/**
+ * pcapng (draft-ietf-opsawg-pcapng) blocks into memory, in host byte
+ * order.  Interfaces get nanosecond time stamps (if_tsresol 9), so ts
+ * is in ns since the epoch.  flags is the epb_flags word and drops the
+ * epb_dropcount, both left out when 0.  Each returns the bytes put at out.
+ */
+size_t sr_dump_ng_shb(unsigned char *out);
+size_t sr_dump_ng_idb(unsigned char *out, const char *name,
+                      const unsigned char *mac, int snaplen);
+size_t sr_dump_ng_epb(unsigned char *out, uint32_t if_id, uint64_t ts,
+                      const unsigned char *sp, uint32_t caplen, uint32_t len,
+                      uint32_t flags, uint64_t drops);
+size_t sr_dump_ng_isb(unsigned char *out, uint32_t if_id, uint64_t ts,
+                      uint64_t drops);
@@ -0,0 +1,530 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.c
+ *
+ * Description:
+ *
+ * Capture filter compiler and interpreter, see sr_filter.h.
+ *
+ * The expression is parsed into a tree, then emitted leaves last first:
+ * every leaf becomes one test whose true and false edges point at the
+ * code for what follows, and/or/not only rewire those edges.  Jumps
+ * therefore always go to a lower index and a program ends after at most
+ * len tests.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <arpa/inet.h>
+
+#include "sr_filter.h"
+#include "sr_protocol.h"
+#include "sr_router.h"
+#include "sr_if.h"
+
+#define SR_F_ACCEPT -1
+#define SR_F_REJECT -2
+
+/* -- instructions -- */
+enum
+{
+    SR_F_ETHERTYPE,
+    SR_F_IPPROTO,
+    SR_F_IPSRC,
+    SR_F_IPDST,
+    SR_F_IFINDEX,
+    SR_F_DIR
+};
+
+static const char* sr_f_names[] =
+{ "ethertype", "ipproto", "ipsrc", "ipdst", "ifindex", "dir" };
+
+/* -- parse tree -- */
+enum { SR_FN_LEAF, SR_FN_AND, SR_FN_OR, SR_FN_NOT };
+
+#define SR_FN_MAX (2 * SR_FILTER_MAX)
+
+struct sr_fnode
+{
+    int type;
+    int a, b;                   /* children */
+    struct sr_filter_insn insn; /* SR_FN_LEAF */
+};
+
+struct sr_fparse
+{
+    struct sr_instance* sr;
+    const char* s;              /* rest of the expression */
+    char tok[64];               /* current token, "" at the end */
+    struct sr_fnode n[SR_FN_MAX];
+    int num;
+    int err;
+};
+
+static int sr_fparse_or(struct sr_fparse* p);
+
+/*---------------------------------------------------------------------
+ * Method: sr_fparse_next(..)
+ * Scope:  Local
+ *
+ * Read the next token, a parenthesis or a run of anything else up to
+ * white space or a parenthesis.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fparse_next(struct sr_fparse* p)
+{
+    size_t n = 0;
+
+    while(isspace((unsigned char)*p->s))
+    { p->s++; }
+
+    if(*p->s == '(' || *p->s == ')')
+    { p->tok[n++] = *p->s++; }
+    else
+    {
+        while(*p->s && !isspace((unsigned char)*p->s) &&
+              *p->s != '(' && *p->s != ')')
+        {
+            if(n + 1 < sizeof(p->tok))
+            { p->tok[n++] = *p->s; }
+            p->s++;
+        }
+    }
+    p->tok[n] = 0;
+} /* -- sr_fparse_next -- */
+
+static int sr_fparse_error(struct sr_fparse* p, const char* what)
+{
+    if(!p->err)
+    {
+        fprintf(stderr, "Capture filter: %s at '%s'\n", what,
+                p->tok[0] ? p->tok : "end");
+        p->err = 1;
+    }
+    return -1;
+}
+
+static int sr_fparse_node(struct sr_fparse* p, int type, int a, int b)
+{
+    if(p->num == SR_FN_MAX)
+    { return sr_fparse_error(p, "expression too long"); }
+
+    memset(&p->n[p->num], 0, sizeof(struct sr_fnode));
+    p->n[p->num].type = type;
+    p->n[p->num].a = a;
+    p->n[p->num].b = b;
+    return p->num++;
+}
+
+static int sr_fparse_leaf(struct sr_fparse* p, uint8_t op, uint32_t k,
+                          uint32_t mask)
+{
+    int i = sr_fparse_node(p, SR_FN_LEAF, -1, -1);
+
+    if(i >= 0)
+    {
+        p->n[i].insn.op = op;
+        p->n[i].insn.k = k & mask;
+        p->n[i].insn.mask = mask;
+    }
+    return i;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fparse_number(..)
+ * Scope:  Local
+ *
+ * Decimal or 0x hex token below max, -1 if it is not one.
+ *
+ *---------------------------------------------------------------------*/
+
+static long sr_fparse_number(struct sr_fparse* p, long max)
+{
+    char* end = 0;
+    long v;
+
+    if(!isdigit((unsigned char)p->tok[0]))
+    { return sr_fparse_error(p, "expected a number"); }
+    v = strtol(p->tok, &end, 0);
+    if(*end || v < 0 || v > max)
+    { return sr_fparse_error(p, "bad number"); }
+
+    sr_fparse_next(p);
+    return v;
+} /* -- sr_fparse_number -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fparse_addr(..)
+ * Scope:  Local
+ *
+ * [src|dst] host A or [src|dst] net A/LEN, the qualifier has been read
+ * already (which: 0 either, 1 src, 2 dst).
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fparse_addr(struct sr_fparse* p, int which)
+{
+    struct in_addr addr;
+    uint32_t mask = 0xffffffff;
+    char* slash = 0;
+    char* end = 0;
+    long plen = 32;
+    int net;
+    int s, d;
+
+    if(strcmp(p->tok, "host") == 0)
+    { net = 0; }
+    else if(strcmp(p->tok, "net") == 0)
+    { net = 1; }
+    else
+    { return sr_fparse_error(p, "expected host or net"); }
+    sr_fparse_next(p);
+
+    if(net && (slash = strchr(p->tok, '/')) != 0)
+    {
+        *slash = 0;
+        plen = strtol(slash + 1, &end, 10);
+        if(end == slash + 1 || *end || plen < 0 || plen > 32)
+        { return sr_fparse_error(p, "bad prefix length"); }
+    }
+    if(inet_aton(p->tok, &addr) == 0)
+    { return sr_fparse_error(p, "bad address"); }
+    sr_fparse_next(p);
+
+    if(plen < 32)
+    { mask = htonl(plen ? 0xffffffff << (32 - plen) : 0); }
+
+    if(which == 1)
+    { return sr_fparse_leaf(p, SR_F_IPSRC, addr.s_addr, mask); }
+    if(which == 2)
+    { return sr_fparse_leaf(p, SR_F_IPDST, addr.s_addr, mask); }
+
+    s = sr_fparse_leaf(p, SR_F_IPSRC, addr.s_addr, mask);
+    d = sr_fparse_leaf(p, SR_F_IPDST, addr.s_addr, mask);
+    if(s < 0 || d < 0)
+    { return -1; }
+    return sr_fparse_node(p, SR_FN_OR, s, d);
+} /* -- sr_fparse_addr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fparse_prim(..)
+ * Scope:  Local
+ *
+ * not prim | ( expr ) | one of the primitives in sr_filter.h
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fparse_prim(struct sr_fparse* p)
+{
+    struct sr_if* iface = 0;
+    long v;
+    int i;
+
+    if(strcmp(p->tok, "not") == 0)
+    {
+        sr_fparse_next(p);
+        if((i = sr_fparse_prim(p)) < 0)
+        { return -1; }
+        return sr_fparse_node(p, SR_FN_NOT, i, -1);
+    }
+    if(strcmp(p->tok, "(") == 0)
+    {
+        sr_fparse_next(p);
+        if((i = sr_fparse_or(p)) < 0)
+        { return -1; }
+        if(strcmp(p->tok, ")") != 0)
+        { return sr_fparse_error(p, "expected )"); }
+        sr_fparse_next(p);
+        return i;
+    }
+
+    if(strcmp(p->tok, "arp") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_ETHERTYPE, htons(ethertype_arp), 0xffff);
+    }
+    if(strcmp(p->tok, "ip") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_ETHERTYPE, htons(ethertype_ip), 0xffff);
+    }
+    if(strcmp(p->tok, "ether") == 0)
+    {
+        sr_fparse_next(p);
+        if(strcmp(p->tok, "proto") != 0)
+        { return sr_fparse_error(p, "expected proto"); }
+        sr_fparse_next(p);
+        if((v = sr_fparse_number(p, 0xffff)) < 0)
+        { return -1; }
+        return sr_fparse_leaf(p, SR_F_ETHERTYPE, htons(v), 0xffff);
+    }
+
+    if(strcmp(p->tok, "icmp") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_IPPROTO, ip_protocol_icmp, 0xff);
+    }
+    if(strcmp(p->tok, "tcp") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_IPPROTO, ip_protocol_tcp, 0xff);
+    }
+    if(strcmp(p->tok, "udp") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_IPPROTO, ip_protocol_udp, 0xff);
+    }
+    if(strcmp(p->tok, "proto") == 0)
+    {
+        sr_fparse_next(p);
+        if((v = sr_fparse_number(p, 0xff)) < 0)
+        { return -1; }
+        return sr_fparse_leaf(p, SR_F_IPPROTO, v, 0xff);
+    }
+
+    if(strcmp(p->tok, "src") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_addr(p, 1);
+    }
+    if(strcmp(p->tok, "dst") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_addr(p, 2);
+    }
+    if(strcmp(p->tok, "host") == 0 || strcmp(p->tok, "net") == 0)
+    { return sr_fparse_addr(p, 0); }
+
+    if(strcmp(p->tok, "iface") == 0)
+    {
+        sr_fparse_next(p);
+        if((iface = sr_get_interface(p->sr, p->tok)) == 0)
+        { return sr_fparse_error(p, "no such interface"); }
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_IFINDEX, iface->ifindex, 0xffffffff);
+    }
+    if(strcmp(p->tok, "in") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_DIR, SR_DIR_IN, 0xffffffff);
+    }
+    if(strcmp(p->tok, "out") == 0)
+    {
+        sr_fparse_next(p);
+        return sr_fparse_leaf(p, SR_F_DIR, SR_DIR_OUT, 0xffffffff);
+    }
+
+    return sr_fparse_error(p, "unknown primitive");
+} /* -- sr_fparse_prim -- */
+
+static int sr_fparse_and(struct sr_fparse* p)
+{
+    int a, b;
+
+    if((a = sr_fparse_prim(p)) < 0)
+    { return -1; }
+    while(strcmp(p->tok, "and") == 0)
+    {
+        sr_fparse_next(p);
+        if((b = sr_fparse_prim(p)) < 0)
+        { return -1; }
+        if((a = sr_fparse_node(p, SR_FN_AND, a, b)) < 0)
+        { return -1; }
+    }
+    return a;
+}
+
+static int sr_fparse_or(struct sr_fparse* p)
+{
+    int a, b;
+
+    if((a = sr_fparse_and(p)) < 0)
+    { return -1; }
+    while(strcmp(p->tok, "or") == 0)
+    {
+        sr_fparse_next(p);
+        if((b = sr_fparse_and(p)) < 0)
+        { return -1; }
+        if((a = sr_fparse_node(p, SR_FN_OR, a, b)) < 0)
+        { return -1; }
+    }
+    return a;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_filter_emit(..)
+ * Scope:  Local
+ *
+ * Append the code for node i, which continues at t when the node holds
+ * and at f when not.  Returns the node's first insn.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_filter_emit(struct sr_filter* flt, struct sr_fparse* p, int i,
+                          int t, int f)
+{
+    struct sr_fnode* n = &p->n[i];
+    int b;
+
+    switch(n->type)
+    {
+        case SR_FN_AND:
+            if((b = sr_filter_emit(flt, p, n->b, t, f)) < 0)
+            { return -1; }
+            return sr_filter_emit(flt, p, n->a, b, f);
+        case SR_FN_OR:
+            if((b = sr_filter_emit(flt, p, n->b, t, f)) < 0)
+            { return -1; }
+            return sr_filter_emit(flt, p, n->a, t, b);
+        case SR_FN_NOT:
+            return sr_filter_emit(flt, p, n->a, f, t);
+    }
+
+    if(flt->len == SR_FILTER_MAX)
+    {
+        fprintf(stderr, "Capture filter: more than %d tests\n", SR_FILTER_MAX);
+        return -1;
+    }
+    flt->prog[flt->len] = n->insn;
+    flt->prog[flt->len].jt = t;
+    flt->prog[flt->len].jf = f;
+    return flt->len++;
+} /* -- sr_filter_emit -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_filter_compile(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_filter* sr_filter_compile(struct sr_instance* sr, const char* expr)
+{
+    struct sr_fparse* p = 0;
+    struct sr_filter* f = 0;
+    int root;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(expr);
+
+    p = (struct sr_fparse*)calloc(1, sizeof(struct sr_fparse));
+    f = (struct sr_filter*)calloc(1, sizeof(struct sr_filter));
+    assert(p && f);
+    p->sr = sr;
+    p->s = expr;
+    sr_fparse_next(p);
+
+    root = sr_fparse_or(p);
+    if(root >= 0 && p->tok[0])
+    { root = sr_fparse_error(p, "expected and/or"); }
+    if(root >= 0)
+    { f->entry = sr_filter_emit(f, p, root, SR_F_ACCEPT, SR_F_REJECT); }
+
+    free(p);
+    if(root < 0 || f->entry < 0)
+    {
+        free(f);
+        return 0;
+    }
+    return f;
+} /* -- sr_filter_compile -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_filter_match(..)
+ * Scope: Global
+ *
+ * IPv4 tests fail on anything that is not an IPv4 frame with a full
+ * header.  Fields are compared in network byte order.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_filter_match(const struct sr_filter* f, const uint8_t* buf,
+                    unsigned int len, int ifindex, int dir)
+{
+    const struct sr_filter_insn* insn = 0;
+    const unsigned int ip_end =
+        sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr);
+    const uint8_t* ip = buf + sizeof(struct sr_ethernet_hdr);
+    uint16_t type = 0;
+    uint32_t v = 0;
+    int is_ip;
+    int pc = f->entry;
+
+    if(len >= sizeof(struct sr_ethernet_hdr))
+    { memcpy(&type, buf + 12, 2); }
+    is_ip = type == htons(ethertype_ip) && len >= ip_end;
+
+    while(pc >= 0)
+    {
+        insn = &f->prog[pc];
+        switch(insn->op)
+        {
+            case SR_F_ETHERTYPE:
+                v = type;
+                break;
+            case SR_F_IPPROTO:
+                if(!is_ip)
+                { pc = insn->jf; continue; }
+                v = ip[9];
+                break;
+            case SR_F_IPSRC:
+                if(!is_ip)
+                { pc = insn->jf; continue; }
+                memcpy(&v, ip + 12, 4);
+                break;
+            case SR_F_IPDST:
+                if(!is_ip)
+                { pc = insn->jf; continue; }
+                memcpy(&v, ip + 16, 4);
+                break;
+            case SR_F_IFINDEX:
+                v = ifindex;
+                break;
+            case SR_F_DIR:
+                v = dir;
+                break;
+        }
+        pc = (v & insn->mask) == insn->k ? insn->jt : insn->jf;
+    }
+    return pc == SR_F_ACCEPT;
+} /* -- sr_filter_match -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_filter_print(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_filter_print(const struct sr_filter* f, FILE* fp)
+{
+    const struct sr_filter_insn* insn = 0;
+    char jt[8], jf[8];
+    int pc;
+
+    /* -- entry first -- */
+    for(pc = f->entry; pc >= 0; pc--)
+    {
+        insn = &f->prog[pc];
+        snprintf(jt, sizeof(jt), "%d", insn->jt);
+        snprintf(jf, sizeof(jf), "%d", insn->jf);
+        fprintf(fp, "(%03d) %-9s & 0x%08x == 0x%08x  jt %s  jf %s\n", pc,
+                sr_f_names[insn->op], insn->mask, insn->k,
+                insn->jt == SR_F_ACCEPT ? "accept" :
+                insn->jt == SR_F_REJECT ? "reject" : jt,
+                insn->jf == SR_F_ACCEPT ? "accept" :
+                insn->jf == SR_F_REJECT ? "reject" : jf);
+    }
+} /* -- sr_filter_print -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_filter_free(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_filter_free(struct sr_filter* f)
+{ free(f); }
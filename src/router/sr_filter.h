@@ -0,0 +1,76 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.h
+ *
+ * Description:
+ *
+ * Capture filter for the -l packet log.  An expression such as
+ *
+ *     tcp and src net 10.0.1.0/24 and in
+ *     not arp and (iface eth1 or icmp)
+ *
+ * is compiled once into a short program of compare and branch
+ * instructions (in the spirit of classic BPF) which is run on every frame
+ * before anything is copied.  Primitives:
+ *
+ *     arp, ip, ether proto N         ethertype
+ *     icmp, tcp, udp, proto N        IPv4 protocol
+ *     [src|dst] host A.B.C.D         IPv4 address, host is src or dst
+ *     [src|dst] net A.B.C.D/LEN      IPv4 prefix
+ *     iface NAME                     router interface
+ *     in, out                        direction
+ *
+ * combined with not, and, or (tightest first) and parentheses.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FILTER_H
+#define SR_FILTER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_FILTER_MAX 64        /* instructions in a program */
+
+/* direction of a logged frame */
+#define SR_DIR_IN  1
+#define SR_DIR_OUT 2
+
+struct sr_instance;
+
+struct sr_filter_insn
+{
+    uint8_t  op;
+    int8_t   jt;                /* next insn if the test holds, < 0 ends */
+    int8_t   jf;                /* next insn otherwise */
+    uint32_t k;                 /* value, network byte order */
+    uint32_t mask;              /* applied before comparing with k */
+};
+
+struct sr_filter
+{
+    int entry;                  /* first insn */
+    int len;
+    struct sr_filter_insn prog[SR_FILTER_MAX];
+};
+
+/* Compile expr, interface names are looked up in sr.  Returns 0 and
+   prints why on stderr if expr does not parse. */
+struct sr_filter* sr_filter_compile(struct sr_instance* sr, const char* expr);
+
+/* 1 if the frame passes */
+int  sr_filter_match(const struct sr_filter* f, const uint8_t* buf,
+                     unsigned int len, int ifindex, int dir);
+
+/* program listing, one insn per line */
+void sr_filter_print(const struct sr_filter* f, FILE* fp);
+
+void sr_filter_free(struct sr_filter* f);
+
+#endif /* -- SR_FILTER_H -- */
@@ -0,0 +1,661 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_gen.c
+ *
+ * Description:
+ *
+ * Synthetic traffic generator, see sr_gen.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+#include "sr_gen.h"
+#include "sr_cksum.h"
+#include "sr_utils.h"
+
+#define SR_GEN_TTL   64
+#define SR_GEN_IMIX_SMALL  64
+#define SR_GEN_IMIX_MEDIUM 594
+#define SR_GEN_IMIX_LARGE  1514
+
+/* ----------------------------------------------------------------------------
+ * struct sr_gen_flow
+ *
+ * Everything but the size, TTL and ids of the frames of one flow, network
+ * byte order.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_gen_flow
+{
+    uint32_t src;
+    uint32_t dst;
+    uint16_t sport;
+    uint16_t dport;
+    int proto;                  /* SR_GEN_* */
+};
+
+struct sr_gen
+{
+    struct sr_gen_opts o;
+    struct sr_gen_route* routes;
+    int nroutes;
+    int* rank;                  /* rank -> routes[] */
+    double* cdf;                /* Zipf over ranks */
+    struct sr_gen_flow* flows;
+    int mix_total;
+    uint64_t rng;
+    unsigned long count;        /* frames so far */
+
+    /* -- gateways sent to so far, open addressing -- */
+    uint32_t* seen;
+    uint8_t* seen_used;
+    unsigned int seen_size;     /* power of two */
+
+    /* -- burst of new next hops -- */
+    int fresh;                  /* next rank to look at for one */
+    int* burst;                 /* routes[] still to send to */
+    int burst_len;
+};
+
+/* -- names as in the mix= key, by SR_GEN_* -- */
+static const char* sr_gen_proto_names[SR_GEN_NPROTOS] = { "tcp", "udp", "icmp" };
+
+static const uint8_t sr_gen_ip_proto[SR_GEN_NPROTOS] =
+{ ip_protocol_tcp, ip_protocol_udp, ip_protocol_icmp };
+
+/* -- L4 header bytes by SR_GEN_*, ICMP is an echo request -- */
+static const unsigned int sr_gen_l4_len[SR_GEN_NPROTOS] = { 20, 8, 8 };
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_rand(..)
+ * Scope: Local
+ *
+ * xorshift64*, the generator has its own state so that a seed gives the
+ * same frames whatever else the process does.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint64_t sr_gen_rand(struct sr_gen* g)
+{
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return g->rng * 2685821657736338717ull;
+} /* -- sr_gen_rand -- */
+
+/* -- uniform in [0, 1) -- */
+static double sr_gen_uniform(struct sr_gen* g)
+{ return (sr_gen_rand(g) >> 11) * (1.0 / 9007199254740992.0); }
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_defaults(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_gen_defaults(struct sr_gen_opts* opts)
+{
+    /* REQUIRES */
+    assert(opts);
+
+    memset(opts, 0, sizeof(struct sr_gen_opts));
+    opts->zipf = 1.0;
+    opts->flows = 1024;
+    opts->mix[SR_GEN_TCP] = 80;
+    opts->mix[SR_GEN_UDP] = 15;
+    opts->mix[SR_GEN_ICMP] = 5;
+    opts->imix = 1;
+    opts->size_min = SR_GEN_IMIX_SMALL;
+    opts->size_max = SR_GEN_IMIX_LARGE;
+    opts->seed = 1;
+    opts->src_mask = 0xffffffff;
+} /* -- sr_gen_defaults -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_parse_mix(..)
+ * Scope: Local
+ *
+ * "tcp:80/udp:15/icmp:5", protocols left out get weight 0.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_gen_parse_mix(struct sr_gen_opts* opts, char* value)
+{
+    int mix[SR_GEN_NPROTOS] = { 0 };
+    char* save = 0;
+    char* item = 0;
+    char* colon = 0;
+    char* end = 0;
+    long w;
+    int total = 0;
+    int i;
+
+    for(item = strtok_r(value, "/", &save); item;
+        item = strtok_r(0, "/", &save))
+    {
+        if((colon = strchr(item, ':')) == 0)
+        { return -1; }
+        *colon++ = 0;
+        w = strtol(colon, &end, 10);
+        if(*end || w < 0 || w > 1000000)
+        { return -1; }
+        for(i = 0; i < SR_GEN_NPROTOS; i++)
+        {
+            if(strcmp(item, sr_gen_proto_names[i]) == 0)
+            { break; }
+        }
+        if(i == SR_GEN_NPROTOS)
+        { return -1; }
+        mix[i] = w;
+        total += w;
+    }
+    if(total == 0)
+    { return -1; }
+
+    memcpy(opts->mix, mix, sizeof(mix));
+    return 0;
+} /* -- sr_gen_parse_mix -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_parse(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_gen_parse(struct sr_gen_opts* opts, const char* spec)
+{
+    char buf[512];
+    char* save = 0;
+    char* item = 0;
+    char* value = 0;
+    char* end = 0;
+    long a, b;
+    int ok;
+
+    /* REQUIRES */
+    assert(opts);
+    assert(spec);
+
+    if(strlen(spec) >= sizeof(buf))
+    {
+        fprintf(stderr, "traffic mix too long\n");
+        return -1;
+    }
+    strcpy(buf, spec);
+
+    for(item = strtok_r(buf, ",", &save); item; item = strtok_r(0, ",", &save))
+    {
+        if((value = strchr(item, '=')) == 0)
+        {
+            fprintf(stderr, "traffic mix: %s is not key=value\n", item);
+            return -1;
+        }
+        *value++ = 0;
+        ok = 0;
+
+        if(strcmp(item, "zipf") == 0)
+        {
+            opts->zipf = strtod(value, &end);
+            ok = *end == 0 && opts->zipf >= 0 && opts->zipf <= 10;
+        }
+        else if(strcmp(item, "flows") == 0)
+        {
+            a = strtol(value, &end, 10);
+            ok = *end == 0 && a > 0 && a <= 10000000;
+            opts->flows = a;
+        }
+        else if(strcmp(item, "mix") == 0)
+        { ok = sr_gen_parse_mix(opts, value) == 0; }
+        else if(strcmp(item, "size") == 0)
+        {
+            if(strcmp(value, "imix") == 0)
+            {
+                opts->imix = 1;
+                ok = 1;
+            }
+            else
+            {
+                a = b = strtol(value, &end, 10);
+                if(*end == '-')
+                { b = strtol(end + 1, &end, 10); }
+                ok = *end == 0 && a >= 42 && a <= b && b <= SR_GEN_MAXLEN;
+                opts->imix = 0;
+                opts->size_min = a;
+                opts->size_max = b;
+            }
+        }
+        else if(strcmp(item, "ttl1") == 0)
+        {
+            opts->ttl1 = strtod(value, &end);
+            ok = *end == 0 && opts->ttl1 >= 0 && opts->ttl1 <= 1;
+        }
+        else if(strcmp(item, "burst") == 0)
+        {
+            a = strtol(value, &end, 10);
+            b = *end == ':' ? strtol(end + 1, &end, 10) : -1;
+            ok = *end == 0 && a > 0 && b > 0 && b <= 1000000;
+            opts->burst_every = a;
+            opts->burst_hops = b;
+        }
+        else if(strcmp(item, "seed") == 0)
+        {
+            opts->seed = strtoul(value, &end, 10);
+            ok = *end == 0;
+        }
+        else
+        {
+            fprintf(stderr, "traffic mix: unknown key %s\n", item);
+            return -1;
+        }
+
+        if(!ok)
+        {
+            fprintf(stderr, "traffic mix: bad value for %s\n", item);
+            return -1;
+        }
+    }
+    return 0;
+} /* -- sr_gen_parse -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_load_rtable(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_gen_load_rtable(const char* path, struct sr_gen_route** routes)
+{
+    struct sr_gen_route* r = 0;
+    struct in_addr dest, gw, mask;
+    char line[BUFSIZ];
+    char s_dest[64], s_gw[64], s_mask[64];
+    FILE* fp = 0;
+    int n = 0, size = 0;
+    int lineno = 0;
+
+    /* REQUIRES */
+    assert(path);
+    assert(routes);
+
+    if((fp = fopen(path, "r")) == 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        lineno++;
+        if(sscanf(line, "%63s %63s %63s", s_dest, s_gw, s_mask) != 3)
+        { continue; }
+        if(inet_aton(s_dest, &dest) == 0 || inet_aton(s_gw, &gw) == 0 ||
+           inet_aton(s_mask, &mask) == 0)
+        {
+            fprintf(stderr, "%s:%d: not dest gw mask iface\n", path, lineno);
+            free(r);
+            fclose(fp);
+            return -1;
+        }
+        if(n == size)
+        {
+            size = size ? 2 * size : 64;
+            r = (struct sr_gen_route*)realloc(r, size * sizeof(*r));
+            assert(r);
+        }
+        r[n].dest = dest.s_addr & mask.s_addr;
+        r[n].mask = mask.s_addr;
+        r[n].gw = gw.s_addr;
+        n++;
+    }
+    fclose(fp);
+
+    *routes = r;
+    return n;
+} /* -- sr_gen_load_rtable -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_seen(..)
+ * Scope: Local
+ *
+ * Has gw been sent to, and mark it so if mark is set.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_gen_seen(struct sr_gen* g, uint32_t gw, int mark)
+{
+    unsigned int i = (gw * 2654435761u) & (g->seen_size - 1);
+
+    while(g->seen_used[i])
+    {
+        if(g->seen[i] == gw)
+        { return 1; }
+        i = (i + 1) & (g->seen_size - 1);
+    }
+    if(mark)
+    {
+        g->seen[i] = gw;
+        g->seen_used[i] = 1;
+    }
+    return 0;
+} /* -- sr_gen_seen -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_host(..)
+ * Scope: Local
+ *
+ * A host address in net/mask, avoiding the all zeros and all ones host
+ * parts where the prefix has room for that.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint32_t sr_gen_host(struct sr_gen* g, uint32_t net, uint32_t mask)
+{
+    uint32_t hosts = ~ntohl(mask);
+    uint32_t h;
+
+    if(hosts == 0)
+    { return net; }
+    if(hosts == 1)
+    { h = sr_gen_rand(g) & 1; }
+    else
+    { h = 1 + sr_gen_rand(g) % (hosts - 1); }
+    return htonl((ntohl(net) & ~hosts) | h);
+} /* -- sr_gen_host -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_flow(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_gen_flow(struct sr_gen* g, const struct sr_gen_route* rt,
+                        struct sr_gen_flow* f)
+{
+    int w;
+
+    f->src = sr_gen_host(g, g->o.src_net, g->o.src_mask);
+    f->dst = sr_gen_host(g, rt->dest, rt->mask);
+    f->sport = htons(1024 + sr_gen_rand(g) % 64512);
+    f->dport = htons(sr_gen_rand(g) % 4 ? 443 : 1 + sr_gen_rand(g) % 1023);
+
+    w = sr_gen_rand(g) % g->mix_total;
+    for(f->proto = 0; w >= g->o.mix[f->proto]; f->proto++)
+    { w -= g->o.mix[f->proto]; }
+} /* -- sr_gen_flow -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_pick(..)
+ * Scope: Local
+ *
+ * A route by Zipf rank.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_gen_pick(struct sr_gen* g)
+{
+    double u = sr_gen_uniform(g);
+    int lo = 0, hi = g->nroutes - 1, mid;
+
+    while(lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if(g->cdf[mid] < u)
+        { lo = mid + 1; }
+        else
+        { hi = mid; }
+    }
+    return g->rank[lo];
+} /* -- sr_gen_pick -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_create(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_gen* sr_gen_create(const struct sr_gen_opts* opts,
+                             const struct sr_gen_route* routes, int nroutes)
+{
+    struct sr_gen* g = 0;
+    double sum = 0;
+    int i, j, t;
+
+    /* REQUIRES */
+    assert(opts);
+
+    if(nroutes <= 0)
+    { return 0; }
+
+    g = (struct sr_gen*)calloc(1, sizeof(struct sr_gen));
+    assert(g);
+    g->o = *opts;
+    g->rng = (opts->seed + 1) * 0x9e3779b97f4a7c15ull;
+    for(i = 0; i < SR_GEN_NPROTOS; i++)
+    { g->mix_total += opts->mix[i]; }
+    assert(g->mix_total > 0);
+
+    g->nroutes = nroutes;
+    g->routes = (struct sr_gen_route*)malloc(nroutes * sizeof(*routes));
+    g->rank = (int*)malloc(nroutes * sizeof(int));
+    g->cdf = (double*)malloc(nroutes * sizeof(double));
+    assert(g->routes && g->rank && g->cdf);
+    memcpy(g->routes, routes, nroutes * sizeof(*routes));
+
+    /* -- popularity is not the order of the rtable -- */
+    for(i = 0; i < nroutes; i++)
+    { g->rank[i] = i; }
+    for(i = nroutes - 1; i > 0; i--)
+    {
+        j = sr_gen_rand(g) % (i + 1);
+        t = g->rank[i];
+        g->rank[i] = g->rank[j];
+        g->rank[j] = t;
+    }
+    for(i = 0; i < nroutes; i++)
+    {
+        sum += 1.0 / pow(i + 1, opts->zipf);
+        g->cdf[i] = sum;
+    }
+    for(i = 0; i < nroutes; i++)
+    { g->cdf[i] /= sum; }
+
+    for(g->seen_size = 16; g->seen_size < 2 * (unsigned int)nroutes;
+        g->seen_size *= 2);
+    g->seen = (uint32_t*)calloc(g->seen_size, sizeof(uint32_t));
+    g->seen_used = (uint8_t*)calloc(g->seen_size, 1);
+    g->burst = (int*)malloc((opts->burst_hops + 1) * sizeof(int));
+    assert(g->seen && g->seen_used && g->burst);
+
+    g->flows = (struct sr_gen_flow*)malloc(opts->flows * sizeof(struct sr_gen_flow));
+    assert(g->flows);
+    for(i = 0; i < opts->flows; i++)
+    {
+        j = sr_gen_pick(g);
+        sr_gen_flow(g, &g->routes[j], &g->flows[i]);
+        sr_gen_seen(g, g->routes[j].gw, 1);
+    }
+
+    return g;
+} /* -- sr_gen_create -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_start_burst(..)
+ * Scope: Local
+ *
+ * Up to burst_hops routes through gateways not sent to yet, in rank
+ * order.  Fewer, or none, once the rtable runs out of new gateways.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_gen_start_burst(struct sr_gen* g)
+{
+    const struct sr_gen_route* rt = 0;
+
+    g->burst_len = 0;
+    for(; g->fresh < g->nroutes && g->burst_len < g->o.burst_hops; g->fresh++)
+    {
+        rt = &g->routes[g->rank[g->fresh]];
+        if(!sr_gen_seen(g, rt->gw, 1))
+        { g->burst[g->burst_len++] = g->rank[g->fresh]; }
+    }
+} /* -- sr_gen_start_burst -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_size(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static unsigned int sr_gen_size(struct sr_gen* g)
+{
+    unsigned int w;
+
+    if(g->o.imix)
+    {
+        w = sr_gen_rand(g) % 12;
+        return w < 7 ? SR_GEN_IMIX_SMALL :
+               w < 11 ? SR_GEN_IMIX_MEDIUM : SR_GEN_IMIX_LARGE;
+    }
+    return g->o.size_min +
+           sr_gen_rand(g) % (g->o.size_max - g->o.size_min + 1);
+} /* -- sr_gen_size -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_l4_cksum(..)
+ * Scope: Local
+ *
+ * TCP or UDP checksum, pseudo header included.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint16_t sr_gen_l4_cksum(const struct sr_ip_hdr* ip_hdr,
+                                const uint8_t* l4, unsigned int len)
+{
+    uint8_t pseudo[12];
+    uint16_t n = htons(len);
+    uint64_t sum;
+
+    memcpy(pseudo, &ip_hdr->ip_src, 4);
+    memcpy(pseudo + 4, &ip_hdr->ip_dst, 4);
+    pseudo[8] = 0;
+    pseudo[9] = ip_hdr->ip_p;
+    memcpy(pseudo + 10, &n, 2);
+
+    sum = sr_cksum_add(pseudo, sizeof(pseudo), 0);
+    sum = sr_cksum_add(l4, len, sum);
+    return ~sr_cksum_fold(sum);
+} /* -- sr_gen_l4_cksum -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_next(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+unsigned int sr_gen_next(struct sr_gen* g, uint8_t* buf)
+{
+    struct sr_ethernet_hdr* e_hdr = (struct sr_ethernet_hdr*)buf;
+    struct sr_ip_hdr* ip_hdr = (struct sr_ip_hdr*)(e_hdr + 1);
+    struct sr_gen_flow burst_flow;
+    const struct sr_gen_flow* f = 0;
+    uint8_t* l4 = (uint8_t*)(ip_hdr + 1);
+    unsigned int len, l4_len, min;
+    uint16_t sum;
+
+    /* REQUIRES */
+    assert(g);
+    assert(buf);
+
+    if(g->o.burst_every && g->count && g->count % g->o.burst_every == 0)
+    { sr_gen_start_burst(g); }
+    g->count++;
+
+    if(g->burst_len > 0)
+    {
+        sr_gen_flow(g, &g->routes[g->burst[--g->burst_len]], &burst_flow);
+        f = &burst_flow;
+    }
+    else
+    { f = &g->flows[sr_gen_rand(g) % g->o.flows]; }
+
+    len = sr_gen_size(g);
+    min = sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr) +
+          sr_gen_l4_len[f->proto];
+    if(len < min)
+    { len = min; }
+    l4_len = len - sizeof(struct sr_ethernet_hdr) - sizeof(struct sr_ip_hdr);
+    memset(buf, 0, len);
+
+    memcpy(e_hdr->ether_dhost, g->o.dst_mac, ETHER_ADDR_LEN);
+    memcpy(e_hdr->ether_shost, g->o.src_mac, ETHER_ADDR_LEN);
+    e_hdr->ether_type = htons(ethertype_ip);
+
+    ip_hdr->ip_v = 4;
+    ip_hdr->ip_hl = sizeof(struct sr_ip_hdr) / 4;
+    ip_hdr->ip_len = htons(len - sizeof(struct sr_ethernet_hdr));
+    ip_hdr->ip_id = htons(g->count);
+    ip_hdr->ip_off = htons(IP_DF);
+    ip_hdr->ip_ttl = sr_gen_uniform(g) < g->o.ttl1 ? 1 : SR_GEN_TTL;
+    ip_hdr->ip_p = sr_gen_ip_proto[f->proto];
+    ip_hdr->ip_src = f->src;
+    ip_hdr->ip_dst = f->dst;
+    ip_hdr->ip_sum = cksum(ip_hdr, sizeof(struct sr_ip_hdr));
+
+    switch(f->proto)
+    {
+        case SR_GEN_TCP:
+            memcpy(l4, &f->sport, 2);
+            memcpy(l4 + 2, &f->dport, 2);
+            *(uint32_t*)(l4 + 4) = htonl(g->count * 1460);   /* seq */
+            *(uint32_t*)(l4 + 8) = htonl(1);                 /* ack */
+            l4[12] = 5 << 4;                                 /* data offset */
+            l4[13] = 0x10;                                   /* ACK */
+            *(uint16_t*)(l4 + 14) = htons(65535);            /* window */
+            sum = sr_gen_l4_cksum(ip_hdr, l4, l4_len);
+            memcpy(l4 + 16, &sum, 2);
+            break;
+        case SR_GEN_UDP:
+            memcpy(l4, &f->sport, 2);
+            memcpy(l4 + 2, &f->dport, 2);
+            *(uint16_t*)(l4 + 4) = htons(l4_len);
+            sum = sr_gen_l4_cksum(ip_hdr, l4, l4_len);
+            sum = sum ? sum : 0xffff;
+            memcpy(l4 + 6, &sum, 2);
+            break;
+        default:
+            l4[0] = 8;                                       /* echo request */
+            memcpy(l4 + 4, &f->sport, 2);                    /* identifier */
+            *(uint16_t*)(l4 + 6) = htons(g->count);          /* sequence */
+            sum = cksum(l4, l4_len);
+            memcpy(l4 + 2, &sum, 2);
+            break;
+    }
+
+    return len;
+} /* -- sr_gen_next -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_gen_destroy(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_gen_destroy(struct sr_gen* g)
+{
+    if(g == 0)
+    { return; }
+    free(g->routes);
+    free(g->rank);
+    free(g->cdf);
+    free(g->flows);
+    free(g->seen);
+    free(g->seen_used);
+    free(g->burst);
+    free(g);
+} /* -- sr_gen_destroy -- */
@@ -0,0 +1,104 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_gen.h
+ *
+ * Description:
+ *
+ * Synthetic traffic with a production like mix, for sr_bench -g and the
+ * sr_gen tool (pcap files).  Frames are Ethernet/IPv4 carrying TCP, UDP
+ * or ICMP echo, laid out as in sr_protocol.h with every checksum right.
+ * They all arrive from one sending host on one router interface.
+ *
+ * The mix is given as comma separated key=value pairs, e.g.
+ *
+ *     zipf=1.2,flows=10000,mix=tcp:80/udp:15/icmp:5,size=imix,ttl1=0.01
+ *
+ *     zipf=S          destinations: routes ranked in a random order, the
+ *                     route of rank k picked with weight 1/k^S, 0 makes
+ *                     it uniform (1.0)
+ *     flows=N         distinct flows, each a destination drawn as above
+ *                     with its own addresses, ports and protocol, every
+ *                     frame belongs to a flow picked at random (1024)
+ *     mix=P:W/..      protocol weights, P is tcp, udp or icmp
+ *                     (tcp:80/udp:15/icmp:5)
+ *     size=N          frame size: N bytes, N-M uniform, or imix for 64,
+ *                     594 and 1514 bytes 7:4:1 (imix)
+ *     ttl1=F          fraction of frames with TTL 1 (0)
+ *     burst=E:H       every E frames one frame to each of H routes whose
+ *                     gateway has not been sent to yet, a burst of new
+ *                     next hops for the ARP cache (off)
+ *     seed=N          same seed, same frames (1)
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_GEN_H
+#define SR_GEN_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_protocol.h"
+
+#define SR_GEN_MAXLEN 1514      /* largest frame */
+
+enum sr_gen_proto
+{
+    SR_GEN_TCP,
+    SR_GEN_UDP,
+    SR_GEN_ICMP,
+    SR_GEN_NPROTOS
+};
+
+/* a destination prefix, network byte order */
+struct sr_gen_route
+{
+    uint32_t dest;
+    uint32_t mask;
+    uint32_t gw;
+};
+
+struct sr_gen_opts
+{
+    /* -- the mix, see above -- */
+    double zipf;
+    int flows;
+    int mix[SR_GEN_NPROTOS];
+    int size_min, size_max;     /* uniform in [min, max] unless imix */
+    int imix;
+    double ttl1;
+    int burst_every, burst_hops;
+    unsigned int seed;
+
+    /* -- the sending host, network byte order -- */
+    uint8_t dst_mac[ETHER_ADDR_LEN];    /* router interface it sends to */
+    uint8_t src_mac[ETHER_ADDR_LEN];
+    uint32_t src_net, src_mask;         /* flow sources are drawn from */
+};
+
+struct sr_gen;
+
+/* defaults for the mix, addresses zeroed */
+void sr_gen_defaults(struct sr_gen_opts* opts);
+
+/* Apply a "key=value,.." mix to opts.  Returns 0, or -1 and says why on
+   stderr. */
+int  sr_gen_parse(struct sr_gen_opts* opts, const char* spec);
+
+/* Read routes from an rtable file (dest gw mask iface per line) into
+   *routes, a malloc'd array.  Returns their number or -1. */
+int  sr_gen_load_rtable(const char* path, struct sr_gen_route** routes);
+
+/* A generator over nroutes routes (copied), 0 if there are none. */
+struct sr_gen* sr_gen_create(const struct sr_gen_opts* opts,
+                             const struct sr_gen_route* routes, int nroutes);
+
+/* Write the next frame to buf (SR_GEN_MAXLEN bytes), returns its length. */
+unsigned int sr_gen_next(struct sr_gen* gen, uint8_t* buf);
+
+void sr_gen_destroy(struct sr_gen* gen);
+
+#endif /* -- SR_GEN_H -- */
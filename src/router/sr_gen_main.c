@@ -0,0 +1,175 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_gen_main.c
+ *
+ * Description:
+ *
+ * sr_gen, synthetic traffic into a pcap file ("make sr_gen"):
+ *
+ *     sr_gen [-r rtable] [-g mix] [-n frames] [-p frames/s]
+ *            [-m router_mac] [-s src_mac] [-S src_net/len] -w file
+ *
+ * The mix is described in sr_gen.h.  Frames are stamped -p apart and
+ * by default come from the client of the stock topology (10.0.1.100
+ * behind eth3, as sr_vnsd has it), so the file replays with sr_bench -R
+ * or sr -R on the usual interfaces.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "sr_gen.h"
+#include "sr_dumper.h"
+
+#define SR_GEN_FRAMES  100000
+#define SR_GEN_PPS     1000000
+
+static int parse_mac(const char* str, uint8_t* mac)
+{
+    unsigned int b[ETHER_ADDR_LEN];
+    int i;
+
+    if(sscanf(str, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4],
+              &b[5]) != ETHER_ADDR_LEN)
+    { return -1; }
+    for(i = 0; i < ETHER_ADDR_LEN; i++)
+    { mac[i] = b[i]; }
+    return 0;
+}
+
+static int parse_net(const char* str, uint32_t* net, uint32_t* mask)
+{
+    char buf[64];
+    char* slash = 0;
+    int len = 32;
+
+    if(strlen(str) >= sizeof(buf))
+    { return -1; }
+    strcpy(buf, str);
+    if((slash = strchr(buf, '/')) != 0)
+    {
+        *slash++ = 0;
+        len = atoi(slash);
+    }
+    if(len < 0 || len > 32 || inet_pton(AF_INET, buf, net) != 1)
+    { return -1; }
+    *mask = len ? htonl(0xffffffff << (32 - len)) : 0;
+    *net &= *mask;
+    return 0;
+}
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-r rtable] [-g mix] [-n frames] [-p frames/s]\n", argv0);
+    printf("           [-m router_mac] [-s src_mac] [-S src_net/len] -w file\n");
+    printf("   mix e.g. zipf=1.2,flows=10000,mix=tcp:80/udp:15/icmp:5,"
+           "size=imix,ttl1=0.01,burst=10000:8,seed=1\n");
+}
+
+int main(int argc, char** argv)
+{
+    struct sr_gen_opts opts;
+    struct sr_gen_route* routes = 0;
+    struct sr_gen* gen = 0;
+    struct pcap_pkthdr h;
+    uint8_t buf[SR_GEN_MAXLEN];
+    const char* rtable = "../rtable";
+    const char* out = 0;
+    FILE* fp = 0;
+    unsigned long long bytes = 0;
+    long frames = SR_GEN_FRAMES;
+    double pps = SR_GEN_PPS;
+    double t;
+    int nroutes;
+    long i;
+    int c;
+
+    sr_gen_defaults(&opts);
+    parse_mac("02:00:00:00:03:01", opts.dst_mac);
+    parse_mac("02:00:00:00:03:02", opts.src_mac);
+    parse_net("10.0.1.100/32", &opts.src_net, &opts.src_mask);
+
+    while((c = getopt(argc, argv, "hr:g:n:p:m:s:S:w:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'r':
+                rtable = optarg;
+                break;
+            case 'g':
+                if(sr_gen_parse(&opts, optarg) != 0)
+                { exit(1); }
+                break;
+            case 'n':
+                frames = atol(optarg);
+                break;
+            case 'p':
+                pps = atof(optarg);
+                break;
+            case 'm':
+                if(parse_mac(optarg, opts.dst_mac) != 0)
+                {
+                    fprintf(stderr, "bad MAC %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 's':
+                if(parse_mac(optarg, opts.src_mac) != 0)
+                {
+                    fprintf(stderr, "bad MAC %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                if(parse_net(optarg, &opts.src_net, &opts.src_mask) != 0)
+                {
+                    fprintf(stderr, "bad source net %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'w':
+                out = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(out == 0 || frames <= 0 || pps <= 0)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if((nroutes = sr_gen_load_rtable(rtable, &routes)) < 0)
+    { exit(1); }
+    if((gen = sr_gen_create(&opts, routes, nroutes)) == 0)
+    {
+        fprintf(stderr, "%s has no routes\n", rtable);
+        exit(1);
+    }
+    if((fp = sr_dump_open(out, 0, SR_GEN_MAXLEN)) == 0)
+    { exit(1); }
+
+    for(i = 0; i < frames; i++)
+    {
+        t = i / pps;
+        h.ts.tv_sec = (time_t)t;
+        h.ts.tv_usec = (suseconds_t)((t - h.ts.tv_sec) * 1e6);
+        h.caplen = h.len = sr_gen_next(gen, buf);
+        sr_dump(fp, &h, buf);
+        bytes += h.len;
+    }
+    sr_dump_close(fp);
+
+    fprintf(stderr, "%ld frames, %llu bytes over %d routes to %s\n", frames,
+            bytes, nroutes, out);
+
+    sr_gen_destroy(gen);
+    free(routes);
+    return 0;
+}
@@ -22,6 +22,7 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "sr_cksum.h"
 
 /*---------------------------------------------------------------------
  * Method: sr_get_interface
@@ -61,22 +62,53 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
  *
  *---------------------------------------------------------------------*/
 
+static unsigned int sr_local_ip_slot(uint32_t ip)
+{ return ((ip * 0x9e3779b1u) >> 16) & (SR_LOCAL_IP_SLOTS - 1); }
+
 struct sr_if *get_interface_from_ip(struct sr_instance *sr, uint32_t ip_address)
 {
-  struct sr_if *cur_iface = sr->if_list;
-  struct sr_if *dest_iface = NULL;
-  while (cur_iface)
+  unsigned int slot = sr_local_ip_slot(ip_address);
+  struct sr_if *cur_iface;
+
+  /* -- linear probing, the table always has empty slots -- */
+  while ((cur_iface = sr->local_ips[slot]) != NULL)
   {
     if (ip_address == cur_iface->ip)
-    {
-      dest_iface = cur_iface;
-      break;
-    }
-    cur_iface = cur_iface->next;
+    { return cur_iface; }
+    slot = (slot + 1) & (SR_LOCAL_IP_SLOTS - 1);
   }
-  return dest_iface;
+  return NULL;
 } /* -- sr_get_interface_from_ip -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_rehash_local_ips(..)
+ * Scope: Local
+ *
+ * Rebuild sr->local_ips after an interface address changed.  Going
+ * down the list in order keeps the first of two interfaces sharing an
+ * address, as a walk of the list would.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rehash_local_ips(struct sr_instance* sr)
+{
+    struct sr_if* if_walker = 0;
+    unsigned int slot;
+
+    memset(sr->local_ips, 0, sizeof(sr->local_ips));
+
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(get_interface_from_ip(sr, if_walker->ip))
+        { continue; }
+
+        slot = sr_local_ip_slot(if_walker->ip);
+        while(sr->local_ips[slot])
+        { slot = (slot + 1) & (SR_LOCAL_IP_SLOTS - 1); }
+        sr->local_ips[slot] = if_walker;
+    }
+} /* -- sr_rehash_local_ips -- */
+
 /*---------------------------------------------------------------------
  * Method: sr_get_interface_from_eth
  * Scope: Global
@@ -116,7 +148,8 @@ struct sr_if *get_interface_from_eth(struct sr_instance *sr, uint8_t *eth_addres
  * Method: sr_add_interface(..)
  * Scope: Global
  *
- * Add and interface to the router's list
+ * Add and interface to the router's list, it gets the next ifindex
+ * (its slot in sr->ifs).
  *
  *---------------------------------------------------------------------*/
 
@@ -128,6 +161,13 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     assert(name);
     assert(sr);
 
+    if(sr->num_ifs == SR_MAX_IFACES)
+    {
+        fprintf(stderr, "Too many interfaces, %s not added (max %d)\n",
+                name, SR_MAX_IFACES);
+        exit(1);
+    }
+
     /* -- empty list special case -- */
     if(sr->if_list == 0)
     {
@@ -135,6 +175,10 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
         assert(sr->if_list);
         sr->if_list->next = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
+        sr->if_list->ip = 0;
+        sr->if_list->ifindex = sr->num_ifs;
+        sr->ifs[sr->num_ifs++] = sr->if_list;
+        sr_rehash_local_ips(sr);
         return;
     }
 
@@ -148,6 +192,10 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     if_walker = if_walker->next;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
     if_walker->next = 0;
+    if_walker->ip = 0;
+    if_walker->ifindex = sr->num_ifs;
+    sr->ifs[sr->num_ifs++] = if_walker;
+    sr_rehash_local_ips(sr);
 } /* -- sr_add_interface -- */
 
 /*---------------------------------------------------------------------
@@ -172,6 +220,7 @@ void sr_set_ether_addr(struct sr_instance* sr, const unsigned char* addr)
     /* -- copy address -- */
     memcpy(if_walker->addr,addr,6);
 
+    sr_if_icmp_template(if_walker);
 } /* -- sr_set_ether_addr -- */
 
 /*---------------------------------------------------------------------
@@ -196,8 +245,43 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
 
+    sr_rehash_local_ips(sr);
+    sr_if_icmp_template(if_walker);
 } /* -- sr_set_ether_ip -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_if_icmp_template(..)
+ * Scope: Global
+ *
+ * (Re)build the ICMP error template of iface from its addresses.  The
+ * IP header is summed with ip_sum and ip_dst zero, so a sender adds
+ * the destination's two words, folds and stores the complement.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_if_icmp_template(struct sr_if* iface)
+{
+    sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*)iface->icmp_err;
+    sr_ip_hdr_t* ip_hdr =
+        (sr_ip_hdr_t*)(iface->icmp_err + sizeof(sr_ethernet_hdr_t));
+
+    /* -- REQUIRES -- */
+    assert(iface);
+
+    memset(iface->icmp_err, 0, SR_ICMP_ERR_LEN);
+    memcpy(eth_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    eth_hdr->ether_type = htons(ethertype_ip);
+
+    ip_hdr->ip_v = 4;
+    ip_hdr->ip_hl = sizeof(sr_ip_hdr_t) / 4;
+    ip_hdr->ip_len = htons(sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_hdr_t));
+    ip_hdr->ip_ttl = INIT_TTL;
+    ip_hdr->ip_p = ip_protocol_icmp;
+    ip_hdr->ip_src = iface->ip;
+
+    iface->icmp_err_sum = sr_cksum_add(ip_hdr, sizeof(sr_ip_hdr_t), 0);
+} /* -- sr_if_icmp_template -- */
+
 /*---------------------------------------------------------------------
  * Method: sr_print_if_list(..)
  * Scope: Global
@@ -250,3 +334,83 @@ void sr_print_if(struct sr_if* iface)
     Debug("\n");
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
 } /* -- sr_print_if -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_parse_if_spec(..)
+ * Scope: Global
+ *
+ * Parse an interface description of the form
+ *
+ *     name[@dev],ip[,mac]
+ *
+ * where dev is the host device the interface is bound to and mac is
+ * written as six colon separated hex bytes.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on success
+ *  -1 if the description is malformed
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_parse_if_spec(const char* spec, struct sr_if_spec* out)
+{
+    char buf[128];
+    char* name = 0;
+    char* ip = 0;
+    char* mac = 0;
+    char* dev = 0;
+    unsigned int b[ETHER_ADDR_LEN];
+    struct in_addr ip_addr;
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(spec);
+    assert(out);
+
+    memset(out, 0, sizeof(struct sr_if_spec));
+
+    if(strlen(spec) >= sizeof(buf))
+    { return -1; }
+    strcpy(buf, spec);
+
+    name = buf;
+    if((ip = strchr(name, ',')) == 0)
+    { return -1; }
+    *ip++ = '\0';
+
+    if((mac = strchr(ip, ',')) != 0)
+    { *mac++ = '\0'; }
+
+    if((dev = strchr(name, '@')) != 0)
+    {
+        *dev++ = '\0';
+        if(*dev == '\0' || strlen(dev) >= sr_IFACE_NAMELEN)
+        { return -1; }
+        strncpy(out->dev, dev, sr_IFACE_NAMELEN);
+    }
+
+    if(*name == '\0' || strlen(name) >= sr_IFACE_NAMELEN)
+    { return -1; }
+    strncpy(out->name, name, sr_IFACE_NAMELEN);
+
+    if(inet_aton(ip, &ip_addr) == 0)
+    { return -1; }
+    out->ip = ip_addr.s_addr;
+
+    if(mac)
+    {
+        if(sscanf(mac, "%x:%x:%x:%x:%x:%x",
+                    &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != ETHER_ADDR_LEN)
+        { return -1; }
+        for(i = 0; i < ETHER_ADDR_LEN; i++)
+        {
+            if(b[i] > 0xff)
+            { return -1; }
+            out->addr[i] = (unsigned char)b[i];
+        }
+        out->has_addr = 1;
+    }
+
+    return 0;
+} /* -- sr_parse_if_spec -- */
@@ -26,6 +26,11 @@
 
 struct sr_instance;
 
+/* an ICMP error as the router sends it: Ethernet and IP header, ICMP
+   header and the first ICMP_DATA_SIZE bytes of the offending packet */
+#define SR_ICMP_ERR_LEN (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + \
+                         sizeof(sr_icmp_hdr_t))
+
 /* ----------------------------------------------------------------------------
  * struct sr_if
  *
@@ -39,7 +44,31 @@ struct sr_if
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
   uint32_t speed;
+  int ifindex;                   /* position in sr->ifs */
   struct sr_if* next;
+
+  /* ICMP errors sent from this interface start as a copy of icmp_err,
+     which has everything but the destination MAC and IP, the type and
+     code and the quoted packet, see sr_if_icmp_template() */
+  uint8_t icmp_err[SR_ICMP_ERR_LEN];
+  uint64_t icmp_err_sum;         /* unfolded sum of its IP header */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_if_spec
+ *
+ * Interface description given on the command line instead of by the
+ * server's VNSHWINFO message, e.g. "eth1@veth1,10.0.1.1,02:00:00:00:01:01"
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_if_spec
+{
+  char name[sr_IFACE_NAMELEN];   /* router interface name (eth1) */
+  char dev[sr_IFACE_NAMELEN];    /* host device to bind, empty if none */
+  uint32_t ip;                   /* network byte order */
+  unsigned char addr[ETHER_ADDR_LEN];
+  int has_addr;                  /* addr given explicitly */
 };
 
 struct sr_if *sr_get_interface(struct sr_instance* sr, const char* name);
@@ -48,7 +77,9 @@ struct sr_if *get_interface_from_eth(struct sr_instance *, uint8_t *);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
+void sr_if_icmp_template(struct sr_if*);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
+int  sr_parse_if_spec(const char*, struct sr_if_spec*);
 
 #endif /* --  sr_INTERFACE_H -- */
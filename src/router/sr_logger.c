@@ -0,0 +1,512 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_logger.c
+ *
+ * Description:
+ *
+ * Asynchronous pcap / pcapng writer, see sr_logger.h.
+ *
+ * The ring is a bounded multi producer queue of fixed size records, each
+ * slot carrying a sequence number (D. Vyukov's bounded MPMC queue, used
+ * here with a single consumer).  A producer claims a slot by moving head
+ * forward with a compare and swap, fills it and then publishes it by
+ * setting the slot's sequence to pos + 1.  The writer takes slots in
+ * order while their sequence says they are published and hands them back
+ * by setting it to pos + size.  A producer that finds its slot still a
+ * lap behind knows the ring is full and drops.
+ *
+ * The writer packs records into one large buffer and writes it out once
+ * per drain, then sleeps for a tick if the ring ran dry.  Producers never
+ * signal it, waking a thread costs more than the copy.
+ *
+ * The filter and the sampling run before a slot is claimed, so a frame
+ * that is not logged costs one short filter program and no shared write.
+ * The sampling countdown is per thread for the same reason, with several
+ * threads logging the overall rate is still 1 in sample.
+ *
+ * Output goes to one file or, when rotating, to a series of segments.  A
+ * segment is cut before a record that would take it past the size limit
+ * or that is stamped after its time limit, and each one starts with its
+ * own headers so it can be read alone.  Segments with a size limit are
+ * preallocated up front and trimmed to what was written when closed, so
+ * the file system is not extending the file on every write.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "sr_logger.h"
+#include "sr_filter.h"
+#include "sr_dumper.h"
+#include "sr_protocol.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_ring.h"
+
+#define SR_LOGGER_BUF  (256 * 1024)  /* writer's output buffer */
+#define SR_LOGGER_IDLE 1000000       /* ns the writer sleeps when idle */
+
+struct sr_log_rec
+{
+    uint32_t seq;
+    uint32_t caplen;
+    uint32_t len;
+    uint16_t ifindex;
+    uint8_t  dir;               /* SR_DIR_* */
+    uint64_t ts;                /* ns since the epoch */
+    uint8_t data[];             /* snaplen bytes */
+};
+
+struct sr_logger
+{
+    struct sr_instance* sr;
+    uint8_t* slots;
+    size_t stride;              /* bytes per slot */
+    uint32_t mask;
+    unsigned int snaplen;
+    unsigned int sample;
+    struct sr_filter* filter;
+    pthread_t thread;
+
+    /* -- claimed by the producers -- */
+    uint32_t head __attribute__ ((aligned (SR_CACHE_LINE)));
+    unsigned long drops[SR_MAX_IFACES];
+
+    /* -- owned by the writer -- */
+    uint32_t tail __attribute__ ((aligned (SR_CACHE_LINE)));
+    unsigned long drops_seen[SR_MAX_IFACES]; /* already in an epb */
+    uint8_t* out;               /* SR_LOGGER_BUF bytes */
+    size_t off;                 /* bytes waiting in out */
+    unsigned long written;
+    unsigned long writes;       /* write calls */
+    int stop;
+
+    /* -- output -- */
+    char path[256];
+    int ng;                     /* pcapng rather than pcap */
+    uint64_t rotate_bytes;
+    uint64_t rotate_ns;
+    int fd;
+    int prealloc;               /* fd was fallocate()d, trim at close */
+    uint64_t seg_bytes;         /* written to fd */
+    uint64_t seg_hdr;           /* of which headers */
+    uint64_t seg_tail;          /* bytes sr_logger_seg_close() may add */
+    uint64_t seg_start;         /* ns */
+    unsigned int seg_seq;
+    unsigned int segs;
+};
+
+static __thread unsigned int sr_log_skip; /* frames until the next sample */
+
+static inline struct sr_log_rec* sr_logger_slot(struct sr_logger* lg,
+                                                uint32_t pos)
+{ return (struct sr_log_rec*)(lg->slots + (pos & lg->mask) * lg->stride); }
+
+static uint64_t sr_logger_now(void)
+{
+    struct timespec ts;
+
+    /* -- vDSO on Linux, no system call -- */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_flush(..)
+ * Scope:  Local
+ *
+ * Write out what is waiting in the output buffer.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_logger_flush(struct sr_logger* lg)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while(done < lg->off)
+    {
+        n = write(lg->fd, lg->out + done, lg->off - done);
+        if(n < 0 && errno == EINTR)
+        { continue; }
+        if(n <= 0)
+        {
+            perror("write(..):sr_logger.c::sr_logger_flush(..)");
+            break;
+        }
+        done += n;
+    }
+    if(lg->off > 0)
+    { lg->writes++; }
+
+    lg->seg_bytes += done;
+    lg->off = 0;
+} /* -- sr_logger_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_seg_open(..)
+ * Scope:  Local
+ *
+ * Open the next output file and queue its headers.  When rotating the
+ * n-th segment of log.pcapng is log-<n>.pcapng.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_logger_seg_open(struct sr_logger* lg, uint64_t now)
+{
+    struct sr_instance* sr = lg->sr;
+    char name[sizeof(lg->path) + 16];
+    const char* ext = 0;
+    int i;
+
+    if(strcmp(lg->path, "-") == 0)
+    {
+        snprintf(name, sizeof(name), "(stdout)");
+        lg->fd = dup(STDOUT_FILENO);
+    }
+    else
+    {
+        if(lg->rotate_bytes || lg->rotate_ns)
+        {
+            ext = strrchr(lg->path, '.');
+            if(ext == 0 || strchr(ext, '/'))
+            { ext = lg->path + strlen(lg->path); }
+            snprintf(name, sizeof(name), "%.*s-%03u%s",
+                     (int)(ext - lg->path), lg->path, lg->seg_seq, ext);
+        }
+        else
+        { snprintf(name, sizeof(name), "%s", lg->path); }
+
+        lg->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if(lg->fd < 0)
+    {
+        fprintf(stderr, "Error opening up dump file %s\n", name);
+        return -1;
+    }
+
+    lg->prealloc = 0;
+    if(lg->rotate_bytes && posix_fallocate(lg->fd, 0, lg->rotate_bytes) == 0)
+    { lg->prealloc = 1; }
+
+    lg->seg_bytes = 0;
+    lg->seg_start = now;
+    lg->seg_seq++;
+    lg->segs++;
+
+    if(lg->ng)
+    {
+        lg->off += sr_dump_ng_shb(lg->out + lg->off);
+        /* -- interface id == ifindex -- */
+        for(i = 0; i < sr->num_ifs; i++)
+        {
+            lg->off += sr_dump_ng_idb(lg->out + lg->off, sr->ifs[i]->name,
+                                      sr->ifs[i]->addr, lg->snaplen);
+        }
+    }
+    else
+    { lg->off += sr_dump_hdr(lg->out + lg->off, 0, lg->snaplen); }
+    lg->seg_hdr = lg->off;
+    lg->seg_tail = lg->ng ? sr->num_ifs * PCAPNG_ISB_MAX : 0;
+
+    return 0;
+} /* -- sr_logger_seg_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_seg_close(..)
+ * Scope:  Local
+ *
+ * pcapng segments end with an Interface Statistics Block per interface
+ * giving the records lost so far.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_logger_seg_close(struct sr_logger* lg, uint64_t now)
+{
+    int i;
+
+    if(lg->ng)
+    {
+        for(i = 0; i < lg->sr->num_ifs; i++)
+        {
+            if(lg->off + PCAPNG_ISB_MAX > SR_LOGGER_BUF)
+            { sr_logger_flush(lg); }
+            lg->off += sr_dump_ng_isb(lg->out + lg->off, i, now,
+                         __atomic_load_n(&lg->drops[i], __ATOMIC_RELAXED));
+        }
+    }
+    sr_logger_flush(lg);
+
+    if(lg->prealloc && ftruncate(lg->fd, lg->seg_bytes) != 0)
+    { perror("ftruncate(..):sr_logger.c::sr_logger_seg_close(..)"); }
+    close(lg->fd);
+    lg->fd = -1;
+} /* -- sr_logger_seg_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_drain(..)
+ * Scope:  Local
+ *
+ * Write out every published record, returns how many there were.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned long sr_logger_drain(struct sr_logger* lg)
+{
+    struct sr_log_rec* rec = 0;
+    struct pcap_pkthdr h;
+    unsigned long n = 0;
+    unsigned long drops;
+    size_t need;
+    uint64_t used;
+
+    for(;;)
+    {
+        rec = sr_logger_slot(lg, lg->tail);
+        if(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != lg->tail + 1)
+        { break; }
+
+        need = lg->ng ? PCAPNG_EPB_MAX(rec->caplen)
+                      : sizeof(struct pcap_sf_pkthdr) + rec->caplen;
+
+        /* -- cut the segment, but never leave one without records.  The
+              size limit leaves room for the closing statistics -- */
+        used = lg->seg_bytes + lg->off;
+        if(used > lg->seg_hdr &&
+           ((lg->rotate_bytes && used + need + lg->seg_tail > lg->rotate_bytes) ||
+            (lg->rotate_ns && rec->ts >= lg->seg_start + lg->rotate_ns)))
+        {
+            sr_logger_seg_close(lg, rec->ts);
+            if(sr_logger_seg_open(lg, rec->ts) != 0)
+            { exit(1); }
+        }
+        if(lg->off + need > SR_LOGGER_BUF)
+        { sr_logger_flush(lg); }
+
+        if(lg->ng)
+        {
+            drops = __atomic_load_n(&lg->drops[rec->ifindex], __ATOMIC_RELAXED);
+            lg->off += sr_dump_ng_epb(lg->out + lg->off, rec->ifindex, rec->ts,
+                    rec->data, rec->caplen, rec->len,
+                    rec->dir == SR_DIR_IN ? PCAPNG_EPB_INBOUND
+                                          : PCAPNG_EPB_OUTBOUND,
+                    drops - lg->drops_seen[rec->ifindex]);
+            lg->drops_seen[rec->ifindex] = drops;
+        }
+        else
+        {
+            h.ts.tv_sec = rec->ts / 1000000000ull;
+            h.ts.tv_usec = rec->ts % 1000000000ull / 1000;
+            h.caplen = rec->caplen;
+            h.len = rec->len;
+            lg->off += sr_dump_rec(lg->out + lg->off, &h, rec->data);
+        }
+
+        __atomic_store_n(&rec->seq, lg->tail + lg->mask + 1, __ATOMIC_RELEASE);
+        lg->tail++;
+        n++;
+    }
+
+    if(lg->off > 0)
+    { sr_logger_flush(lg); }
+    lg->written += n;
+    return n;
+} /* -- sr_logger_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_main(..)
+ * Scope:  Local
+ *
+ * Writer thread, drains until told to stop and then once more.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_logger_main(void* arg)
+{
+    struct sr_logger* lg = (struct sr_logger*)arg;
+    struct timespec idle = { 0, SR_LOGGER_IDLE };
+
+    while(!__atomic_load_n(&lg->stop, __ATOMIC_ACQUIRE))
+    {
+        if(sr_logger_drain(lg) == 0)
+        { nanosleep(&idle, 0); }
+    }
+    sr_logger_drain(lg);
+    sr_logger_seg_close(lg, sr_logger_now());
+
+    return 0;
+} /* -- sr_logger_main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_logger_start(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_logger_start(struct sr_instance* sr, const struct sr_logger_opts* opts)
+{
+    struct sr_logger* lg = 0;
+    size_t plen;
+    uint32_t n = 64;
+    uint32_t i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(opts);
+    assert(opts->path);
+    assert(opts->snaplen > 0 && opts->snaplen <= SR_LOGGER_BUF / 2);
+
+    if((plen = strlen(opts->path)) >= sizeof(lg->path))
+    {
+        fprintf(stderr, "Log file name too long\n");
+        return -1;
+    }
+
+    lg = (struct sr_logger*)calloc(1, sizeof(struct sr_logger));
+    assert(lg);
+    lg->sr = sr;
+    lg->snaplen = opts->snaplen;
+    lg->sample = opts->sample;
+    lg->filter = opts->filter;
+    lg->stride = (sizeof(struct sr_log_rec) + opts->snaplen + SR_CACHE_LINE - 1)
+                 & ~(size_t)(SR_CACHE_LINE - 1);
+    memcpy(lg->path, opts->path, plen + 1);
+    lg->ng = plen > 7 && strcmp(opts->path + plen - 7, ".pcapng") == 0;
+    lg->rotate_bytes = opts->rotate_bytes;
+    lg->rotate_ns = opts->rotate_secs * 1000000000ull;
+    lg->fd = -1;
+
+    /* -- as many slots as fit SR_LOGGER_RING, a power of two -- */
+    while(2 * n * lg->stride <= SR_LOGGER_RING)
+    { n <<= 1; }
+
+    lg->slots = (uint8_t*)malloc(n * lg->stride);
+    lg->out = (uint8_t*)malloc(SR_LOGGER_BUF);
+    if(!lg->slots || !lg->out || sr_logger_seg_open(lg, sr_logger_now()) != 0)
+    {
+        free(lg->slots);
+        free(lg->out);
+        free(lg);
+        return -1;
+    }
+    lg->mask = n - 1;
+    for(i = 0; i < n; i++)
+    { sr_logger_slot(lg, i)->seq = i; }
+
+    if(pthread_create(&lg->thread, 0, sr_logger_main, lg) != 0)
+    {
+        close(lg->fd);
+        free(lg->slots);
+        free(lg->out);
+        free(lg);
+        return -1;
+    }
+
+    sr->logger = lg;
+    return 0;
+} /* -- sr_logger_start -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_logger_put(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_logger_put(struct sr_logger* lg, const uint8_t* buf, unsigned int len,
+                   int ifindex, int dir)
+{
+    struct sr_log_rec* rec = 0;
+    uint32_t pos;
+    uint32_t seq;
+    int32_t dif;
+
+    if(lg->filter && !sr_filter_match(lg->filter, buf, len, ifindex, dir))
+    { return; }
+    if(lg->sample > 1)
+    {
+        if(sr_log_skip > 0)
+        {
+            sr_log_skip--;
+            return;
+        }
+        sr_log_skip = lg->sample - 1;
+    }
+
+    /* -- a frame without an interface is booked on the first one -- */
+    if(ifindex < 0 || ifindex >= SR_MAX_IFACES)
+    { ifindex = 0; }
+
+    pos = __atomic_load_n(&lg->head, __ATOMIC_RELAXED);
+    for(;;)
+    {
+        rec = sr_logger_slot(lg, pos);
+        seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        dif = (int32_t)(seq - pos);
+
+        if(dif == 0)
+        {
+            if(__atomic_compare_exchange_n(&lg->head, &pos, pos + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            { break; }
+            /* -- lost the slot, pos now holds the new head -- */
+        }
+        else if(dif < 0)
+        {
+            /* -- writer is a whole lap behind -- */
+            __atomic_fetch_add(&lg->drops[ifindex], 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        { pos = __atomic_load_n(&lg->head, __ATOMIC_RELAXED); }
+    }
+
+    rec->ts = sr_logger_now();
+    rec->ifindex = ifindex;
+    rec->dir = dir;
+    rec->len = len;
+    rec->caplen = min(lg->snaplen, len);
+    memcpy(rec->data, buf, rec->caplen);
+
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+} /* -- sr_logger_put -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_logger_stop(..)
+ * Scope: Global
+ *
+ * The ring is not freed.  A thread that already loaded sr->logger (the
+ * ARP thread is never joined) may still be filling a slot, its record is
+ * simply lost.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_logger_stop(struct sr_instance* sr)
+{
+    struct sr_logger* lg = 0;
+    unsigned long drops = 0;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if((lg = sr->logger) == 0)
+    { return; }
+    __atomic_store_n(&sr->logger, 0, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&lg->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(lg->thread, 0);
+
+    for(i = 0; i < SR_MAX_IFACES; i++)
+    { drops += __atomic_load_n(&lg->drops[i], __ATOMIC_RELAXED); }
+    fprintf(stderr, "Packet log: %lu records in %lu writes to %u file%s, "
+            "%lu dropped (ring full)\n", lg->written, lg->writes, lg->segs,
+            lg->segs > 1 ? "s" : "", drops);
+} /* -- sr_logger_stop -- */
@@ -0,0 +1,69 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_logger.h
+ *
+ * Description:
+ *
+ * Background writer for the -l packet log.  sr_log_packet() copies the
+ * capture record into a bounded ring and returns, a writer thread drains
+ * the ring into the log file in large writes.  A file named *.pcapng gets
+ * pcapng with one interface per sr_if (interface id == ifindex),
+ * direction flags, drop counts and nanosecond time stamps, anything else
+ * classic pcap.  Any thread may log (the
+ * reader, the workers, the TX and ARP threads), so the ring takes several
+ * producers.  When it is full the record is dropped and counted, forwarding
+ * never waits for the disk.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOGGER_H
+#define SR_LOGGER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_LOGGER_RING (4 * 1024 * 1024) /* bytes of records in the ring */
+
+struct sr_instance;
+struct sr_logger;
+struct sr_filter;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_logger_opts
+ *
+ * What gets into the log and where.  A frame is recorded if it passes
+ * the filter, then only every sample-th of those.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_logger_opts
+{
+    const char* path;           /* log file, "-" for stdout */
+    const char* filter_expr;    /* -F, see sr_filter.h */
+    uint64_t rotate_bytes;      /* start a new file at this size, 0 never */
+    unsigned int rotate_secs;   /* or after this long, 0 never */
+    unsigned int snaplen;       /* bytes kept of each frame */
+    unsigned int sample;        /* 1 in sample frames, 0 or 1 for all */
+    struct sr_filter* filter;   /* filter_expr compiled, handed over */
+};
+
+/* Open the log file and start its writer as sr->logger.  Needs the
+   interfaces.  Returns 0 on success. */
+int  sr_logger_start(struct sr_instance* sr, const struct sr_logger_opts* opts);
+
+/* Queue a record of buf if it passes the filter and sampling.  dir is
+   SR_DIR_IN or SR_DIR_OUT (sr_filter.h).  Never blocks. */
+void sr_logger_put(struct sr_logger* lg, const uint8_t* buf, unsigned int len,
+                   int ifindex, int dir);
+
+/* Drain what is queued, close the file, stop the writer and report
+   written and dropped records on stderr. */
+void sr_logger_stop(struct sr_instance* sr);
+
+#endif /* -- SR_LOGGER_H -- */
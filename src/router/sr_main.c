@@ -27,8 +27,15 @@
 #endif /* _LINUX_ */
 
 #include "sr_dumper.h"
+#include "sr_logger.h"
+#include "sr_filter.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_transport.h"
+#include "sr_workers.h"
+#include "sr_prof.h"
+#include "sr_ctl.h"
 
 extern char* optarg;
 
@@ -61,12 +68,32 @@ int main(int argc, char **argv)
     char *template = NULL;
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
-    char *logfile = 0;
+    char *replay = 0;
+    char *capture = 0;
+    char *ctl_path = 0;
+    struct sr_logger_opts lopts;
+    int shm = 0;
+    int nworkers = 0;
+    int cpus[SR_MAX_CPUS];
+    int ncpus = 0;
+    struct sr_if_spec ifspecs[SR_MAX_IFSPECS];
+    int num_ifspecs = 0;
+    struct sr_transport_opts opts;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
-
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    SR_PROF_INIT();
+    SR_PROF_THREAD("reader", -1);
+
+    lopts.path = 0;
+    lopts.rotate_bytes = 0;
+    lopts.rotate_secs = 0;
+    lopts.snaplen = PACKET_DUMP_SIZE;
+    lopts.sample = 1;
+    lopts.filter_expr = 0;
+    lopts.filter = 0;
+
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:I:R:W:Mw:a:F:N:S:C:G:U:")) != EOF)
     {
         switch (c)
         {
@@ -90,7 +117,42 @@ int main(int argc, char **argv)
                 server = optarg;
                 break;
             case 'l':
-                logfile = optarg;
+                lopts.path = optarg;
+                break;
+            case 'F':
+                lopts.filter_expr = optarg;
+                break;
+            case 'N':
+                lopts.sample = atoi((char *) optarg);
+                if(lopts.sample < 1)
+                {
+                    fprintf(stderr,"Bad sampling rate %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                lopts.snaplen = atoi((char *) optarg);
+                if(lopts.snaplen < 14 || lopts.snaplen > 65535)
+                {
+                    fprintf(stderr,"Bad snaplen %s (14 to 65535)\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'C':
+                lopts.rotate_bytes = strtoull(optarg, 0, 10) * 1000000;
+                if(lopts.rotate_bytes == 0)
+                {
+                    fprintf(stderr,"Bad file size %s (MB)\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'G':
+                if(atoi((char *) optarg) <= 0)
+                {
+                    fprintf(stderr,"Bad rotation interval %s (s)\n", optarg);
+                    exit(1);
+                }
+                lopts.rotate_secs = atoi((char *) optarg);
                 break;
             case 'r':
                 rtable = optarg;
@@ -98,11 +160,64 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'I':
+                if(num_ifspecs == SR_MAX_IFSPECS)
+                {
+                    fprintf(stderr,"Too many interfaces (max %d)\n",
+                            SR_MAX_IFSPECS);
+                    exit(1);
+                }
+                if(sr_parse_if_spec(optarg, &ifspecs[num_ifspecs]) != 0)
+                {
+                    fprintf(stderr,"Bad interface %s, expected "
+                            "name[@dev],ip[,mac]\n", optarg);
+                    exit(1);
+                }
+                num_ifspecs++;
+                break;
+            case 'R':
+                replay = optarg;
+                break;
+            case 'W':
+                capture = optarg;
+                break;
+            case 'M':
+                shm = 1;
+                break;
+            case 'U':
+                ctl_path = optarg;
+                break;
+            case 'w':
+                nworkers = atoi((char *) optarg);
+                if(nworkers < 0 || nworkers > SR_MAX_WORKERS)
+                {
+                    fprintf(stderr,"Bad worker count %s (max %d)\n",
+                            optarg, SR_MAX_WORKERS);
+                    exit(1);
+                }
+                break;
+            case 'a':
+                if((ncpus = sr_parse_cpu_list(optarg, cpus, SR_MAX_CPUS)) <= 0)
+                {
+                    fprintf(stderr,"Bad cpu list %s, expected e.g. 0,2-5\n",
+                            optarg);
+                    exit(1);
+                }
+                break;
         } /* switch */
     } /* -- while -- */
 
+    if(lopts.path && strcmp(lopts.path, "-") == 0 &&
+       (lopts.rotate_bytes || lopts.rotate_secs))
+    {
+        fprintf(stderr,"-C and -G need a log file name\n");
+        exit(1);
+    }
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    if(lopts.path)
+    { sr.log_opts = &lopts; }
 
     /* -- set up routing table from file -- */
     if(template == NULL) {
@@ -120,16 +235,61 @@ int main(int argc, char **argv)
     else
     { strncpy(sr.user, user, 32); }
 
-    /* -- set up file pointer for logging of raw packets -- */
-    if(logfile != 0)
+    /* -- pick a transport: replay a capture, bind host devices, or talk
+          to a VNS server -- */
+    opts.server = server;
+    opts.port = port;
+    opts.shm = shm;
+    opts.ifspecs = ifspecs;
+    opts.num_ifspecs = num_ifspecs;
+    opts.replay_file = replay;
+    opts.capture_prefix = capture;
+
+    if(replay)
+    { sr.transport = &sr_offline_transport; }
+    else if(num_ifspecs > 0)
+    { sr.transport = &sr_afpacket_transport; }
+    else
+    { sr.transport = &sr_vns_transport; }
+
+    if(sr.transport != &sr_vns_transport)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        if(template != NULL)
+        {
+            fprintf(stderr,"-T needs a VNS server, it cannot be used with -I/-R\n");
+            return 1;
+        }
+        if(sr.transport->open(&sr, &opts) != 0)
+        {
+            return 1;
+        }
+        if(sr_verify_routing_table(&sr) != 0)
+        {
+            fprintf(stderr,"Routing table not consistent with hardware\n");
+            return 1;
+        }
+        if(sr_start_logger(&sr) != 0)
+        {
+            return 1;
+        }
+
+        sr_init(&sr);
+        if(nworkers > 0 && sr_workers_start(&sr, nworkers, cpus, ncpus) != 0)
+        {
+            fprintf(stderr,"Could not start %d workers\n", nworkers);
+            return 1;
+        }
+        if(ctl_path && sr_ctl_start(&sr, ctl_path) != 0)
         {
-            fprintf(stderr,"Error opening up dump file %s\n",
-                    logfile);
-            exit(1);
+            return 1;
         }
+        printf(" <-- Ready to process packets --> \n");
+
+        while( sr.transport->read(&sr) == 1);
+
+        sr_destroy_instance(&sr);
+
+        return 0;
     }
 
     Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
@@ -139,7 +299,7 @@ int main(int argc, char **argv)
         Debug("Requesting topology %d\n", topo);
 
     /* connect to server and negotiate session */
-    if(sr_connect_to_server(&sr,port,server) == -1)
+    if(sr.transport->open(&sr, &opts) != 0)
     {
         return 1;
     }
@@ -155,9 +315,18 @@ int main(int argc, char **argv)
 
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
+    if(nworkers > 0 && sr_workers_start(&sr, nworkers, cpus, ncpus) != 0)
+    {
+        fprintf(stderr,"Could not start %d workers\n", nworkers);
+        return 1;
+    }
+    if(ctl_path && sr_ctl_start(&sr, ctl_path) != 0)
+    {
+        return 1;
+    }
 
     /* -- whizbang main loop ;-) */
-    while( sr_read_from_server(&sr) == 1);
+    while( sr.transport->read(&sr) == 1);
 
     sr_destroy_instance(&sr);
 
@@ -175,9 +344,33 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-I name@dev,ip[,mac] ...]\n");
+    printf("           [-R replay pcap -W capture prefix] [-M]\n");
+    printf("           [-w workers] [-a cpu list]\n");
+    printf("           [-F capture filter] [-N sample] [-S snaplen]\n");
+    printf("           [-C file MB] [-G file seconds] [-U control socket]\n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
+    printf("   -I (repeatable) binds interface name to host device dev with\n");
+    printf("      address ip instead of connecting to a server; mac defaults\n");
+    printf("      to the device's own address\n");
+    printf("   -R replays a pcap/pcapng file through the router offline, the\n");
+    printf("      interfaces come from -I (name,ip,mac) and frames sent on\n");
+    printf("      each are written to <capture prefix>-<name>.pcap\n");
+    printf("   -M offers the server shared memory rings for frames, TCP is\n");
+    printf("      used when the server is remote or declines\n");
+    printf("   -w forwards on that many worker threads, frames are spread by\n");
+    printf("      flow; -a pins reader, TX thread and workers to the listed\n");
+    printf("      cpus (e.g. 0-3) in that order\n");
+    printf("   -F logs only frames matching the filter (with -l), e.g.\n");
+    printf("      \"icmp and (src net 10.0.1.0/24 or iface eth2) and in\",\n");
+    printf("      -N keeps 1 in N of those, -S the first snaplen bytes (%d)\n",
+           PACKET_DUMP_SIZE);
+    printf("   -l writes pcapng if the name ends in .pcapng, else pcap; -C\n");
+    printf("      and -G start a new file (log-000.pcapng, log-001.pcapng, ..)\n");
+    printf("      after that many MB or seconds\n");
+    printf("   -U serves counters on a unix socket, e.g.\n");
+    printf("      echo stats json | nc -U /tmp/sr.sock\n");
 } /* -- usage -- */
 
 /*-----------------------------------------------------------------------------
@@ -217,9 +410,14 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
+    sr_ctl_stop(sr);
+    sr_workers_stop(sr);
+    sr_logger_stop(sr);
+    SR_PROF_DUMP(stderr);
+
+    if(sr->transport && sr->transport->close)
     {
-        sr_dump_close(sr->logfile);
+        sr->transport->close(sr);
     }
 
     /*
@@ -244,8 +442,15 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
+    sr->num_ifs = 0;
+    memset(sr->local_ips, 0, sizeof(sr->local_ips));
     sr->routing_table = 0;
-    sr->logfile = 0;
+    sr->logger = 0;
+    sr->log_opts = 0;
+    sr->transport = 0;
+    sr->transport_state = 0;
+    sr->workers = 0;
+    sr->ctl = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -292,6 +497,8 @@ int sr_verify_routing_table(struct sr_instance* sr)
         }
         if(if_walker == 0)
         { ret++; } /* -- interface not found! -- */
+        else
+        { rt_walker->ifindex = if_walker->ifindex; }
 
         rt_walker = rt_walker->next;
     } /* -- while -- */
@@ -312,3 +519,40 @@ static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
     sr_print_routing_table(sr);
     printf("---------------------------------------------\n");
 }
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_start_logger(..)
+ * Scope: Global
+ *
+ * Start the packet log writer once the interfaces are known: the filter
+ * may name them and pcapng describes each.  Called by main() for -I/-R
+ * and on VNSHWINFO for a server.  Nothing to do without -l.
+ *
+ *----------------------------------------------------------------------------*/
+
+int sr_start_logger(struct sr_instance* sr)
+{
+    struct sr_logger_opts* lopts = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if((lopts = sr->log_opts) == 0)
+    { return 0; }
+    sr->log_opts = 0;
+
+    if(lopts->filter_expr)
+    {
+        if((lopts->filter = sr_filter_compile(sr, lopts->filter_expr)) == 0)
+        { return -1; }
+        printf("Capture filter \"%s\"\n", lopts->filter_expr);
+        sr_filter_print(lopts->filter, stdout);
+    }
+
+    if(sr_logger_start(sr, lopts) != 0)
+    {
+        fprintf(stderr,"Could not start the packet log writer\n");
+        return -1;
+    }
+    return 0;
+} /* -- sr_start_logger -- */
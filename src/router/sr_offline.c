@@ -0,0 +1,564 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_offline.c
+ *
+ * Description:
+ *
+ * Offline transport.  Frames are read from a pcap or pcapng file and fed to
+ * sr_handlepacket() back to back, frames the router sends are written to one
+ * pcap file per interface.  No network, no server, same frames every run.
+ *
+ * Which interface a frame arrived on:
+ *   pcapng  the Interface Description Block of the frame; its if_name option
+ *           is matched against the router's interface names, IDBs without a
+ *           name map to the router interfaces in order.
+ *   pcap    the interface whose address is the destination MAC, for
+ *           broadcasts the interface owning the ARP target IP, otherwise the
+ *           first interface.
+ *
+ * Output frames are stamped with the time of the input frame being handled so
+ * captures are identical between runs.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "sr_dumper.h"
+#include "sr_transport.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_workers.h"
+#include "sr_pkt.h"
+
+#define SR_OFF_MAX_IFS   32
+#define SR_OFF_MAX_IDB   64
+
+enum sr_off_format
+{
+    sr_off_pcap,
+    sr_off_pcapng
+};
+
+struct sr_off_out
+{
+    FILE* fp;
+};
+
+struct sr_offline
+{
+    uint8_t* map;                   /* private writable mapping of input */
+    size_t   map_len;
+    size_t   off;                   /* next record */
+    enum sr_off_format format;
+    int      swapped;               /* pcap written on other endianness */
+    int      nsec;                  /* pcap with nanosecond stamps */
+
+    /* pcapng interface id -> router interface */
+    struct sr_if* idb[SR_OFF_MAX_IDB];
+    uint64_t idb_units[SR_OFF_MAX_IDB];   /* if_tsresol, stamp ticks per s */
+    int      num_idb;
+
+    struct sr_off_out outs[SR_OFF_MAX_IFS];   /* by ifindex */
+    int      num_outs;
+    pthread_mutex_t out_lock;       /* ARP sweeper sends too */
+    struct timeval now;             /* stamp of current input frame */
+
+    unsigned long frames_in;
+    unsigned long bytes_in;
+    unsigned long frames_out;
+    struct timeval start;
+};
+
+static uint32_t sr_off_u32(struct sr_offline* off, const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return off->swapped ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t sr_off_u16(const uint8_t* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_off_pcap_iface(..)
+ * Scope: Local
+ *
+ * Guess the receiving interface of an untagged frame.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_if* sr_off_pcap_iface(struct sr_instance* sr,
+                                       uint8_t* frame, unsigned int len)
+{
+    struct sr_ethernet_hdr* e_hdr = (struct sr_ethernet_hdr*)frame;
+    struct sr_arp_hdr* a_hdr = 0;
+    struct sr_if* iface = 0;
+
+    if((iface = get_interface_from_eth(sr, e_hdr->ether_dhost)) != 0)
+    { return iface; }
+
+    if(ntohs(e_hdr->ether_type) == ethertype_arp &&
+       len >= sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr))
+    {
+        a_hdr = (struct sr_arp_hdr*)(frame + sizeof(struct sr_ethernet_hdr));
+        if((iface = get_interface_from_ip(sr, a_hdr->ar_tip)) != 0)
+        { return iface; }
+    }
+
+    return sr->if_list;
+} /* -- sr_off_pcap_iface -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_off_add_idb(..)
+ * Scope: Local
+ *
+ * Record the router interface an Interface Description Block stands for.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_off_add_idb(struct sr_instance* sr, struct sr_offline* off,
+                           const uint8_t* body, uint32_t body_len)
+{
+    char name[sr_IFACE_NAMELEN];
+    struct sr_if* iface = 0;
+    uint32_t pos = 8; /* linktype, reserved, snaplen */
+    uint64_t units = 1000000; /* default if_tsresol is microseconds */
+    uint16_t code, len;
+    uint8_t res;
+    int i;
+
+    if(off->num_idb == SR_OFF_MAX_IDB)
+    { return; }
+
+    while(pos + 4 <= body_len)
+    {
+        code = sr_off_u16(body + pos);
+        len  = sr_off_u16(body + pos + 2);
+        if(code == PCAPNG_OPT_END || pos + 4 + len > body_len)
+        { break; }
+        if(code == PCAPNG_IF_NAME && len < sr_IFACE_NAMELEN)
+        {
+            memcpy(name, body + pos + 4, len);
+            name[len] = '\0';
+            iface = sr_get_interface(sr, name);
+        }
+        if(code == PCAPNG_IF_TSRESOL && len >= 1)
+        {
+            /* -- 10^-res seconds, or 2^-res with the top bit set -- */
+            res = body[pos + 4];
+            if(res & 0x80)
+            { units = (res & 0x7f) < 64 ? 1ull << (res & 0x7f) : 0; }
+            else
+            {
+                for(units = 1; res > 0 && units <= 1000000000000000000ull;
+                    res--)
+                { units *= 10; }
+                if(res > 0)
+                { units = 0; }
+            }
+            if(units == 0)
+            { units = 1000000; }
+        }
+        pos += 4 + ((len + 3) & ~3);
+    }
+
+    if(iface == 0)
+    {
+        /* -- unnamed or unknown: n-th IDB is the n-th interface -- */
+        iface = sr->if_list;
+        for(i = 0; iface && i < off->num_idb; i++)
+        { iface = iface->next; }
+        if(iface == 0)
+        { iface = sr->if_list; }
+    }
+
+    off->idb_units[off->num_idb] = units;
+    off->idb[off->num_idb++] = iface;
+} /* -- sr_off_add_idb -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_off_epb_flags(..)
+ * Scope: Local
+ *
+ * The epb_flags word of an Enhanced Packet Block, 0 if it has none.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint32_t sr_off_epb_flags(struct sr_offline* off, const uint8_t* p,
+                                 uint32_t block_len, uint32_t caplen)
+{
+    uint32_t pos = 28 + ((caplen + 3) & ~3);
+    uint16_t code, len;
+
+    while(pos + 4 <= block_len - 4)
+    {
+        code = sr_off_u16(p + pos);
+        len  = sr_off_u16(p + pos + 2);
+        if(code == PCAPNG_OPT_END || pos + 4 + len > block_len - 4)
+        { break; }
+        if(code == PCAPNG_EPB_FLAGS && len == 4)
+        { return sr_off_u32(off, p + pos + 4); }
+        pos += 4 + ((len + 3) & ~3);
+    }
+    return 0;
+} /* -- sr_off_epb_flags -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_off_next(..)
+ * Scope: Local
+ *
+ * Find the next frame in the input.  Returns 1 and fills in frame, length,
+ * interface and time stamp, or 0 at the end of the file.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_off_next(struct sr_instance* sr, struct sr_offline* off,
+                       uint8_t** frame, unsigned int* len,
+                       struct sr_if** iface)
+{
+    uint8_t* p = 0;
+    uint32_t type, block_len, caplen, if_id;
+    uint64_t ts, units;
+
+    if(off->format == sr_off_pcap)
+    {
+        if(off->off + sizeof(struct pcap_sf_pkthdr) > off->map_len)
+        { return 0; }
+        p = off->map + off->off;
+        caplen = sr_off_u32(off, p + 8);
+        if(off->off + sizeof(struct pcap_sf_pkthdr) + caplen > off->map_len)
+        { return 0; }
+
+        off->now.tv_sec  = sr_off_u32(off, p);
+        off->now.tv_usec = sr_off_u32(off, p + 4);
+        if(off->nsec)
+        { off->now.tv_usec /= 1000; }
+
+        *frame = p + sizeof(struct pcap_sf_pkthdr);
+        *len = caplen;
+        *iface = sr_off_pcap_iface(sr, *frame, caplen);
+        off->off += sizeof(struct pcap_sf_pkthdr) + caplen;
+        return 1;
+    }
+
+    while(off->off + 12 <= off->map_len)
+    {
+        p = off->map + off->off;
+        type = sr_off_u32(off, p);
+        block_len = sr_off_u32(off, p + 4);
+        if(block_len < 12 || (block_len & 3) ||
+           off->off + block_len > off->map_len)
+        {
+            fprintf(stderr, "sr_offline: truncated pcapng block at %lu\n",
+                    (unsigned long)off->off);
+            return 0;
+        }
+        off->off += block_len;
+
+        switch(type)
+        {
+            case PCAPNG_SHB:
+                /* -- new section, interface ids start over -- */
+                off->num_idb = 0;
+                break;
+
+            case PCAPNG_IDB:
+                sr_off_add_idb(sr, off, p + 8, block_len - 12);
+                break;
+
+            case PCAPNG_EPB:
+                if(block_len < 32)
+                { break; }
+                if_id  = sr_off_u32(off, p + 8);
+                caplen = sr_off_u32(off, p + 20);
+                if(caplen > block_len - 32 || if_id >= off->num_idb)
+                { break; }
+                /* -- frames the router sent (-l logs both ways) are not
+                 *    input -- */
+                if((sr_off_epb_flags(off, p, block_len, caplen) & 3) ==
+                   PCAPNG_EPB_OUTBOUND)
+                { break; }
+                ts = ((uint64_t)sr_off_u32(off, p + 12) << 32) |
+                     sr_off_u32(off, p + 16);
+                units = off->idb_units[if_id];
+                off->now.tv_sec  = ts / units;
+                off->now.tv_usec = (uint64_t)((double)(ts % units) * 1e6 /
+                                              units);
+                *frame = p + 28;
+                *len = caplen;
+                *iface = off->idb[if_id];
+                return 1;
+
+            case PCAPNG_SPB:
+                if(block_len < 16 || off->num_idb == 0)
+                { break; }
+                caplen = sr_off_u32(off, p + 8);
+                if(caplen > block_len - 16)
+                { caplen = block_len - 16; }
+                *frame = p + 12;
+                *len = caplen;
+                *iface = off->idb[0];
+                return 1;
+
+            default:
+                break;
+        }
+    }
+
+    return 0;
+} /* -- sr_off_next -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_offline_open(..)
+ * Scope: Local
+ *
+ * Create the interfaces from the command line, map the input file and open
+ * one capture file per interface.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_offline_open(struct sr_instance* sr,
+                           struct sr_transport_opts* opts)
+{
+    struct sr_offline* off = 0;
+    struct stat st;
+    char fn[BUFSIZ];
+    uint32_t magic;
+    int fd, i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(opts->replay_file);
+
+    if(opts->num_ifspecs <= 0 || opts->num_ifspecs > SR_OFF_MAX_IFS)
+    {
+        fprintf(stderr, "sr_offline: between 1 and %d interfaces needed (-I)\n",
+                SR_OFF_MAX_IFS);
+        return -1;
+    }
+
+    for(i = 0; i < opts->num_ifspecs; i++)
+    {
+        if(!opts->ifspecs[i].has_addr)
+        {
+            fprintf(stderr, "sr_offline: interface %s needs a MAC address\n",
+                    opts->ifspecs[i].name);
+            return -1;
+        }
+    }
+
+    if((fd = open(opts->replay_file, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+    {
+        perror("sr_offline: open");
+        return -1;
+    }
+    if(st.st_size < 24)
+    {
+        fprintf(stderr, "sr_offline: %s is not a capture file\n",
+                opts->replay_file);
+        close(fd);
+        return -1;
+    }
+
+    off = (struct sr_offline*)calloc(1, sizeof(struct sr_offline));
+    assert(off);
+    pthread_mutex_init(&off->out_lock, 0);
+
+    /* -- private writable mapping: the router rewrites frames in place -- */
+    off->map_len = st.st_size;
+    off->map = mmap(0, off->map_len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(off->map == MAP_FAILED)
+    {
+        perror("sr_offline: mmap");
+        free(off);
+        return -1;
+    }
+    sr->transport_state = off;
+
+    memcpy(&magic, off->map, sizeof(magic));
+    if(magic == TCPDUMP_MAGIC || magic == PCAP_NSEC_MAGIC ||
+       magic == __builtin_bswap32(TCPDUMP_MAGIC) ||
+       magic == __builtin_bswap32(PCAP_NSEC_MAGIC))
+    {
+        off->format  = sr_off_pcap;
+        off->swapped = (magic != TCPDUMP_MAGIC && magic != PCAP_NSEC_MAGIC);
+        off->nsec    = (magic == PCAP_NSEC_MAGIC ||
+                        magic == __builtin_bswap32(PCAP_NSEC_MAGIC));
+        if(sr_off_u32(off, off->map + 20) != LINKTYPE_ETHERNET)
+        {
+            fprintf(stderr, "sr_offline: only ethernet captures supported\n");
+            return -1;
+        }
+        off->off = sizeof(struct pcap_file_header);
+    }
+    else if(magic == PCAPNG_SHB)
+    {
+        memcpy(&magic, off->map + 8, sizeof(magic));
+        if(magic != PCAPNG_BOM)
+        {
+            fprintf(stderr, "sr_offline: pcapng from a host of other "
+                    "endianness not supported\n");
+            return -1;
+        }
+        off->format = sr_off_pcapng;
+        off->off = 0;
+    }
+    else
+    {
+        fprintf(stderr, "sr_offline: %s is not a pcap or pcapng file\n",
+                opts->replay_file);
+        return -1;
+    }
+
+    for(i = 0; i < opts->num_ifspecs; i++)
+    {
+        /* -- the list starts out empty, outs[i] is ifindex i -- */
+        sr_add_interface(sr, opts->ifspecs[i].name);
+        sr_set_ether_addr(sr, opts->ifspecs[i].addr);
+        sr_set_ether_ip(sr, opts->ifspecs[i].ip);
+        assert(sr->ifs[i]->ifindex == i);
+
+        if(opts->capture_prefix)
+        {
+            snprintf(fn, sizeof(fn), "%s-%s.pcap", opts->capture_prefix,
+                     opts->ifspecs[i].name);
+            if((off->outs[i].fp = sr_dump_open(fn, 0, 65535)) == 0)
+            { return -1; }
+        }
+        off->num_outs = i + 1;
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+    printf("Replaying %s\n", opts->replay_file);
+
+    gettimeofday(&off->start, 0);
+
+    return 0;
+} /* -- sr_offline_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_offline_read(..)
+ * Scope: Local
+ *
+ * Hand the next input frame to the router, report throughput at the end.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_offline_read(struct sr_instance* sr)
+{
+    struct sr_offline* off = (struct sr_offline*)sr->transport_state;
+    struct timeval end;
+    struct sr_if* iface = 0;
+    struct sr_pkt pkt;
+    uint8_t* frame = 0;
+    unsigned int len = 0;
+    double secs;
+
+    if(sr_off_next(sr, off, &frame, &len, &iface))
+    {
+        off->frames_in++;
+        off->bytes_in += len;
+        if(len < sizeof(struct sr_ethernet_hdr))
+        { return 1; }
+
+        sr_pkt_parse(&pkt, frame, len, iface);
+        sr_receive_pkt(sr, &pkt);
+        return 1;
+    }
+
+    /* -- count what the workers still have in flight -- */
+    sr_workers_sync(sr);
+
+    gettimeofday(&end, 0);
+    secs = (end.tv_sec - off->start.tv_sec) +
+           (end.tv_usec - off->start.tv_usec) / 1e6;
+    printf("Replayed %lu frames (%lu bytes) in %.3f s, %.0f frames/s, "
+           "%lu frames sent\n", off->frames_in, off->bytes_in, secs,
+           secs > 0 ? off->frames_in / secs : 0.0, off->frames_out);
+
+    return 0;
+} /* -- sr_offline_read -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_offline_send(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_offline_send(struct sr_instance* sr, uint8_t* buf,
+                           unsigned int len, int ifindex)
+{
+    struct sr_offline* off = (struct sr_offline*)sr->transport_state;
+    struct pcap_pkthdr h;
+
+    if(off == 0)
+    { return -1; } /* -- replay finished -- */
+
+    pthread_mutex_lock(&off->out_lock);
+    off->frames_out++;
+    if(ifindex >= 0 && ifindex < off->num_outs && off->outs[ifindex].fp)
+    {
+        h.ts = off->now;
+        h.caplen = len;
+        h.len = len;
+        sr_dump(off->outs[ifindex].fp, &h, buf);
+    }
+    pthread_mutex_unlock(&off->out_lock);
+
+    return 0;
+} /* -- sr_offline_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_offline_close(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_offline_close(struct sr_instance* sr)
+{
+    struct sr_offline* off = (struct sr_offline*)sr->transport_state;
+    int i;
+
+    if(off == 0)
+    { return; }
+
+    pthread_mutex_lock(&off->out_lock);
+    for(i = 0; i < off->num_outs; i++)
+    {
+        if(off->outs[i].fp)
+        { sr_dump_close(off->outs[i].fp); }
+        off->outs[i].fp = 0;
+    }
+    pthread_mutex_unlock(&off->out_lock);
+
+    munmap(off->map, off->map_len);
+    sr->transport_state = 0;
+    /* -- the ARP thread may still hold off->out_lock, leave it be -- */
+} /* -- sr_offline_close -- */
+
+const struct sr_transport sr_offline_transport =
+{
+    "offline",
+    sr_offline_open,
+    sr_offline_read,
+    sr_offline_send,
+    0,
+    sr_offline_close
+};
@@ -0,0 +1,127 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pkt.c
+ *
+ * Description:
+ *
+ * Parsing a received frame into its descriptor, see sr_pkt.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <assert.h>
+#include <arpa/inet.h>
+
+#include "sr_pkt.h"
+#include "sr_protocol.h"
+#include "sr_prof.h"
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_pkt_parse_frame(..)
+ * Scope: Local
+ *
+ * The hash is taken over the IPv4 5-tuple (3-tuple for fragments and
+ * other protocols) so frames of one flow always hash alike, ARP hashes by
+ * the sender's address.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_pkt_parse_frame(struct sr_pkt* pkt, uint8_t* buf,
+                               unsigned int len, struct sr_if* in_if)
+{
+    const struct sr_ethernet_hdr* e_hdr = (const struct sr_ethernet_hdr*)buf;
+    const struct sr_ip_hdr* ip_hdr = 0;
+    const struct sr_arp_hdr* arp_hdr = 0;
+    const uint8_t* l4 = 0;
+    unsigned int hlen;
+    uint32_t h = 0;
+
+    /* REQUIRES */
+    assert(pkt);
+    assert(buf);
+
+    pkt->buf = buf;
+    pkt->len = len;
+    pkt->in_if = in_if;
+    pkt->l3_off = sizeof(struct sr_ethernet_hdr);
+    pkt->l4_off = 0;
+    pkt->flags = 0;
+    pkt->hash = 0;
+
+    if(len < sizeof(struct sr_ethernet_hdr))
+    {
+        pkt->flags = SR_PKT_SHORT;
+        return;
+    }
+
+    if(e_hdr->ether_type == htons(ethertype_ip))
+    {
+        if(len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr))
+        {
+            pkt->flags = SR_PKT_SHORT;
+            return;
+        }
+        ip_hdr = (const struct sr_ip_hdr*)(buf + pkt->l3_off);
+        hlen = ip_hdr->ip_hl * 4;
+        if(ip_hdr->ip_v != 4 || hlen < sizeof(struct sr_ip_hdr))
+        { return; }
+        if(len < sizeof(struct sr_ethernet_hdr) + hlen)
+        {
+            pkt->flags = SR_PKT_SHORT;
+            return;
+        }
+
+        pkt->flags = SR_PKT_IP;
+        pkt->l4_off = pkt->l3_off + hlen;
+        if(hlen > sizeof(struct sr_ip_hdr))
+        { pkt->flags |= SR_PKT_IP_OPTS; }
+        if(ntohs(ip_hdr->ip_off) & (IP_MF | IP_OFFMASK))
+        { pkt->flags |= SR_PKT_FRAG; }
+        if(len >= (unsigned int)pkt->l4_off + 4)
+        { pkt->flags |= SR_PKT_L4; }
+
+        h = ip_hdr->ip_src ^ (ip_hdr->ip_dst * 0x9e3779b1u) ^ ip_hdr->ip_p;
+        if((ip_hdr->ip_p == ip_protocol_tcp || ip_hdr->ip_p == ip_protocol_udp) &&
+           (pkt->flags & (SR_PKT_FRAG | SR_PKT_L4)) == SR_PKT_L4)
+        {
+            l4 = buf + pkt->l4_off;
+            h ^= ((uint32_t)l4[0] << 24 | (uint32_t)l4[1] << 16 |
+                  (uint32_t)l4[2] << 8 | l4[3]) * 0x85ebca6bu;
+        }
+    }
+    else if(e_hdr->ether_type == htons(ethertype_arp))
+    {
+        if(len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr))
+        {
+            pkt->flags = SR_PKT_SHORT;
+            return;
+        }
+        arp_hdr = (const struct sr_arp_hdr*)(buf + pkt->l3_off);
+        pkt->flags = SR_PKT_ARP;
+        h = arp_hdr->ar_sip;
+    }
+    else
+    { return; }
+
+    /* -- murmur3 finalizer -- */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    pkt->hash = h;
+} /* -- sr_pkt_parse_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_pkt_parse(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_pkt_parse(struct sr_pkt* pkt, uint8_t* buf, unsigned int len,
+                  struct sr_if* in_if)
+{
+    SR_PROF_BEGIN(t);
+
+    sr_pkt_parse_frame(pkt, buf, len, in_if);
+    SR_PROF_END(SR_PROF_PARSE, t);
+} /* -- sr_pkt_parse -- */
@@ -0,0 +1,53 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pkt.h
+ *
+ * Description:
+ *
+ * Descriptor for a received frame.  The frame is parsed once where it
+ * enters the router (sr_receive_packet() and friends in sr_transport.c),
+ * the descriptor then travels with it through the workers and into
+ * sr_handle_pkt() so later stages read offsets and flags instead of
+ * recasting headers and looking the interface up by name again.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PKT_H
+#define SR_PKT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+struct sr_if;
+
+#define SR_PKT_ARP      0x0001  /* complete ARP header at l3_off */
+#define SR_PKT_IP       0x0002  /* IPv4 header at l3_off, version and
+                                   header length checked against len */
+#define SR_PKT_IP_OPTS  0x0004  /* IPv4 header longer than 20 bytes */
+#define SR_PKT_FRAG     0x0008  /* IPv4 fragment */
+#define SR_PKT_L4       0x0010  /* 4 or more bytes at l4_off */
+#define SR_PKT_SHORT    0x0020  /* frame ends inside the ethernet, ARP or
+                                   IPv4 header, set alone */
+
+struct sr_pkt
+{
+    uint8_t* buf;               /* ethernet frame, lent */
+    unsigned int len;
+    struct sr_if* in_if;        /* receiving interface */
+    uint16_t l3_off;            /* ARP or IPv4 header */
+    uint16_t l4_off;            /* IPv4 payload, 0 if not IPv4 */
+    uint16_t flags;             /* SR_PKT_* */
+    uint32_t hash;              /* flow hash, see sr_pkt_parse() */
+};
+
+/* Fill in pkt for the frame in buf.  A frame that is neither complete ARP
+   nor sane IPv4 gets neither SR_PKT_ARP nor SR_PKT_IP set and is dropped
+   by every stage, SR_PKT_SHORT tells a truncated one from the rest. */
+void sr_pkt_parse(struct sr_pkt* pkt, uint8_t* buf, unsigned int len,
+                  struct sr_if* in_if);
+
+#endif /* -- SR_PKT_H -- */
@@ -0,0 +1,262 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_prof.c
+ *
+ * Description:
+ *
+ * Per stage latency histograms, see sr_prof.h.  Empty unless built with
+ * -DSR_PROFILE.
+ *
+ * Threads register their histograms on a list the first time they record.
+ * The dump walks that list while the threads keep running, so a dump taken
+ * under load may be off by the few packets in flight.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifdef SR_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "sr_prof.h"
+
+__thread struct sr_prof_thread* sr_prof_self;
+
+static struct sr_prof_thread* sr_prof_threads;
+static pthread_mutex_t sr_prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static double sr_prof_ticks_per_ns = 1.0;
+
+static const char* sr_prof_names[SR_PROF_NSTAGES] =
+{ "parse", "cksum", "classify", "rewrite", "lpm", "arp", "send" };
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_prof_thread(..)
+ * Scope: Global
+ *
+ * Histograms of the calling thread, created on first use.  A name (with
+ * id appended unless it is negative) renames the thread, 0 keeps the
+ * current one.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_prof_thread* sr_prof_thread(const char* name, int id)
+{
+    struct sr_prof_thread* pt = sr_prof_self;
+    static int n = 0;
+
+    if(!pt)
+    {
+        pt = (struct sr_prof_thread*)calloc(1, sizeof(struct sr_prof_thread));
+        assert(pt);
+
+        pthread_mutex_lock(&sr_prof_lock);
+        snprintf(pt->name, sizeof(pt->name), "thread %d", n++);
+        pt->next = sr_prof_threads;
+        sr_prof_threads = pt;
+        pthread_mutex_unlock(&sr_prof_lock);
+
+        sr_prof_self = pt;
+    }
+    if(name && id >= 0)
+    { snprintf(pt->name, sizeof(pt->name), "%s %d", name, id); }
+    else if(name)
+    { snprintf(pt->name, sizeof(pt->name), "%s", name); }
+
+    return pt;
+} /* -- sr_prof_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_prof_signal_main(..)
+ * Scope:  Local
+ *
+ * Dump on every SIGUSR1.  The signal is blocked everywhere else, so
+ * the dump runs in an ordinary thread and may use stdio and locks.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_prof_signal_main(void* arg)
+{
+    sigset_t set;
+    int sig;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    while(sigwait(&set, &sig) == 0)
+    { sr_prof_dump(stderr); }
+
+    return 0;
+} /* -- sr_prof_signal_main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_prof_init(..)
+ * Scope: Global
+ *
+ * Call before any other thread is started: they inherit the blocked
+ * SIGUSR1 from here.  Also measures the cycle counter against the clock
+ * for 20 ms so the dump can print ns.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_prof_init(void)
+{
+    struct timespec t0, t1;
+    struct timespec wait = { 0, 20000000 };
+    uint64_t c0, c1;
+    sigset_t set;
+    pthread_t thread;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, 0);
+
+    if(pthread_create(&thread, 0, sr_prof_signal_main, 0) != 0)
+    { perror("pthread_create(..):sr_prof.c::sr_prof_init(..)"); }
+    else
+    { pthread_detach(thread); }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = sr_prof_now();
+    nanosleep(&wait, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    c1 = sr_prof_now();
+
+    sr_prof_ticks_per_ns = (double)(c1 - c0) /
+        ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec));
+    if(sr_prof_ticks_per_ns <= 0)
+    { sr_prof_ticks_per_ns = 1.0; }
+} /* -- sr_prof_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_prof_value(..)
+ * Scope:  Local
+ *
+ * Upper edge of bucket i in ns.
+ *
+ *---------------------------------------------------------------------*/
+
+static double sr_prof_value(unsigned int i)
+{
+    unsigned int msb;
+    uint64_t top;
+
+    if(i < SR_PROF_SUB)
+    { return i / sr_prof_ticks_per_ns; }
+
+    msb = i / SR_PROF_SUB + 2;
+    top = ((uint64_t)(SR_PROF_SUB + i % SR_PROF_SUB + 1) << (msb - 3)) - 1;
+    return top / sr_prof_ticks_per_ns;
+} /* -- sr_prof_value -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_prof_print(..)
+ * Scope:  Local
+ *
+ * One line per stage with samples: count, mean and percentiles in ns.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_prof_print(FILE* fp, const char* name,
+                          uint64_t hist[][SR_PROF_BUCKETS],
+                          const uint64_t* max)
+{
+    static const double pct[] = { 0.50, 0.90, 0.99, 0.999 };
+    double at[4];
+    double sum;
+    uint64_t count, seen;
+    unsigned int i;
+    int s, p;
+
+    fprintf(fp, "%s\n", name);
+    fprintf(fp, "  %-9s %12s %9s %9s %9s %9s %9s %9s\n", "stage", "count",
+            "mean", "p50", "p90", "p99", "p99.9", "max");
+
+    for(s = 0; s < SR_PROF_NSTAGES; s++)
+    {
+        count = 0;
+        sum = 0;
+        for(i = 0; i < SR_PROF_BUCKETS; i++)
+        {
+            count += hist[s][i];
+            sum += hist[s][i] * sr_prof_value(i);
+        }
+        if(count == 0)
+        { continue; }
+
+        seen = 0;
+        p = 0;
+        for(i = 0; i < SR_PROF_BUCKETS && p < 4; i++)
+        {
+            seen += hist[s][i];
+            while(p < 4 && seen >= pct[p] * count)
+            { at[p++] = sr_prof_value(i); }
+        }
+
+        fprintf(fp, "  %-9s %12llu %9.0f %9.0f %9.0f %9.0f %9.0f %9.0f\n",
+                sr_prof_names[s], (unsigned long long)count, sum / count,
+                at[0], at[1], at[2], at[3], max[s] / sr_prof_ticks_per_ns);
+    }
+} /* -- sr_prof_print -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_prof_dump(..)
+ * Scope: Global
+ *
+ * Every thread's histograms, then all of them merged.  Threads that
+ * recorded nothing are left out.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_prof_dump(FILE* fp)
+{
+    static uint64_t hist[SR_PROF_NSTAGES][SR_PROF_BUCKETS];
+    static uint64_t all[SR_PROF_NSTAGES][SR_PROF_BUCKETS];
+    uint64_t max[SR_PROF_NSTAGES];
+    uint64_t all_max[SR_PROF_NSTAGES];
+    struct sr_prof_thread* pt = 0;
+    uint64_t total;
+    char title[64];
+    unsigned int i;
+    int s, n = 0;
+
+    /* -- the lock also keeps two dumps from sharing the buffers -- */
+    pthread_mutex_lock(&sr_prof_lock);
+
+    memset(all, 0, sizeof(all));
+    memset(all_max, 0, sizeof(all_max));
+    fprintf(fp, "---- stage latency in ns (%.3f cycles/ns) ----\n",
+            sr_prof_ticks_per_ns);
+
+    for(pt = sr_prof_threads; pt; pt = pt->next)
+    {
+        total = 0;
+        for(s = 0; s < SR_PROF_NSTAGES; s++)
+        {
+            for(i = 0; i < SR_PROF_BUCKETS; i++)
+            {
+                hist[s][i] = __atomic_load_n(&pt->hist[s][i], __ATOMIC_RELAXED);
+                all[s][i] += hist[s][i];
+                total += hist[s][i];
+            }
+            max[s] = __atomic_load_n(&pt->max[s], __ATOMIC_RELAXED);
+            if(max[s] > all_max[s])
+            { all_max[s] = max[s]; }
+        }
+        if(total == 0)
+        { continue; }
+        sr_prof_print(fp, pt->name, hist, max);
+        n++;
+    }
+    if(n > 1)
+    {
+        snprintf(title, sizeof(title), "all %d threads", n);
+        sr_prof_print(fp, title, all, all_max);
+    }
+    fflush(fp);
+
+    pthread_mutex_unlock(&sr_prof_lock);
+} /* -- sr_prof_dump -- */
+
+#endif /* SR_PROFILE */
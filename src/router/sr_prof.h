@@ -0,0 +1,129 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_prof.h
+ *
+ * Description:
+ *
+ * Per stage latency histograms for the forwarding path, built only with
+ * "make PROFILE=1" (-DSR_PROFILE).  Otherwise every SR_PROF_* macro
+ * below expands to nothing and no code or data is left behind.
+ *
+ * A stage is timed with the cycle counter (rdtsc on x86, the monotonic
+ * clock elsewhere) and the count is added to a histogram of the calling
+ * thread, so recording takes no lock and shares no cache line.  Buckets
+ * are log scaled with 8 linear steps per power of two (HdrHistogram
+ * style, at most 12.5% error).  SIGUSR1 prints all threads' histograms
+ * to stderr, and so does sr_destroy_instance().
+ *
+ *     SR_PROF_BEGIN(t);                       start timing into t
+ *     SR_PROF_LAP(SR_PROF_LPM, t);            record since t, restart t
+ *     SR_PROF_END(SR_PROF_SEND, t);           record since t
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PROF_H
+#define SR_PROF_H
+
+#ifdef SR_PROFILE
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum sr_prof_stage
+{
+    SR_PROF_PARSE,              /* sr_pkt_parse() */
+    SR_PROF_CKSUM,              /* IPv4 header checksum check */
+    SR_PROF_CLASSIFY,           /* is it for one of our addresses */
+    SR_PROF_REWRITE,            /* TTL and checksum update */
+    SR_PROF_LPM,                /* sr_find_lpm() */
+    SR_PROF_ARP,                /* cache lookup and MAC fill in, or queueing */
+    SR_PROF_SEND,               /* sr_send_packet_if() */
+    SR_PROF_NSTAGES
+};
+
+#define SR_PROF_SUB     8       /* linear steps per power of two */
+#define SR_PROF_BUCKETS (62 * SR_PROF_SUB)
+
+struct sr_prof_thread
+{
+    char name[16];
+    struct sr_prof_thread* next;
+    uint64_t max[SR_PROF_NSTAGES];
+    uint64_t hist[SR_PROF_NSTAGES][SR_PROF_BUCKETS];
+};
+
+extern __thread struct sr_prof_thread* sr_prof_self;
+
+struct sr_prof_thread* sr_prof_thread(const char* name, int id);
+void sr_prof_init(void);
+void sr_prof_dump(FILE* fp);
+
+static inline uint64_t sr_prof_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/* bucket v falls in: v itself below 8, then 8 per power of two */
+static inline unsigned int sr_prof_bucket(uint64_t v)
+{
+    unsigned int msb;
+
+    if(v < SR_PROF_SUB)
+    { return v; }
+    msb = 63 - __builtin_clzll(v);
+    return (msb - 2) * SR_PROF_SUB + ((v >> (msb - 3)) & (SR_PROF_SUB - 1));
+}
+
+static inline void sr_prof_add(int stage, uint64_t v)
+{
+    struct sr_prof_thread* pt = sr_prof_self;
+    uint64_t* h;
+
+    if(!pt)
+    { pt = sr_prof_thread(0, -1); }
+
+    /* -- only this thread writes, the dump reads while we run -- */
+    h = &pt->hist[stage][sr_prof_bucket(v)];
+    __atomic_store_n(h, *h + 1, __ATOMIC_RELAXED);
+    if(v > pt->max[stage])
+    { __atomic_store_n(&pt->max[stage], v, __ATOMIC_RELAXED); }
+}
+
+#define SR_PROF_INIT()          sr_prof_init()
+#define SR_PROF_DUMP(fp)        sr_prof_dump(fp)
+#define SR_PROF_THREAD(name, id) sr_prof_thread(name, id)
+#define SR_PROF_BEGIN(t)        uint64_t t = sr_prof_now()
+#define SR_PROF_LAP(stage, t)   do { uint64_t _n = sr_prof_now(); \
+                                     sr_prof_add(stage, _n - (t)); \
+                                     (t) = _n; } while(0)
+#define SR_PROF_END(stage, t)   sr_prof_add(stage, sr_prof_now() - (t))
+
+#else /* SR_PROFILE */
+
+#define SR_PROF_INIT()          do {} while(0)
+#define SR_PROF_DUMP(fp)        do {} while(0)
+#define SR_PROF_THREAD(name, id) do {} while(0)
+#define SR_PROF_BEGIN(t)        do {} while(0)
+#define SR_PROF_LAP(stage, t)   do {} while(0)
+#define SR_PROF_END(stage, t)   do {} while(0)
+
+#endif /* SR_PROFILE */
+
+#endif /* -- SR_PROF_H -- */
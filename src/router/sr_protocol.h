@@ -188,5 +188,6 @@ struct sr_arp_hdr
 typedef struct sr_arp_hdr sr_arp_hdr_t;
 
 #define sr_IFACE_NAMELEN 32
+#define SR_MAX_IFACES    256
 
 #endif /* -- SR_PROTOCOL_H -- */
@@ -0,0 +1,226 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ratelimit.c
+ *
+ * Description:
+ *
+ * Token buckets for generated ICMP, see sr_ratelimit.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "sr_ratelimit.h"
+
+/* the coarse clock is a plain read of the kernel's tick, a few ms is
+   plenty of resolution for refilling buckets */
+#ifdef CLOCK_MONOTONIC_COARSE
+#define SR_ICMP_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define SR_ICMP_CLOCK CLOCK_MONOTONIC
+#endif
+
+static uint64_t sr_icmp_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(SR_ICMP_CLOCK, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* bring a bucket of rate/burst up to time now */
+static double sr_tbucket_fill(double tokens, uint64_t* last, uint64_t now,
+                              double rate, double burst)
+{
+    if(now > *last)
+    {
+        tokens += (now - *last) * rate / 1e9;
+        *last = now;
+    }
+    return tokens < burst ? tokens : burst;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_limit_init(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_icmp_limit_init(struct sr_icmp_limit* lim)
+{
+    int i;
+
+    /* REQUIRES */
+    assert(lim);
+
+    memset(lim, 0, sizeof(struct sr_icmp_limit));
+    pthread_mutex_init(&lim->lock, 0);
+    for(i = 0; i < SR_ICMP_NKINDS; i++)
+    {
+        sr_icmp_limit_set(lim, i, i == SR_ICMP_ECHO ? 0 : SR_ICMP_RATE,
+                          SR_ICMP_BURST);
+    }
+    sr_icmp_limit_set(lim, SR_ICMP_NKINDS, SR_ICMP_SRC_RATE,
+                      SR_ICMP_SRC_BURST);
+} /* -- sr_icmp_limit_init -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_kind(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_icmp_kind(uint8_t type, uint8_t code)
+{
+    switch(type)
+    {
+        case 0:
+            return SR_ICMP_ECHO;
+        case 3:
+            return code == 3 ? SR_ICMP_PORT_UNREACH : SR_ICMP_UNREACH;
+        case 11:
+            return SR_ICMP_TIME_EXCEEDED;
+    }
+    return SR_ICMP_NKINDS;
+} /* -- sr_icmp_kind -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_allow(..)
+ * Scope: Global
+ *
+ * Both buckets are checked before either is charged, a message the
+ * source bucket stops does not use up a token of its kind.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_icmp_allow(struct sr_icmp_limit* lim, uint8_t type, uint8_t code,
+                  uint32_t dst)
+{
+    int kind = sr_icmp_kind(type, code);
+    struct sr_tbucket* b = 0;
+    struct sr_icmp_src* src = 0;
+    uint64_t now;
+    int ok = 1;
+
+    /* REQUIRES */
+    assert(lim);
+
+    if(kind == SR_ICMP_NKINDS)
+    { return 1; }
+    b = &lim->kinds[kind];
+
+    /* -- nothing to take a lock for while a kind is not limited -- */
+    if(!(__atomic_load_n(&lim->limited, __ATOMIC_RELAXED) & (1u << kind)))
+    {
+        sr_stats_icmp(kind, 1);
+        return 1;
+    }
+
+    now = sr_icmp_now();
+    pthread_mutex_lock(&lim->lock);
+    if(b->rate > 0)
+    {
+        b->tokens = sr_tbucket_fill(b->tokens, &b->last, now, b->rate,
+                                    b->burst);
+        ok = b->tokens >= 1;
+    }
+    if(kind != SR_ICMP_ECHO && lim->src_rate > 0)
+    {
+        src = &lim->srcs[(ntohl(dst) * 2654435761u) >>
+                         (32 - __builtin_ctz(SR_ICMP_SRC_SLOTS))];
+        if(src->ip != dst)
+        {
+            src->ip = dst;
+            src->tokens = lim->src_burst;
+            src->last = now;
+        }
+        src->tokens = sr_tbucket_fill(src->tokens, &src->last, now,
+                                      lim->src_rate, lim->src_burst);
+        ok = ok && src->tokens >= 1;
+    }
+    if(ok)
+    {
+        if(b->rate > 0)
+        { b->tokens -= 1; }
+        if(src)
+        { src->tokens -= 1; }
+    }
+    pthread_mutex_unlock(&lim->lock);
+
+    sr_stats_icmp(kind, ok);
+    return ok;
+} /* -- sr_icmp_allow -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_limit_set(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_icmp_limit_set(struct sr_icmp_limit* lim, int kind, double rate,
+                       double burst)
+{
+    struct sr_tbucket* b = 0;
+    unsigned int limited = 0;
+    int i;
+
+    /* REQUIRES */
+    assert(lim);
+    assert(kind >= 0 && kind <= SR_ICMP_NKINDS);
+
+    if(burst < 1)
+    { burst = 1; }
+
+    pthread_mutex_lock(&lim->lock);
+    if(kind == SR_ICMP_NKINDS)
+    {
+        lim->src_rate = rate;
+        lim->src_burst = burst;
+        for(i = 0; i < SR_ICMP_SRC_SLOTS; i++)
+        { lim->srcs[i].ip = 0; }
+    }
+    else
+    {
+        b = &lim->kinds[kind];
+        b->rate = rate;
+        b->burst = burst;
+        b->tokens = burst;
+        b->last = sr_icmp_now();
+    }
+    for(i = 0; i < SR_ICMP_NKINDS; i++)
+    {
+        if(lim->kinds[i].rate > 0 || (i != SR_ICMP_ECHO && lim->src_rate > 0))
+        { limited |= 1u << i; }
+    }
+    __atomic_store_n(&lim->limited, limited, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lim->lock);
+} /* -- sr_icmp_limit_set -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_limit_get(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_icmp_limit_get(struct sr_icmp_limit* lim, int kind, double* rate,
+                       double* burst)
+{
+    /* REQUIRES */
+    assert(lim);
+    assert(kind >= 0 && kind <= SR_ICMP_NKINDS);
+
+    pthread_mutex_lock(&lim->lock);
+    if(kind == SR_ICMP_NKINDS)
+    {
+        *rate = lim->src_rate;
+        *burst = lim->src_burst;
+    }
+    else
+    {
+        *rate = lim->kinds[kind].rate;
+        *burst = lim->kinds[kind].burst;
+    }
+    pthread_mutex_unlock(&lim->lock);
+} /* -- sr_icmp_limit_get -- */
@@ -0,0 +1,90 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ratelimit.h
+ *
+ * Description:
+ *
+ * Token buckets for the ICMP messages the router generates itself, so a
+ * traceroute storm or a UDP flood at one of its addresses cannot turn
+ * into as many replies.  Every kind of message (sr_stats.h) has its own
+ * bucket, and ICMP errors are limited per destination host as well (the
+ * source of the packet that caused them).  sr_send_icmp() asks before it
+ * builds anything, a reply that is suppressed costs a clock read and a
+ * few arithmetic operations under a short lock.
+ *
+ * A bucket holds up to burst tokens and gains rate tokens per second,
+ * every message takes one.  Rate 0 turns a bucket off.  The per source
+ * buckets live in a fixed table of SR_ICMP_SRC_SLOTS slots indexed by a
+ * hash of the address; a source that lands on a slot another one holds
+ * takes it over with a full bucket, the per kind buckets still bound
+ * the total when sources are spoofed.  Echo replies answer the sender's
+ * own requests one for one, so only their kind bucket applies to them,
+ * and it is off unless set ("set icmp-rate", sr_ctl.h).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RATELIMIT_H
+#define SR_RATELIMIT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <pthread.h>
+
+#include "sr_stats.h"
+
+#define SR_ICMP_RATE       1000 /* errors per second of each kind */
+#define SR_ICMP_BURST      50
+#define SR_ICMP_SRC_RATE   100  /* errors per second to one host */
+#define SR_ICMP_SRC_BURST  10
+#define SR_ICMP_SRC_SLOTS  1024 /* power of two */
+
+struct sr_tbucket
+{
+    double rate;                /* tokens per second, 0 for no limit */
+    double burst;               /* most tokens held */
+    double tokens;
+    uint64_t last;              /* ns, when tokens was brought up to date */
+};
+
+struct sr_icmp_src
+{
+    uint32_t ip;                /* network byte order, 0 if free */
+    double tokens;
+    uint64_t last;
+};
+
+struct sr_icmp_limit
+{
+    pthread_mutex_t lock;       /* guards everything below */
+    unsigned int limited;       /* bit per kind with a bucket on, read
+                                   without the lock */
+    struct sr_tbucket kinds[SR_ICMP_NKINDS];
+    double src_rate, src_burst; /* shared by all per source buckets */
+    struct sr_icmp_src srcs[SR_ICMP_SRC_SLOTS];
+};
+
+void sr_icmp_limit_init(struct sr_icmp_limit* lim);
+
+/* The kind of ICMP message type/code is, SR_ICMP_NKINDS if not one the
+   router sends. */
+int  sr_icmp_kind(uint8_t type, uint8_t code);
+
+/* 1 if a message of type/code to host dst (network byte order) may be
+   sent now, its tokens taken; 0 if it is suppressed.  Counted in
+   sr_stats either way. */
+int  sr_icmp_allow(struct sr_icmp_limit* lim, uint8_t type, uint8_t code,
+                   uint32_t dst);
+
+/* Change or read the limits of a kind, or of every source for
+   kind == SR_ICMP_NKINDS.  A bucket that is changed starts out full. */
+void sr_icmp_limit_set(struct sr_icmp_limit* lim, int kind, double rate,
+                       double burst);
+void sr_icmp_limit_get(struct sr_icmp_limit* lim, int kind, double* rate,
+                       double* burst);
+
+#endif /* -- SR_RATELIMIT_H -- */
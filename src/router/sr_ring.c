@@ -0,0 +1,150 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.c
+ *
+ * Description:
+ *
+ * Single producer / single consumer pointer ring, see sr_ring.h.  Each side
+ * caches the other side's index and only reloads it when the cached value
+ * says the ring is full (producer) or empty (consumer).
+ *
+ * Every side keeps its own counters, so a full or empty ring shows up
+ * without adding shared writes.  The consumer samples the occupancy at
+ * each pop.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_ring.h"
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ring_init(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_ring_init(struct sr_ring* ring, uint32_t size)
+{
+    uint32_t n = 1;
+
+    /* REQUIRES */
+    assert(ring);
+    assert(size > 0);
+
+    while(n < size)
+    { n <<= 1; }
+
+    memset(ring, 0, sizeof(struct sr_ring));
+    if((ring->slots = (void**)calloc(n, sizeof(void*))) == 0)
+    { return -1; }
+    ring->mask = n - 1;
+
+    return 0;
+} /* -- sr_ring_init -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ring_destroy(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_ring_destroy(struct sr_ring* ring)
+{
+    free(ring->slots);
+    ring->slots = 0;
+} /* -- sr_ring_destroy -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ring_push(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_ring_push(struct sr_ring* ring, void* item)
+{
+    uint32_t head = ring->head; /* -- only we write it -- */
+
+    if(head - ring->tail_cache > ring->mask)
+    {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if(head - ring->tail_cache > ring->mask)
+        {
+            ring->full++;
+            return -1;
+        }
+    }
+
+    ring->slots[head & ring->mask] = item;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return 0;
+} /* -- sr_ring_push -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ring_pop(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void* sr_ring_pop(struct sr_ring* ring)
+{
+    uint32_t tail = ring->tail; /* -- only we write it -- */
+    void* item = 0;
+
+    if(tail == ring->head_cache)
+    {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if(tail == ring->head_cache)
+        {
+            ring->empty++;
+            return 0;
+        }
+    }
+
+    ring->pops++;
+    ring->occ_sum += ring->head_cache - tail;
+    if(ring->head_cache - tail > ring->occ_max)
+    { ring->occ_max = ring->head_cache - tail; }
+
+    item = ring->slots[tail & ring->mask];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return item;
+} /* -- sr_ring_pop -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ring_count(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+uint32_t sr_ring_count(struct sr_ring* ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+} /* -- sr_ring_count -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ring_print_stats(..)
+ * Scope: Global
+ *
+ * May run on any thread, the counters are read without synchronisation.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_ring_print_stats(struct sr_ring* ring, const char* name, FILE* fp)
+{
+    unsigned long pops = __atomic_load_n(&ring->pops, __ATOMIC_RELAXED);
+
+    fprintf(fp, "%-12s size %5u  now %5u  avg %7.1f  max %5u  "
+            "full %8lu  empty %8lu\n", name, ring->mask + 1,
+            sr_ring_count(ring),
+            pops ? (double)__atomic_load_n(&ring->occ_sum, __ATOMIC_RELAXED)
+                   / pops : 0.0,
+            __atomic_load_n(&ring->occ_max, __ATOMIC_RELAXED),
+            __atomic_load_n(&ring->full, __ATOMIC_RELAXED),
+            __atomic_load_n(&ring->empty, __ATOMIC_RELAXED));
+} /* -- sr_ring_print_stats -- */
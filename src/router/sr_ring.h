@@ -0,0 +1,62 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.h
+ *
+ * Description:
+ *
+ * Bounded single producer / single consumer ring of pointers, used to hand
+ * frames between threads without taking a lock.  Exactly one thread may
+ * push and exactly one other thread may pop.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RING_H
+#define SR_RING_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_CACHE_LINE 64
+
+struct sr_ring
+{
+    void**   slots;
+    uint32_t mask;              /* size - 1, size is a power of two */
+
+    /* -- written by the producer -- */
+    uint32_t head __attribute__ ((aligned (SR_CACHE_LINE)));
+    uint32_t tail_cache;        /* producer's last look at tail */
+    unsigned long full;         /* pushes that found the ring full */
+
+    /* -- written by the consumer -- */
+    uint32_t tail __attribute__ ((aligned (SR_CACHE_LINE)));
+    uint32_t head_cache;        /* consumer's last look at head */
+    unsigned long empty;        /* pops that found the ring empty */
+    unsigned long pops;
+    unsigned long occ_sum;      /* items waiting, summed over pops */
+    uint32_t occ_max;
+} __attribute__ ((aligned (SR_CACHE_LINE)));
+
+/* size is rounded up to a power of two. Returns 0 on success. */
+int   sr_ring_init(struct sr_ring* ring, uint32_t size);
+void  sr_ring_destroy(struct sr_ring* ring);
+
+/* 0 on success, -1 if the ring is full */
+int   sr_ring_push(struct sr_ring* ring, void* item);
+
+/* oldest item or 0 if the ring is empty */
+void* sr_ring_pop(struct sr_ring* ring);
+
+/* items waiting, exact for the consumer, a lower bound for the producer */
+uint32_t sr_ring_count(struct sr_ring* ring);
+
+/* one line of counters: size, occupancy now/avg/max, full and empty hits */
+void  sr_ring_print_stats(struct sr_ring* ring, const char* name, FILE* fp);
+
+#endif /* -- SR_RING_H -- */
@@ -21,6 +21,12 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_transport.h"
+#include "sr_pkt.h"
+#include "sr_prof.h"
+#include "sr_stats.h"
+
+int sr_log_level = SR_LOG_DEBUG;
 
 /*---------------------------------------------------------------------
  * Method: sr_init(void)
@@ -37,6 +43,18 @@ void sr_init(struct sr_instance* sr)
 
     /* Initialize cache and cache cleanup thread */
     sr_arpcache_init(&(sr->cache));
+    sr_icmp_limit_init(&(sr->icmp_limit));
+
+    /* Route changes from the control socket wait for lookups in flight,
+       and get their turn even while lookups keep coming */
+    pthread_rwlockattr_t rt_attr;
+    pthread_rwlockattr_init(&rt_attr);
+#ifdef _LINUX_
+    pthread_rwlockattr_setkind_np(&rt_attr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&(sr->rt_lock), &rt_attr);
+    pthread_rwlockattr_destroy(&rt_attr);
 
     pthread_attr_init(&(sr->attr));
     pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
@@ -71,11 +89,44 @@ void sr_handlepacket(struct sr_instance* sr,
         unsigned int len,
         char* interface/* lent */)
 {
+  struct sr_pkt pkt;
+  struct sr_if* in_iface;
+
   /* REQUIRES */
   assert(sr);
   assert(packet);
   assert(interface);
 
+  in_iface = sr_get_interface(sr, interface);
+  if (!in_iface) {
+    return;
+  }
+
+  sr_pkt_parse(&pkt, packet, len, in_iface);
+  sr_handle_pkt(sr, &pkt);
+} /* end sr_handlepacket */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handle_pkt(struct sr_pkt* pkt)
+ * Scope:  Global
+ *
+ * sr_handlepacket() for a frame that has already been parsed, the
+ * transports and the workers call this directly.  Same rules for the
+ * buffer: it is lent, copy it to keep it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handle_pkt(struct sr_instance* sr, struct sr_pkt* pkt/* lent */)
+{
+  /* REQUIRES */
+  assert(sr);
+  assert(pkt);
+  assert(pkt->in_if);
+
+  uint8_t* packet = pkt->buf;
+  unsigned int len = pkt->len;
+  struct sr_if* in_iface = pkt->in_if;
+
   //printf("*** -> Received packet of length %d \n",len);
 
   /* fill in code here */
@@ -83,19 +134,12 @@ void sr_handlepacket(struct sr_instance* sr,
   sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*) packet;
 
   //in case we are dealing with arp stuff
-  if (ntohs(eth_hdr->ether_type) == ethertype_arp) {
-    sr_arp_hdr_t* arp_hdr = (sr_arp_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+  if (pkt->flags & SR_PKT_ARP) {
+    sr_arp_hdr_t* arp_hdr = (sr_arp_hdr_t*)(packet + pkt->l3_off);
     
-    //go over my interfaces and see if any is the target
-    struct sr_if* iface = sr->if_list;
-    int found_interface = 0;
-    while (iface) {
-      if (iface->ip == arp_hdr->ar_tip) {
-        found_interface = 1;
-        break;  // We found a match, so stop looping
-      }
-      iface = iface->next;
-    }
+    //see if any of my interfaces is the target
+    struct sr_if* iface = get_interface_from_ip(sr, arp_hdr->ar_tip);
+    int found_interface = iface != NULL;
 
     //if the arp is targetting my router
     if(found_interface){
@@ -121,110 +165,147 @@ void sr_handlepacket(struct sr_instance* sr,
 
         //send packet and free space
         //printf("send packet as handling request \n");
-        sr_send_packet(sr, arp_reply, len, interface);
+        sr_send_packet_if(sr, arp_reply, len, in_iface->ifindex);
         free(arp_reply);
         return;
       }
       //in case of handling reply
       if (ntohs(arp_hdr->ar_op) == arp_op_reply) {
+        struct sr_packet* packet_list = NULL;
         pthread_mutex_lock(&sr->cache.lock);
         //get the request from the queue(also save the result to the cache)
         struct sr_arpreq* req = sr_arpcache_insert(&sr->cache, arp_hdr->ar_sha, arp_hdr->ar_sip);
-        if (req) {//if there is an request, send all its packets and delete it
-          struct sr_packet* packet_list = req->packets;
-          while (packet_list) {
-            sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*) packet_list->buf;
-            memcpy(eth_hdr->ether_dhost, arp_hdr->ar_sha, ETHER_ADDR_LEN);//destination should be the source of ARP(the one who responded to my IP to MAC request)
-            memcpy(eth_hdr->ether_shost, sr_get_interface(sr, packet_list->iface)->addr, ETHER_ADDR_LEN);//we are sending from the router
-            //printf("packet sent for handling reply\n");
-            sr_send_packet(sr, packet_list->buf, packet_list->len, packet_list->iface);
-            packet_list = packet_list->next;
-          }
-          sr_arpreq_destroy(&sr->cache, req);//delete the request after done(I think it handles delelting the packets by itself)
+        if (req) {//take its packets and delete it, sending happens after we let go of the lock
+          packet_list = sr_arpreq_detach(&sr->cache, req);
         }
         pthread_mutex_unlock(&sr->cache.lock);
+
+        //send the whole list as one batch if the transport can
+        int held = sr_tx_hold;
+        sr_tx_hold = 1;
+        struct sr_packet* queued;
+        for (queued = packet_list; queued; queued = queued->next) {
+          sr_ethernet_hdr_t* queued_eth = (sr_ethernet_hdr_t*) queued->buf;
+          memcpy(queued_eth->ether_dhost, arp_hdr->ar_sha, ETHER_ADDR_LEN);//destination should be the source of ARP(the one who responded to my IP to MAC request)
+          memcpy(queued_eth->ether_shost, sr->ifs[queued->ifindex]->addr, ETHER_ADDR_LEN);//we are sending from the router
+          //printf("packet sent for handling reply\n");
+          sr_send_packet_if(sr, queued->buf, queued->len, queued->ifindex);
+        }
+        sr_tx_hold = held;
+        if (!held) {
+          sr_send_flush(sr);
+        }
+        sr_arpreq_free_packets(packet_list);
         return;
       }
     }
     return;//don't resend arp anyway
   }
   
-  //length sanity check, should at least contain an ip and ethernet header
-  if(len < sizeof(sr_ethernet_hdr_t)+ sizeof(sr_ip_hdr_t)){
-    fprintf(stderr, "Packet is too short");
+  //sanity check, lengths and version were checked when the frame was parsed
+  if (!(pkt->flags & SR_PKT_IP)) {
+    sr_stats_drop(pkt->flags & SR_PKT_SHORT ? SR_DROP_SHORT : SR_DROP_BAD_HDR);
     return;
   }
 
+  SR_PROF_BEGIN(t);
+
   //checksum sanity check
-  sr_ip_hdr_t* ip_hdr =(sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+  sr_ip_hdr_t* ip_hdr =(sr_ip_hdr_t*)(packet + pkt->l3_off);
   uint16_t received_checksum = ip_hdr->ip_sum;
   ip_hdr->ip_sum = 0;// Reset for checksum calculation
-  uint16_t calculated_checksum = cksum(ip_hdr, ip_hdr->ip_hl * 4);
+  uint16_t calculated_checksum;
+  if (!(pkt->flags & SR_PKT_IP_OPTS)) {//no options, fixed size header
+    calculated_checksum = cksum_iphdr20(ip_hdr);
+  } else {
+    calculated_checksum = cksum(ip_hdr, ip_hdr->ip_hl * 4);
+  }
   if(received_checksum != calculated_checksum){
     //fprintf(stderr, "wrong checksum");
     //fprintf(stderr, "Received checksum: 0x%04x\n", ntohs(received_checksum));  // Convert from network byte order for readability
     //fprintf(stderr, "Calculated checksum: 0x%04x\n", ntohs(calculated_checksum));  // Convert from network byte order for readability
+    sr_stats_drop(SR_DROP_CKSUM);
     return;
   }
+  ip_hdr->ip_sum = received_checksum;//put it back, replies and errors start from it too
+  SR_PROF_LAP(SR_PROF_CKSUM, t);
 
-  struct sr_if* iface = sr->if_list;
-  int is_for_router = 0;
-
-  while (iface) {
-    if (iface->ip == ip_hdr->ip_dst) {
-      is_for_router = 1;
-      break;//check if this message is for my router
-    }
-    iface = iface->next;
-  }
+  //check if this message is for my router
+  int is_for_router = get_interface_from_ip(sr, ip_hdr->ip_dst) != NULL;
+  SR_PROF_LAP(SR_PROF_CLASSIFY, t);
   //if for me
   if (is_for_router) {
-    if (ip_hdr->ip_p == ip_protocol_icmp) {//dealing with ping echo
-      sr_icmp_hdr_t* icmp_hdr = (sr_icmp_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+    //a fragment would need reassembling before we could echo it whole, ignore it
+    if (ip_hdr->ip_p == ip_protocol_icmp && (pkt->flags & (SR_PKT_L4 | SR_PKT_FRAG)) == SR_PKT_L4) {//dealing with ping echo
+      sr_icmp_hdr_t* icmp_hdr = (sr_icmp_hdr_t*)(packet + pkt->l4_off);
       if (icmp_hdr->icmp_type == 8 && icmp_hdr->icmp_code == 0) {//make sure it's actually an echo request
-        sr_send_icmp(sr, packet, len, interface, 0, 0);
+        sr_send_echo_reply(sr, packet, len, in_iface, pkt->l4_off);
         return;
       }
     }else if (ip_hdr->ip_p == ip_protocol_tcp|| ip_hdr->ip_p == ip_protocol_udp) {
-      sr_send_icmp(sr, packet, len, interface, 3, 3);//deal with TCP and UDP
+      sr_send_icmp(sr, packet, len, in_iface, 3, 3);//deal with TCP and UDP
     } else {
       //just ignore
     }
   }else{//not for me
-    ip_hdr->ip_sum = received_checksum;
+    uint16_t old_ttl_word, new_ttl_word;//ttl and protocol share a checksum word
+    memcpy(&old_ttl_word, &ip_hdr->ip_ttl, 2);
     ip_hdr->ip_ttl--;//decrement ttl
     if(ip_hdr->ip_ttl <= 0){//if timeout
-      sr_send_icmp(sr, packet, len, interface, 11, 0);
+      sr_stats_drop(SR_DROP_TTL);
+      ip_hdr->ip_ttl++;//quote the header as it arrived, its checksum was not patched yet
+      sr_send_icmp(sr, packet, len, in_iface, 11, 0);
       return;
     }
 
     //need to update checksum since ttl is modified
-    ip_hdr->ip_sum = 0;
-    ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr->ip_hl * 4);
+    if (!(pkt->flags & SR_PKT_IP_OPTS)) {//only the ttl word changed, patch the checksum
+      memcpy(&new_ttl_word, &ip_hdr->ip_ttl, 2);
+      ip_hdr->ip_sum = cksum_update16(received_checksum, old_ttl_word, new_ttl_word);
+    } else {
+      ip_hdr->ip_sum = 0;
+      ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr->ip_hl * 4);
+    }
+    SR_PROF_LAP(SR_PROF_REWRITE, t);
 
+    //copy what we need out of the route, it may go away once we unlock
+    pthread_rwlock_rdlock(&sr->rt_lock);
     struct sr_rt* dest = sr_find_lpm(sr, ip_hdr->ip_dst);
-    if(!dest){//if we don't find any good place to send
-      sr_send_icmp(sr, packet, len, interface, 3, 0);//destination unreachable
+    uint32_t next_hop = dest ? dest->gw.s_addr : 0;
+    int out_ifindex = dest ? dest->ifindex : -1;
+    pthread_rwlock_unlock(&sr->rt_lock);
+    SR_PROF_LAP(SR_PROF_LPM, t);
+    if(out_ifindex < 0){//if we don't find any good place to send
+      sr_stats_drop(SR_DROP_NO_ROUTE);
+      sr_send_icmp(sr, packet, len, in_iface, 3, 0);//destination unreachable
       return;
     }
     //see if this destination is saved in cache
-    struct sr_arpentry* arp_entry = sr_arpcache_lookup(&sr->cache, dest->gw.s_addr);
-    struct sr_if* out_iface = sr_get_interface(sr, dest->interface);
-    if (arp_entry) {//if we can find it
-      sr_ethernet_hdr_t* eth_hdr = (sr_ethernet_hdr_t*) packet;
-      memcpy(eth_hdr->ether_dhost, arp_entry->mac, ETHER_ADDR_LEN);//destination mac is given by the cache
+    struct sr_arpentry arp_entry;//copied out, nothing to free
+    struct sr_if* out_iface = sr->ifs[out_ifindex];
+    if (sr_arpcache_lookup(&sr->cache, next_hop, &arp_entry)) {//if we can find it
+      memcpy(eth_hdr->ether_dhost, arp_entry.mac, ETHER_ADDR_LEN);//destination mac is given by the cache
       memcpy(eth_hdr->ether_shost, out_iface->addr, ETHER_ADDR_LEN); //source mac is my outgoing port
+      SR_PROF_END(SR_PROF_ARP, t);
       //printf("packet sent for handling finding something in cache\n");
-      sr_send_packet(sr, packet, len, out_iface->name);
-      free(arp_entry);
+      sr_send_packet_if(sr, packet, len, out_iface->ifindex);
     } else {
-      //not in the cache, so just add to the queue
-      sr_arpcache_queuereq(&sr->cache, dest->gw.s_addr, packet, len, out_iface->name);//request will later be handled when I hear back from it
+      //not in the cache, so add to the queue and ask right away instead of
+      //waiting for the next sweep, handle_arpreq does nothing if we asked
+      //less than a second ago. Hold the lock so the sweeper can't destroy req,
+      //but only while deciding, the ARP request goes out after the unlock
+      struct sr_arpreq_todo todo;
+      pthread_mutex_lock(&sr->cache.lock);
+      struct sr_arpreq* req = sr_arpcache_queuereq(&sr->cache, next_hop, packet, len, out_iface->ifindex);
+      handle_arpreq(sr, req, &todo);
+      pthread_mutex_unlock(&sr->cache.lock);
+      sr_arpreq_todo_run(sr, &todo);
+      SR_PROF_END(SR_PROF_ARP, t);
     }
   }
-} /* end sr_handlepacket */
+} /* end sr_handle_pkt */
 
-//helper function to find longest prefix match
+//helper function to find longest prefix match, hold sr->rt_lock while using the result
 struct sr_rt* sr_find_lpm(struct sr_instance* sr, uint32_t ip_dst){
     struct sr_rt* rt_entry = sr->routing_table;
     struct sr_rt* longest_match = NULL;
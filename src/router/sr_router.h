@@ -12,12 +12,21 @@
 
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_ratelimit.h"
+
+/* runtime log level, "set log-level" on the control socket */
+#define SR_LOG_QUIET 0          /* nothing */
+#define SR_LOG_ERROR 1          /* errors on stderr */
+#define SR_LOG_DEBUG 2          /* and Debug() on stdout, the default */
+extern int sr_log_level;
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
-#define Debug(x, args...) printf(x, ## args)
+#define Debug(x, args...) \
+  do { if(sr_log_level >= SR_LOG_DEBUG) printf(x, ## args); } while (0)
 #define DebugMAC(x) \
-  do { int ivyl; for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
+  do { int ivyl; if(sr_log_level < SR_LOG_DEBUG) break; \
+  for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
   (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } while (0)
 #else
 #define Debug(x, args...) do{}while(0)
@@ -25,11 +34,20 @@
 #endif
 
 #define INIT_TTL 255
+
+/* open addressing table of interface addresses, kept at most half full */
+#define SR_LOCAL_IP_SLOTS (2 * SR_MAX_IFACES)
 #define PACKET_DUMP_SIZE 1024
 
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_transport;
+struct sr_workers;
+struct sr_logger;
+struct sr_logger_opts;
+struct sr_ctl;
+struct sr_pkt;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -47,23 +65,43 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
+    struct sr_if* ifs[SR_MAX_IFACES]; /* the same, by ifindex */
+    int num_ifs;
+    struct sr_if* local_ips[SR_LOCAL_IP_SLOTS]; /* the same, hashed by ip */
     struct sr_rt* routing_table; /* routing table */
+    pthread_rwlock_t rt_lock;   /* held to read routing_table once packets
+                                   flow, the control socket writes it */
     struct sr_arpcache cache;   /* ARP cache */
+    struct sr_icmp_limit icmp_limit; /* buckets for the ICMP it sends */
     pthread_attr_t attr;
-    FILE* logfile;
+    struct sr_logger* logger;   /* packet log writer, 0 if no -l */
+    struct sr_logger_opts* log_opts; /* -l settings until it starts */
+    const struct sr_transport* transport; /* how frames get in and out */
+    void* transport_state;      /* owned by the transport */
+    struct sr_workers* workers; /* forwarding threads, 0 if none (-w) */
+    struct sr_ctl* ctl;         /* control socket, 0 if none (-U) */
 };
 
 /* -- sr_main.c -- */
 int sr_verify_routing_table(struct sr_instance* sr);
+int sr_start_logger(struct sr_instance* sr);
 
-/* -- sr_vns_comm.c -- */
+/* -- sr_transport.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_if(struct sr_instance* , uint8_t* , unsigned int , int );
+void sr_receive_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+void sr_receive_pkt(struct sr_instance* , struct sr_pkt* );
+void sr_send_flush(struct sr_instance* );
+
+/* -- sr_vns_comm.c -- */
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+void sr_log_packet(struct sr_instance* , uint8_t* , int , int , int );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_handle_pkt(struct sr_instance* , struct sr_pkt* );
 struct sr_rt* sr_find_lpm(struct sr_instance* sr, uint32_t ip_dst);
 /* Add additional helper method declarations here! */
 
@@ -81,6 +81,22 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_ifindex(..)
+ * Scope: Local
+ *
+ * Tables loaded before the interfaces are known get their indices from
+ * sr_verify_routing_table().
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_rt_ifindex(struct sr_instance* sr, const char* if_name)
+{
+    struct sr_if* iface = sr_get_interface(sr, if_name);
+
+    return iface ? iface->ifindex : -1;
+} /* -- sr_rt_ifindex -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
@@ -105,6 +121,7 @@ struct in_addr gw, struct in_addr mask,char* if_name)
         sr->routing_table->gw   = gw;
         sr->routing_table->mask = mask;
         strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+        sr->routing_table->ifindex = sr_rt_ifindex(sr, if_name);
 
         return;
     }
@@ -124,6 +141,7 @@ struct in_addr gw, struct in_addr mask,char* if_name)
     rt_walker->gw   = gw;
     rt_walker->mask = mask;
     strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+    rt_walker->ifindex = sr_rt_ifindex(sr, if_name);
 
 } /* -- sr_add_entry -- */
 
@@ -30,6 +30,7 @@ struct sr_rt
     struct in_addr gw;
     struct in_addr mask;
     char   interface[sr_IFACE_NAMELEN];
+    int    ifindex;         /* -1 until the interface exists */
     struct sr_rt* next;
 };
 
@@ -0,0 +1,165 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.c
+ *
+ * Description:
+ *
+ * Shared memory frame rings, see sr_shm.h for the layout.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef _LINUX_
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif /* _LINUX_ */
+
+#include "sr_shm.h"
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_create(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_shm_create(struct sr_shm* shm)
+{
+#ifdef _LINUX_
+    /* REQUIRES */
+    assert(shm);
+
+    memset(shm, 0, sizeof(struct sr_shm));
+    shm->size = SR_SHM_HDR_SIZE + 2 * (size_t)SR_SHM_SLOTS * SR_SHM_SLOT_SIZE;
+
+    /* -- not close-on-exec, the server reopens it through /proc -- */
+    if((shm->fd = syscall(SYS_memfd_create, "sr-vns", 0)) < 0)
+    {
+        perror("memfd_create(..):sr_shm.c::sr_shm_create(..)");
+        return -1;
+    }
+    if(ftruncate(shm->fd, shm->size) < 0)
+    {
+        perror("ftruncate(..):sr_shm.c::sr_shm_create(..)");
+        close(shm->fd);
+        return -1;
+    }
+
+    shm->base = mmap(0, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     shm->fd, 0);
+    if(shm->base == MAP_FAILED)
+    {
+        perror("mmap(..):sr_shm.c::sr_shm_create(..)");
+        close(shm->fd);
+        shm->base = 0;
+        return -1;
+    }
+
+    shm->hdr = (struct sr_shm_hdr*)shm->base;
+    shm->hdr->magic     = SR_SHM_MAGIC;
+    shm->hdr->version   = SR_SHM_VERSION;
+    shm->hdr->nslots    = SR_SHM_SLOTS;
+    shm->hdr->slot_size = SR_SHM_SLOT_SIZE;
+
+    return 0;
+#else
+    fprintf(stderr, "sr_shm: shared memory rings need memfd (Linux)\n");
+    return -1;
+#endif /* _LINUX_ */
+} /* -- sr_shm_create -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_destroy(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_shm_destroy(struct sr_shm* shm)
+{
+#ifdef _LINUX_
+    if(shm->base)
+    { munmap(shm->base, shm->size); }
+    if(shm->fd >= 0)
+    { close(shm->fd); }
+#endif /* _LINUX_ */
+    shm->base = 0;
+    shm->hdr = 0;
+    shm->fd = -1;
+} /* -- sr_shm_destroy -- */
+
+static struct sr_shm_slot* sr_shm_slot(struct sr_shm* shm, int ring,
+                                       uint32_t idx)
+{
+    size_t off = SR_SHM_HDR_SIZE +
+                 ((size_t)ring * SR_SHM_SLOTS + (idx & (SR_SHM_SLOTS - 1))) *
+                 SR_SHM_SLOT_SIZE;
+    return (struct sr_shm_slot*)(shm->base + off);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_push(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_shm_push(struct sr_shm* shm, int ring, const uint8_t* buf,
+                unsigned int len, const char* iface)
+{
+    struct sr_shm_ring* r = &shm->hdr->ring[ring];
+    struct sr_shm_slot* slot = 0;
+    uint32_t prod, cons;
+
+    if(len > SR_SHM_SLOT_SIZE - SR_SHM_SLOT_HDR)
+    { return -1; }
+
+    prod = r->prod; /* -- only we write it -- */
+    cons = __atomic_load_n(&r->cons, __ATOMIC_ACQUIRE);
+    if(prod - cons >= SR_SHM_SLOTS)
+    { return -1; }
+
+    slot = sr_shm_slot(shm, ring, prod);
+    slot->len = len;
+    strncpy(slot->iface, iface, sizeof(slot->iface));
+    memcpy(slot->data, buf, len);
+
+    __atomic_store_n(&r->prod, prod + 1, __ATOMIC_RELEASE);
+
+    /* -- order the store above against the reload of cons (the consumer
+          does the mirror image) so one of us sees the other -- */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&r->cons, __ATOMIC_ACQUIRE) == prod;
+} /* -- sr_shm_push -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_peek(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_shm_slot* sr_shm_peek(struct sr_shm* shm, int ring)
+{
+    struct sr_shm_ring* r = &shm->hdr->ring[ring];
+    uint32_t cons = r->cons; /* -- only we write it -- */
+
+    if(__atomic_load_n(&r->prod, __ATOMIC_ACQUIRE) == cons)
+    { return 0; }
+
+    return sr_shm_slot(shm, ring, cons);
+} /* -- sr_shm_peek -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_pop(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_shm_pop(struct sr_shm* shm, int ring)
+{
+    struct sr_shm_ring* r = &shm->hdr->ring[ring];
+
+    __atomic_store_n(&r->cons, r->cons + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+} /* -- sr_shm_pop -- */
@@ -0,0 +1,101 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.h
+ *
+ * Description:
+ *
+ * A pair of single producer / single consumer frame rings in one memfd,
+ * shared between sr and the VNS server (srhandler.py) on the same host.
+ * The server maps the memfd through /proc/<pid>/fd/<fd>, both ends are
+ * negotiated with VNS_SHM_OPEN / VNS_SHM_STATUS.
+ *
+ * Layout (host byte order, offsets in bytes):
+ *
+ *     0     struct sr_shm_hdr (magic, version, nslots, slot_size)
+ *     64    ring 0 producer index      sr -> server
+ *     128   ring 0 consumer index
+ *     192   ring 1 producer index      server -> sr
+ *     256   ring 1 consumer index
+ *     4096  ring 0 slots, then ring 1 slots
+ *
+ * Each slot holds a 32 bit frame length, a 16 byte interface name and the
+ * frame.  Indices run freely, slot i lives at i % nslots.  A producer that
+ * pushes onto an empty ring sends a VNS_SHM_DOORBELL over the VNS socket.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SHM_H
+#define SR_SHM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stddef.h>
+
+#define SR_SHM_MAGIC      0x53524d31   /* "SRM1" */
+#define SR_SHM_VERSION    1
+#define SR_SHM_SLOTS      1024         /* power of two */
+#define SR_SHM_SLOT_SIZE  2048
+#define SR_SHM_SLOT_HDR   20
+#define SR_SHM_HDR_SIZE   4096
+
+#define SR_SHM_TO_SERVER  0
+#define SR_SHM_TO_ROUTER  1
+
+/* ms sr waits on the socket before looking at its ring again, covers a
+   doorbell lost to a producer/consumer race */
+#define SR_SHM_POLL_MS    10
+
+struct sr_shm_ring
+{
+    uint32_t prod;
+    uint8_t  pad0[60];
+    uint32_t cons;
+    uint8_t  pad1[60];
+} __attribute__ ((packed));
+
+struct sr_shm_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    uint32_t slot_size;
+    uint8_t  pad[48];
+    struct sr_shm_ring ring[2];
+} __attribute__ ((packed));
+
+struct sr_shm_slot
+{
+    uint32_t len;
+    char     iface[16];
+    uint8_t  data[0];
+} __attribute__ ((packed));
+
+struct sr_shm
+{
+    int      fd;
+    uint8_t* base;
+    size_t   size;
+    struct sr_shm_hdr* hdr;
+};
+
+/* Create and map the memfd. Returns 0 on success. */
+int  sr_shm_create(struct sr_shm* shm);
+void sr_shm_destroy(struct sr_shm* shm);
+
+/* Copy a frame onto ring. Returns 1 if the ring was empty (the consumer
+   needs a doorbell), 0 if not, -1 if the ring is full or the frame does not
+   fit in a slot. */
+int  sr_shm_push(struct sr_shm* shm, int ring, const uint8_t* buf,
+                 unsigned int len, const char* iface);
+
+/* Oldest frame on ring or 0 if it is empty. The slot stays valid and
+   writable until sr_shm_pop(). */
+struct sr_shm_slot* sr_shm_peek(struct sr_shm* shm, int ring);
+void sr_shm_pop(struct sr_shm* shm, int ring);
+
+#endif /* -- SR_SHM_H -- */
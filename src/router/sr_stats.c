@@ -0,0 +1,267 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.c
+ *
+ * Description:
+ *
+ * Per thread counters and their summed report, see sr_stats.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "sr_stats.h"
+#include "sr_router.h"
+#include "sr_if.h"
+
+__thread struct sr_stats_thread* sr_stats_self;
+
+static struct sr_stats_thread* sr_stats_threads;
+static pthread_mutex_t sr_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* sr_stats_drop_names[SR_DROP_NREASONS] =
+{
+    "too_short", "bad_header", "bad_checksum", "ttl_expired", "no_route",
+    "arp_failed", "queue_full", "tx_ring_full"
+};
+
+static const char* sr_stats_icmp_names[SR_ICMP_NKINDS] =
+{
+    "echo", "unreach", "port-unreach", "ttl"
+};
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_thread(..)
+ * Scope: Global
+ *
+ * The block is never freed: a reader may still be summing it when its
+ * thread exits, and what it counted must stay in the totals.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_stats_thread* sr_stats_thread(void)
+{
+    struct sr_stats_thread* st = sr_stats_self;
+    void* mem = 0;
+
+    if(st)
+    { return st; }
+
+    if(posix_memalign(&mem, SR_CACHE_LINE, sizeof(struct sr_stats_thread)) != 0)
+    {
+        perror("posix_memalign(..):sr_stats.c::sr_stats_thread(..)");
+        abort();
+    }
+    st = (struct sr_stats_thread*)mem;
+    memset(st, 0, sizeof(struct sr_stats_thread));
+
+    pthread_mutex_lock(&sr_stats_lock);
+    st->next = sr_stats_threads;
+    sr_stats_threads = st;
+    pthread_mutex_unlock(&sr_stats_lock);
+
+    sr_stats_self = st;
+    return st;
+} /* -- sr_stats_thread -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_sum(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_sum(struct sr_if_stats* ifs, uint64_t* drops)
+{
+    struct sr_stats_thread* st = 0;
+    int i;
+
+    /* REQUIRES */
+    assert(ifs);
+    assert(drops);
+
+    memset(ifs, 0, SR_MAX_IFACES * sizeof(struct sr_if_stats));
+    memset(drops, 0, SR_DROP_NREASONS * sizeof(uint64_t));
+
+    pthread_mutex_lock(&sr_stats_lock);
+    for(st = sr_stats_threads; st; st = st->next)
+    {
+        for(i = 0; i < SR_MAX_IFACES; i++)
+        {
+            ifs[i].rx_pkts += __atomic_load_n(&st->ifs[i].rx_pkts, __ATOMIC_RELAXED);
+            ifs[i].rx_bytes += __atomic_load_n(&st->ifs[i].rx_bytes, __ATOMIC_RELAXED);
+            ifs[i].tx_pkts += __atomic_load_n(&st->ifs[i].tx_pkts, __ATOMIC_RELAXED);
+            ifs[i].tx_bytes += __atomic_load_n(&st->ifs[i].tx_bytes, __ATOMIC_RELAXED);
+        }
+        for(i = 0; i < SR_DROP_NREASONS; i++)
+        { drops[i] += __atomic_load_n(&st->drops[i], __ATOMIC_RELAXED); }
+    }
+    pthread_mutex_unlock(&sr_stats_lock);
+} /* -- sr_stats_sum -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_sum_icmp(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_sum_icmp(uint64_t* sent, uint64_t* suppressed)
+{
+    struct sr_stats_thread* st = 0;
+    int i;
+
+    /* REQUIRES */
+    assert(sent);
+    assert(suppressed);
+
+    memset(sent, 0, SR_ICMP_NKINDS * sizeof(uint64_t));
+    memset(suppressed, 0, SR_ICMP_NKINDS * sizeof(uint64_t));
+
+    pthread_mutex_lock(&sr_stats_lock);
+    for(st = sr_stats_threads; st; st = st->next)
+    {
+        for(i = 0; i < SR_ICMP_NKINDS; i++)
+        {
+            sent[i] += __atomic_load_n(&st->icmp_sent[i], __ATOMIC_RELAXED);
+            suppressed[i] += __atomic_load_n(&st->icmp_suppressed[i],
+                                             __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&sr_stats_lock);
+} /* -- sr_stats_sum_icmp -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_drop_name(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+const char* sr_stats_drop_name(int reason)
+{
+    if(reason < 0 || reason >= SR_DROP_NREASONS)
+    { return "unknown"; }
+    return sr_stats_drop_names[reason];
+} /* -- sr_stats_drop_name -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_icmp_name(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+const char* sr_stats_icmp_name(int kind)
+{
+    if(kind < 0 || kind >= SR_ICMP_NKINDS)
+    { return "unknown"; }
+    return sr_stats_icmp_names[kind];
+} /* -- sr_stats_icmp_name -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_print(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_print(struct sr_instance* sr, FILE* fp)
+{
+    static struct sr_if_stats ifs[SR_MAX_IFACES];
+    uint64_t drops[SR_DROP_NREASONS];
+    uint64_t sent[SR_ICMP_NKINDS], suppressed[SR_ICMP_NKINDS];
+    struct sr_if* iface = 0;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(fp);
+
+    /* -- only the control thread reports, ifs need not be on its stack -- */
+    sr_stats_sum(ifs, drops);
+    sr_stats_sum_icmp(sent, suppressed);
+
+    fprintf(fp, "%-10s %14s %16s %14s %16s\n", "interface", "rx_packets",
+            "rx_bytes", "tx_packets", "tx_bytes");
+    for(i = 0; i < sr->num_ifs; i++)
+    {
+        if((iface = sr->ifs[i]) == 0)
+        { continue; }
+        fprintf(fp, "%-10s %14llu %16llu %14llu %16llu\n", iface->name,
+                (unsigned long long)ifs[i].rx_pkts,
+                (unsigned long long)ifs[i].rx_bytes,
+                (unsigned long long)ifs[i].tx_pkts,
+                (unsigned long long)ifs[i].tx_bytes);
+    }
+
+    fprintf(fp, "%-14s %14s\n", "drop", "packets");
+    for(i = 0; i < SR_DROP_NREASONS; i++)
+    {
+        fprintf(fp, "%-14s %14llu\n", sr_stats_drop_names[i],
+                (unsigned long long)drops[i]);
+    }
+
+    fprintf(fp, "%-14s %14s %14s\n", "icmp", "sent", "suppressed");
+    for(i = 0; i < SR_ICMP_NKINDS; i++)
+    {
+        fprintf(fp, "%-14s %14llu %14llu\n", sr_stats_icmp_names[i],
+                (unsigned long long)sent[i],
+                (unsigned long long)suppressed[i]);
+    }
+} /* -- sr_stats_print -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_print_json(..)
+ * Scope: Global
+ *
+ * {"interfaces":{"eth1":{"rx_packets":..,"rx_bytes":..,"tx_packets":..,
+ *  "tx_bytes":..},..},"drops":{"too_short":..,..},
+ *  "icmp":{"echo":{"sent":..,"suppressed":..},..}}
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_print_json(struct sr_instance* sr, FILE* fp)
+{
+    static struct sr_if_stats ifs[SR_MAX_IFACES];
+    uint64_t drops[SR_DROP_NREASONS];
+    uint64_t sent[SR_ICMP_NKINDS], suppressed[SR_ICMP_NKINDS];
+    struct sr_if* iface = 0;
+    const char* sep = "";
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(fp);
+
+    sr_stats_sum(ifs, drops);
+    sr_stats_sum_icmp(sent, suppressed);
+
+    fprintf(fp, "{\"interfaces\":{");
+    for(i = 0; i < sr->num_ifs; i++)
+    {
+        if((iface = sr->ifs[i]) == 0)
+        { continue; }
+        fprintf(fp, "%s\"%s\":{\"rx_packets\":%llu,\"rx_bytes\":%llu,"
+                "\"tx_packets\":%llu,\"tx_bytes\":%llu}", sep, iface->name,
+                (unsigned long long)ifs[i].rx_pkts,
+                (unsigned long long)ifs[i].rx_bytes,
+                (unsigned long long)ifs[i].tx_pkts,
+                (unsigned long long)ifs[i].tx_bytes);
+        sep = ",";
+    }
+
+    fprintf(fp, "},\"drops\":{");
+    for(i = 0; i < SR_DROP_NREASONS; i++)
+    {
+        fprintf(fp, "%s\"%s\":%llu", i ? "," : "", sr_stats_drop_names[i],
+                (unsigned long long)drops[i]);
+    }
+    fprintf(fp, "},\"icmp\":{");
+    for(i = 0; i < SR_ICMP_NKINDS; i++)
+    {
+        fprintf(fp, "%s\"%s\":{\"sent\":%llu,\"suppressed\":%llu}",
+                i ? "," : "", sr_stats_icmp_names[i],
+                (unsigned long long)sent[i],
+                (unsigned long long)suppressed[i]);
+    }
+    fprintf(fp, "}}\n");
+} /* -- sr_stats_print_json -- */
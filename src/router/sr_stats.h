@@ -0,0 +1,147 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.h
+ *
+ * Description:
+ *
+ * Packet and byte counters per interface and direction, counts of frames
+ * the router dropped, by reason, and of the ICMP messages it generated or
+ * suppressed (sr_ratelimit.h), by kind.  Every thread that counts gets its
+ * own block of counters, aligned to a cache line and written by that
+ * thread only, so counting is a plain add with no lock and no cache line
+ * bouncing between the reader, the workers and the TX thread.  A reader
+ * (the control socket, sr_ctl.h) sums the blocks of all threads; a sum
+ * taken while frames move may be off by the frames in flight.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_STATS_H
+#define SR_STATS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#include "sr_protocol.h"
+#include "sr_ring.h"
+
+struct sr_instance;
+
+enum sr_drop
+{
+    SR_DROP_SHORT,              /* frame ends inside a header */
+    SR_DROP_BAD_HDR,            /* unknown ethertype, not IPv4, bad IHL */
+    SR_DROP_CKSUM,              /* IPv4 header checksum */
+    SR_DROP_TTL,                /* TTL expired */
+    SR_DROP_NO_ROUTE,           /* no route to the destination */
+    SR_DROP_ARP,                /* next hop never answered ARP */
+    SR_DROP_QUEUE,              /* ARP pending queue full */
+    SR_DROP_TX_FULL,            /* no TX ring slot came free in time */
+    SR_DROP_NREASONS
+};
+
+enum sr_icmp_kind
+{
+    SR_ICMP_ECHO,               /* echo reply */
+    SR_ICMP_UNREACH,            /* net or host unreachable */
+    SR_ICMP_PORT_UNREACH,       /* port unreachable */
+    SR_ICMP_TIME_EXCEEDED,      /* TTL expired in transit */
+    SR_ICMP_NKINDS
+};
+
+struct sr_if_stats
+{
+    uint64_t rx_pkts;
+    uint64_t rx_bytes;
+    uint64_t tx_pkts;
+    uint64_t tx_bytes;
+};
+
+struct sr_stats_thread
+{
+    struct sr_if_stats ifs[SR_MAX_IFACES];  /* by ifindex */
+    uint64_t drops[SR_DROP_NREASONS];
+    uint64_t icmp_sent[SR_ICMP_NKINDS];
+    uint64_t icmp_suppressed[SR_ICMP_NKINDS];
+    struct sr_stats_thread* next;
+} __attribute__ ((aligned (SR_CACHE_LINE)));
+
+extern __thread struct sr_stats_thread* sr_stats_self;
+
+/* counters of the calling thread, created on first use */
+struct sr_stats_thread* sr_stats_thread(void);
+
+/* all threads summed, ifs[] and drops[] as in sr_stats_thread */
+void sr_stats_sum(struct sr_if_stats* ifs, uint64_t* drops);
+
+/* all threads summed, ICMP messages sent and suppressed by kind */
+void sr_stats_sum_icmp(uint64_t* sent, uint64_t* suppressed);
+
+/* name of a drop reason, e.g. "bad_checksum" */
+const char* sr_stats_drop_name(int reason);
+
+/* name of an ICMP kind, e.g. "ttl" */
+const char* sr_stats_icmp_name(int kind);
+
+/* summed counters as a table, or as one JSON object */
+void sr_stats_print(struct sr_instance* sr, FILE* fp);
+void sr_stats_print_json(struct sr_instance* sr, FILE* fp);
+
+/* -- only the owning thread writes, readers may load at any time -- */
+#define SR_STATS_ADD(field, n) \
+    __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+
+static inline struct sr_stats_thread* sr_stats_get(void)
+{
+    struct sr_stats_thread* st = sr_stats_self;
+
+    if(!st)
+    { st = sr_stats_thread(); }
+    return st;
+}
+
+static inline void sr_stats_rx(int ifindex, unsigned int len)
+{
+    struct sr_if_stats* s;
+
+    if(ifindex < 0 || ifindex >= SR_MAX_IFACES)
+    { return; }
+    s = &sr_stats_get()->ifs[ifindex];
+    SR_STATS_ADD(s->rx_pkts, 1);
+    SR_STATS_ADD(s->rx_bytes, len);
+}
+
+static inline void sr_stats_tx(int ifindex, unsigned int len)
+{
+    struct sr_if_stats* s;
+
+    if(ifindex < 0 || ifindex >= SR_MAX_IFACES)
+    { return; }
+    s = &sr_stats_get()->ifs[ifindex];
+    SR_STATS_ADD(s->tx_pkts, 1);
+    SR_STATS_ADD(s->tx_bytes, len);
+}
+
+static inline void sr_stats_drop(enum sr_drop reason)
+{
+    struct sr_stats_thread* st = sr_stats_get();
+
+    SR_STATS_ADD(st->drops[reason], 1);
+}
+
+static inline void sr_stats_icmp(enum sr_icmp_kind kind, int sent)
+{
+    struct sr_stats_thread* st = sr_stats_get();
+
+    if(sent)
+    { SR_STATS_ADD(st->icmp_sent[kind], 1); }
+    else
+    { SR_STATS_ADD(st->icmp_suppressed[kind], 1); }
+}
+
+#endif /* -- SR_STATS_H -- */
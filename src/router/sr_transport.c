@@ -0,0 +1,214 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_transport.c
+ *
+ * Description:
+ *
+ * Transport independent half of sending a frame: sanity checks and logging
+ * happen here before the frame is handed to the active transport.  Received
+ * frames enter the router through sr_receive_packet(), or sr_receive_pkt()
+ * for a transport that has already parsed them.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_transport.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_workers.h"
+#include "sr_pkt.h"
+#include "sr_filter.h"
+#include "sr_prof.h"
+#include "sr_stats.h"
+
+__thread int sr_tx_hold = 0;
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ether_addrs_match_interface(..)
+ * Scope: Local
+ *
+ * Make sure ethernet addresses are sane so we don't muck uo the system.
+ *
+ *----------------------------------------------------------------------------*/
+
+static int
+sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
+                                uint8_t* buf, /* borrowed */
+                                int ifindex )
+{
+    struct sr_ethernet_hdr* ether_hdr = 0;
+    struct sr_if* iface = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(buf);
+
+    ether_hdr = (struct sr_ethernet_hdr*)buf;
+
+    if ( ifindex < 0 || ifindex >= sr->num_ifs ){
+        if(sr_log_level >= SR_LOG_ERROR)
+        { fprintf( stderr, "** Error, interface %d, does not exist\n", ifindex); }
+        return 0;
+    }
+    iface = sr->ifs[ifindex];
+
+    if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
+        if(sr_log_level >= SR_LOG_ERROR)
+        { fprintf( stderr, "** Error, source address does not match interface\n"); }
+        return 0;
+    }
+
+    /* TODO */
+    /* Check destination, hardware address.  If it is private (i.e. destined
+     * to a virtual interface) ensure it is going to the correct topology
+     * Note: This check should really be done server side ...
+     */
+
+    return 1;
+
+} /* -- sr_ether_addrs_match_interface -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet(..)
+ * Scope: Global
+ *
+ * Send a packet (ethernet header included!) of length 'len' out of the
+ * interface named 'iface'.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         const char* iface /* borrowed */)
+{
+    struct sr_if* if_rec = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(iface);
+
+    if ( (if_rec = sr_get_interface(sr, iface)) == 0 ){
+        if(sr_log_level >= SR_LOG_ERROR)
+        { fprintf( stderr, "** Error, interface %s, does not exist\n", iface); }
+        return -1;
+    }
+
+    return sr_send_packet_if(sr, buf, len, if_rec->ifindex);
+} /* -- sr_send_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_if(..)
+ * Scope: Global
+ *
+ * Send a packet (ethernet header included!) of length 'len' out of
+ * interface 'ifindex' using whichever transport the router was started
+ * with.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_if(struct sr_instance* sr /* borrowed */,
+                      uint8_t* buf /* borrowed */ ,
+                      unsigned int len,
+                      int ifindex)
+{
+    int ret;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(sr->transport);
+
+    /* don't waste my time ... */
+    if ( len < sizeof(struct sr_ethernet_hdr) ){
+        if(sr_log_level >= SR_LOG_ERROR)
+        { fprintf(stderr , "** Error: packet is wayy to short \n"); }
+        return -1;
+    }
+
+    /* -- log packet -- */
+    sr_log_packet(sr, buf, len, ifindex, SR_DIR_OUT);
+
+    if ( ! sr_ether_addrs_match_interface( sr, buf, ifindex) ){
+        if(sr_log_level >= SR_LOG_ERROR)
+        { fprintf( stderr, "*** Error: problem with ethernet header, check log\n"); }
+        return -1;
+    }
+    sr_stats_tx(ifindex, len);
+
+    SR_PROF_BEGIN(t);
+    if(sr->workers)
+    { ret = sr_workers_send(sr, buf, len, ifindex); }
+    else
+    { ret = sr->transport->send(sr, buf, len, ifindex); }
+    SR_PROF_END(SR_PROF_SEND, t);
+
+    return ret;
+} /* -- sr_send_packet_if -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_flush(..)
+ * Scope: Global
+ *
+ * Push out frames this thread sent while it had sr_tx_hold set.  With
+ * workers running the TX thread owns the transport and flushes itself.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_send_flush(struct sr_instance* sr /* borrowed */)
+{
+    if(sr->workers == 0 && sr->transport->flush)
+    { sr->transport->flush(sr); }
+} /* -- sr_send_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_receive_pkt(..)
+ * Scope: Global
+ *
+ * Called by the transports for every parsed frame.  The frame is logged,
+ * then handled right away, or copied to a worker when running with -w.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_receive_pkt(struct sr_instance* sr /* borrowed */,
+                    struct sr_pkt* pkt /* lent */)
+{
+    sr_log_packet(sr, pkt->buf, pkt->len,
+                  pkt->in_if ? pkt->in_if->ifindex : -1, SR_DIR_IN);
+    if(pkt->in_if)
+    { sr_stats_rx(pkt->in_if->ifindex, pkt->len); }
+
+    if(sr->workers)
+    {
+        sr_workers_dispatch(sr, pkt);
+        return;
+    }
+
+    sr_handle_pkt(sr, pkt);
+} /* -- sr_receive_pkt -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_receive_packet(..)
+ * Scope: Global
+ *
+ * sr_receive_pkt() for a frame that arrived on the interface named 'iface'.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_receive_packet(struct sr_instance* sr /* borrowed */,
+                       uint8_t* buf /* lent */,
+                       unsigned int len,
+                       const char* iface /* lent */)
+{
+    struct sr_pkt pkt;
+    struct sr_if* in_if = sr_get_interface(sr, iface);
+
+    if(in_if == 0)
+    { return; }
+
+    sr_pkt_parse(&pkt, buf, len, in_if);
+    sr_receive_pkt(sr, &pkt);
+} /* -- sr_receive_packet -- */
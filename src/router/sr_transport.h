@@ -0,0 +1,81 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_transport.h
+ *
+ * Description:
+ *
+ * The router exchanges frames with the outside world through a transport.
+ * Every transport fills in the interface list when it is opened, runs one
+ * step of the main loop per call to read() and puts frames on the wire with
+ * send().  sr_send_packet_if() in sr_transport.c is the common entry point
+ * the router code uses for sending.  Interfaces are passed around by
+ * ifindex, only the VNS transport deals in names.
+ *
+ *   vns       the VNS/POX server over TCP (sr_vns_comm.c)
+ *   afpacket  host devices through PACKET_MMAP rings (sr_afpacket.c)
+ *   offline   replay a pcap/pcapng file, capture to pcap (sr_offline.c)
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TRANSPORT_H
+#define SR_TRANSPORT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_MAX_IFSPECS 32
+
+struct sr_instance;
+struct sr_if_spec;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_transport_opts
+ *
+ * Command line settings, each transport only looks at the ones it needs.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_transport_opts
+{
+    char* server;                   /* vns */
+    unsigned short port;            /* vns */
+    int shm;                        /* vns: offer shared memory rings */
+    struct sr_if_spec* ifspecs;     /* afpacket, offline */
+    int num_ifspecs;                /* afpacket, offline */
+    char* replay_file;              /* offline: input pcap/pcapng */
+    char* capture_prefix;           /* offline: output <prefix>-<iface>.pcap */
+};
+
+struct sr_transport
+{
+    const char* name;
+
+    /* connect and learn the interfaces, 0 on success */
+    int  (*open)(struct sr_instance*, struct sr_transport_opts*);
+
+    /* one step of the main loop: 1 keep going, 0 finished, -1 error */
+    int  (*read)(struct sr_instance*);
+
+    /* put one complete ethernet frame on the wire of interface ifindex
+       (sr->ifs), 0 on success.  While sr_tx_hold is set on the calling
+       thread the frame may be held back until flush() */
+    int  (*send)(struct sr_instance*, uint8_t*, unsigned int, int);
+
+    /* push out frames held back by send(), may be NULL */
+    void (*flush)(struct sr_instance*);
+
+    void (*close)(struct sr_instance*);
+};
+
+/* set by a thread that sends several frames in a row and flushes after */
+extern __thread int sr_tx_hold;
+
+extern const struct sr_transport sr_vns_transport;
+extern const struct sr_transport sr_afpacket_transport;
+extern const struct sr_transport sr_offline_transport;
+
+#endif /* -- SR_TRANSPORT_H -- */
@@ -3,20 +3,33 @@
 #include <string.h>
 #include "sr_protocol.h"
 #include "sr_utils.h"
+#include "sr_cksum.h"
 
 
+/* Summed in host order by sr_cksum_add(), the complemented fold is already
+   in network order. A result of 0 is still returned as 0xffff. */
 uint16_t cksum (const void *_data, int len) {
-  const uint8_t *data = _data;
+  return sr_cksum_final(sr_cksum_add(_data, len, 0));
+}
+
+/* cksum() of a 20 byte IPv4 header without options, unrolled. */
+uint16_t cksum_iphdr20 (const void *_data) {
+  const uint16_t *w = _data;
   uint32_t sum;
 
-  for (sum = 0;len >= 2; data += 2, len -= 2)
-    sum += data[0] << 8 | data[1];
-  if (len > 0)
-    sum += data[0] << 8;
-  while (sum > 0xffff)
-    sum = (sum >> 16) + (sum & 0xffff);
-  sum = htons (~sum);
-  return sum ? sum : 0xffff;
+  sum = (uint32_t)w[0] + w[1] + w[2] + w[3] + w[4] +
+        w[5] + w[6] + w[7] + w[8] + w[9];
+  return sr_cksum_final(sum);
+}
+
+/* New checksum after one 16 bit word of the covered data changed from
+   old_w to new_w, all in network order (RFC 1624 eqn. 3). Matches what
+   cksum() would give over the new data, 0 is returned as 0xffff. */
+uint16_t cksum_update16 (uint16_t sum, uint16_t old_w, uint16_t new_w) {
+  uint32_t s;
+
+  s = (uint32_t)(uint16_t)~sum + (uint16_t)~old_w + new_w;
+  return sr_cksum_final(s);
 }
 
 
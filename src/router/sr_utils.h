@@ -29,6 +29,8 @@
 #define SR_UTILS_H
 
 uint16_t cksum(const void *_data, int len);
+uint16_t cksum_iphdr20(const void *_data);
+uint16_t cksum_update16(uint16_t sum, uint16_t old_w, uint16_t new_w);
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
@@ -35,21 +35,48 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include "sr_dumper.h"
+#include "sr_logger.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_transport.h"
+#include "sr_shm.h"
+#include "sr_pkt.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
-                                  uint8_t * packet /* lent */,
-                                  unsigned int len,
-                                  char* interface  /* lent */);
+                                  struct sr_pkt* pkt /* lent */);
+static void sr_vns_receive(struct sr_instance* , uint8_t* , unsigned int ,
+                           const char* );
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
+static void sr_handle_shm_status(struct sr_instance* , c_shm_status* , int );
+static void sr_vns_shm_drain(struct sr_instance* );
+static void sr_handle_packet_batch(struct sr_instance* , uint8_t* , int );
+
+/* ----------------------------------------------------------------------------
+ * struct sr_vns
+ *
+ * Transport state of a VNS session, hangs off sr->transport_state.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_vns
+{
+    struct sr_shm shm;          /* rings shared with the server */
+    int shm_offered;            /* VNS_SHM_OPEN sent */
+    int shm_active;             /* server mapped the rings */
+    pthread_mutex_t shm_lock;   /* main and ARP threads both push on ring 0 */
+    uint32_t caps;              /* VNS_CAP_* agreed with the server */
+    uint8_t* batch;             /* VNSPACKET_BATCH being filled */
+    unsigned int batch_len;
+    uint32_t batch_count;
+};
 
 /*-----------------------------------------------------------------------------
  * Method: sr_session_closed_help(..)
@@ -142,6 +169,7 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         command.mLen   = htonl(sizeof(c_open));
         command.mType  = htonl(VNSOPEN);
         command.topoID = htons(sr->topo_id);
+        command.caps   = htons(VNS_CAP_BATCH);
         strncpy( command.mVirtualHostID, sr->host,  IDSIZE);
         strncpy( command.mUID, sr->user, IDSIZE);
 
@@ -318,6 +346,212 @@ int sr_handle_auth_status(struct sr_instance* sr, c_auth_status* status) {
     return status->auth_ok;
 }
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_shm_status(..)
+ * Scope: Local
+ *
+ * The server's answer to our VNS_SHM_OPEN.  From here on frames travel
+ * through the rings, TCP stays around for control messages and doorbells.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_handle_shm_status(struct sr_instance* sr, c_shm_status* status,
+                                 int len)
+{
+    struct sr_vns* vns = (struct sr_vns*)sr->transport_state;
+    int msg_len = len - (int)sizeof(c_shm_status);
+
+    if(vns == 0 || !vns->shm_offered)
+    { return; }
+
+    if(status->ok)
+    {
+        printf("Exchanging frames with server through shared memory\n");
+        vns->shm_active = 1;
+        return;
+    }
+
+    fprintf(stderr, "Server declined shared memory, staying on TCP: %.*s\n",
+            msg_len > 0 ? msg_len : 0, status->msg);
+    vns->shm_offered = 0;
+    sr_shm_destroy(&vns->shm);
+} /* -- sr_handle_shm_status -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_shm_drain(..)
+ * Scope: Local
+ *
+ * Run every frame the server left on our ring through the router.  Frames
+ * are handled in place, the slot is only released afterwards.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_shm_drain(struct sr_instance* sr)
+{
+    struct sr_vns* vns = (struct sr_vns*)sr->transport_state;
+    struct sr_shm_slot* slot = 0;
+    char iface[sr_IFACE_NAMELEN];
+    unsigned int len;
+
+    if(vns == 0 || !vns->shm_active)
+    { return; }
+
+    while((slot = sr_shm_peek(&vns->shm, SR_SHM_TO_ROUTER)) != 0)
+    {
+        len = slot->len;
+        memcpy(iface, slot->iface, sizeof(slot->iface));
+        iface[sizeof(slot->iface)] = '\0';
+
+        if(len >= sizeof(struct sr_ethernet_hdr) &&
+           len <= SR_SHM_SLOT_SIZE - SR_SHM_SLOT_HDR)
+        { sr_vns_receive(sr, slot->data, len, iface); }
+
+        sr_shm_pop(&vns->shm, SR_SHM_TO_ROUTER);
+    }
+} /* -- sr_vns_shm_drain -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_batch_flush(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_batch_flush(struct sr_instance* sr)
+{
+    struct sr_vns* vns = (struct sr_vns*)sr->transport_state;
+    c_packet_batch* hdr = (c_packet_batch*)vns->batch;
+
+    if(vns->batch_count == 0)
+    { return 0; }
+
+    hdr->mLen  = htonl(vns->batch_len);
+    hdr->mType = htonl(VNSPACKET_BATCH);
+    hdr->count = htonl(vns->batch_count);
+
+    vns->batch_count = 0;
+    if(write(sr->sockfd, vns->batch, vns->batch_len) < vns->batch_len)
+    {
+        fprintf(stderr, "Error writing packet batch\n");
+        return -1;
+    }
+    return 0;
+} /* -- sr_vns_batch_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_flush(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_flush(struct sr_instance* sr)
+{
+    if(sr->transport_state)
+    { sr_vns_batch_flush(sr); }
+} /* -- sr_vns_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_batch_add(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_batch_add(struct sr_instance* sr, uint8_t* buf,
+                            unsigned int len, const char* iface)
+{
+    struct sr_vns* vns = (struct sr_vns*)sr->transport_state;
+    c_batch_entry* e = 0;
+    unsigned int need = sizeof(c_batch_entry) + len;
+
+    if(vns->batch == 0)
+    {
+        vns->batch = (uint8_t*)malloc(VNS_BATCH_MAX);
+        assert(vns->batch);
+    }
+    if(vns->batch_count == 0)
+    { vns->batch_len = sizeof(c_packet_batch); }
+
+    if(vns->batch_len + need > VNS_BATCH_MAX && sr_vns_batch_flush(sr) < 0)
+    { return -1; }
+    if(vns->batch_count == 0)
+    { vns->batch_len = sizeof(c_packet_batch); }
+
+    e = (c_batch_entry*)(vns->batch + vns->batch_len);
+    e->len = htons(len);
+    strncpy(e->mInterfaceName, iface, sizeof(e->mInterfaceName));
+    memcpy(e->frame, buf, len);
+
+    vns->batch_len += need;
+    vns->batch_count++;
+    return 0;
+} /* -- sr_vns_batch_add -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_packet_batch(..)
+ * Scope: Local
+ *
+ * Same as VNSPACKET for every frame of the batch.  Replies are collected
+ * and go back as one batch once the last frame is done.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_handle_packet_batch(struct sr_instance* sr, uint8_t* buf,
+                                   int len)
+{
+    c_packet_batch* hdr = (c_packet_batch*)buf;
+    c_batch_entry* e = 0;
+    uint32_t count = ntohl(hdr->count);
+    unsigned int off = sizeof(c_packet_batch);
+    unsigned int flen;
+    char iface[sr_IFACE_NAMELEN];
+    uint32_t i;
+
+    /* -- sends made meanwhile are collected into one batch -- */
+    sr_tx_hold = 1;
+    for(i = 0; i < count && off + sizeof(c_batch_entry) <= len; i++)
+    {
+        e = (c_batch_entry*)(buf + off);
+        flen = ntohs(e->len);
+        if(off + sizeof(c_batch_entry) + flen > len)
+        {
+            fprintf(stderr, "Error: truncated packet batch\n");
+            break;
+        }
+        off += sizeof(c_batch_entry) + flen;
+
+        if(flen < sizeof(struct sr_ethernet_hdr))
+        { continue; }
+        memcpy(iface, e->mInterfaceName, sizeof(e->mInterfaceName));
+        iface[sizeof(e->mInterfaceName)] = '\0';
+
+        sr_vns_receive(sr, e->frame, flen, iface);
+    }
+    sr_tx_hold = 0;
+
+    sr_send_flush(sr);
+} /* -- sr_handle_packet_batch -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_doorbell(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_doorbell(struct sr_instance* sr, uint32_t ring)
+{
+    c_shm_doorbell db;
+
+    db.mLen  = htonl(sizeof(c_shm_doorbell));
+    db.mType = htonl(VNS_SHM_DOORBELL);
+    db.ring  = htonl(ring);
+
+    if(send(sr->sockfd, &db, sizeof(db), 0) != sizeof(db))
+    {
+        perror("send(..):sr_vns_comm.c::sr_vns_doorbell()");
+        return -1;
+    }
+    return 0;
+} /* -- sr_vns_doorbell -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_read_from_server(..)
  * Scope: global
@@ -335,7 +569,6 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 {
     int command, len;
     unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
     int ret = 0, bytes_read = 0;
 
     /* REQUIRES */
@@ -369,7 +602,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     len = ntohl(len);
 
-    if ( len > 10000 || len < 0 )
+    if ( len > VNS_BATCH_MAX || len < 0 )
     {
         fprintf(stderr,"Error: command length to large %d\n",len);
         close(sr->sockfd);
@@ -424,22 +657,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         /* -------------        VNSPACKET     -------------------- */
 
         case VNSPACKET:
-            sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
-            { break; }
-
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
-
             /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
+            sr_vns_receive(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
@@ -447,6 +666,12 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
             break;
 
+            /* -------------    VNSPACKET_BATCH   -------------------- */
+
+        case VNSPACKET_BATCH:
+            sr_handle_packet_batch(sr, buf, len);
+            break;
+
             /* -------------        VNSCLOSE      -------------------- */
 
         case VNSCLOSE:
@@ -474,6 +699,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 fprintf(stderr,"Routing table not consistent with hardware\n");
                 return -1;
             }
+            if(sr_start_logger(sr) != 0)
+            { return -1; }
             printf(" <-- Ready to process packets --> \n");
             break;
 
@@ -495,6 +722,25 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 ret = -1;
             break;
 
+            /* ------------- VNS_CAPS --------------------- */
+        case VNS_CAPS:
+            if(sr->transport_state)
+            {
+                ((struct sr_vns*)sr->transport_state)->caps =
+                    ntohl(((c_caps*)buf)->caps);
+            }
+            break;
+
+            /* ------------- VNS_SHM_STATUS --------------- */
+        case VNS_SHM_STATUS:
+            sr_handle_shm_status(sr, (c_shm_status*)buf, len);
+            break;
+
+            /* ------------- VNS_SHM_DOORBELL ------------- */
+        case VNS_SHM_DOORBELL:
+            sr_vns_shm_drain(sr);
+            break;
+
         default:
             Debug("unknown command: %d\n", command);
             break;
@@ -507,77 +753,43 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 }/* -- sr_read_from_server -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_ether_addrs_match_interface(..)
+ * Method: sr_vns_send(..)
  * Scope: Local
  *
- * Make sure ethernet addresses are sane so we don't muck uo the system.
- *
- *----------------------------------------------------------------------------*/
-
-static int
-sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
-                                uint8_t* buf, /* borrowed */
-                                const char* name /* borrowed */ )
-{
-    struct sr_ethernet_hdr* ether_hdr = 0;
-    struct sr_if* iface = 0;
-
-    /* -- REQUIRES -- */
-    assert(sr);
-    assert(buf);
-    assert(name);
-
-    ether_hdr = (struct sr_ethernet_hdr*)buf;
-    iface = sr_get_interface(sr, name);
-
-    if ( iface == 0 ){
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
-        return 0;
-    }
-
-    if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
-        fprintf( stderr, "** Error, source address does not match interface\n");
-        return 0;
-    }
-
-    /* TODO */
-    /* Check destination, hardware address.  If it is private (i.e. destined
-     * to a virtual interface) ensure it is going to the correct topology
-     * Note: This check should really be done server side ...
-     */
-
-    return 1;
-
-} /* -- sr_ether_addrs_match_interface -- */
-
-/*-----------------------------------------------------------------------------
- * Method: sr_send_packet(..)
- * Scope: Global
- *
  * Send a packet (ethernet header included!) of length 'len' to the server
- * to be injected onto the wire.
+ * to be injected onto the wire.  Checks and logging are done by
+ * sr_send_packet(..).
  *
  *---------------------------------------------------------------------------*/
 
-int sr_send_packet(struct sr_instance* sr /* borrowed */,
-                         uint8_t* buf /* borrowed */ ,
-                         unsigned int len,
-                         const char* iface /* borrowed */)
+static int sr_vns_send(struct sr_instance* sr /* borrowed */,
+                       uint8_t* buf /* borrowed */ ,
+                       unsigned int len,
+                       int ifindex)
 {
+    struct sr_vns* vns = (struct sr_vns*)sr->transport_state;
     c_packet_header *sr_pkt;
     unsigned int total_len =  len + (sizeof(c_packet_header));
+    const char* iface = sr->ifs[ifindex]->name; /* -- the server knows names -- */
+    int ret;
 
-    /* REQUIRES */
-    assert(sr);
-    assert(buf);
-    assert(iface);
-
-    /* don't waste my time ... */
-    if ( len < sizeof(struct sr_ethernet_hdr) ){
-        fprintf(stderr , "** Error: packet is wayy to short \n");
-        return -1;
+    if(vns && vns->shm_active)
+    {
+        pthread_mutex_lock(&vns->shm_lock);
+        ret = sr_shm_push(&vns->shm, SR_SHM_TO_SERVER, buf, len, iface);
+        pthread_mutex_unlock(&vns->shm_lock);
+
+        if(ret == 1)
+        { return sr_vns_doorbell(sr, SR_SHM_TO_SERVER); }
+        if(ret == 0)
+        { return 0; }
+        /* -- ring full or jumbo frame, TCP still works -- */
     }
 
+    if(sr_tx_hold && vns && (vns->caps & VNS_CAP_BATCH) &&
+       len + sizeof(c_batch_entry) + sizeof(c_packet_batch) <= VNS_BATCH_MAX)
+    { return sr_vns_batch_add(sr, buf, len, iface); }
+
     /* Create packet */
     sr_pkt = (c_packet_header *)malloc(len +
             sizeof(c_packet_header));
@@ -588,15 +800,6 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
             buf,len);
 
-    /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
-
-    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
-        return -1;
-    }
-
     if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
         fprintf(stderr, "Error writing packet\n");
         free(sr_pkt);
@@ -606,33 +809,140 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     free(sr_pkt);
 
     return 0;
-} /* -- sr_send_packet -- */
+} /* -- sr_vns_send -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_log_packet()
+ * Method: sr_vns_open(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_open(struct sr_instance* sr, struct sr_transport_opts* opts)
+{
+    struct sr_vns* vns = 0;
+    c_shm_open so;
+
+    vns = (struct sr_vns*)calloc(1, sizeof(struct sr_vns));
+    assert(vns);
+    vns->shm.fd = -1;
+    pthread_mutex_init(&vns->shm_lock, 0);
+    sr->transport_state = vns;
+
+    if(sr_connect_to_server(sr, opts->port, opts->server) == -1)
+    { return -1; }
+
+    /* -- offer shared memory, servers that don't know VNS_SHM_OPEN simply
+          never answer and we stay on TCP -- */
+    if(opts->shm && sr_shm_create(&vns->shm) == 0)
+    {
+        so.mLen  = htonl(sizeof(c_shm_open));
+        so.mType = htonl(VNS_SHM_OPEN);
+        so.pid   = htonl(getpid());
+        so.fd    = htonl(vns->shm.fd);
+        so.size  = htonl(vns->shm.size);
+        if(send(sr->sockfd, &so, sizeof(so), 0) != sizeof(so))
+        {
+            perror("send(..):sr_vns_comm.c::sr_vns_open()");
+            return -1;
+        }
+        vns->shm_offered = 1;
+    }
+
+    return 0;
+} /* -- sr_vns_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_read(..)
  * Scope: Local
  *
+ * One step of the main loop.  With shared memory the socket only carries
+ * doorbells, wait on it for a bounded time and look at the ring either way.
+ *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+static int sr_vns_read(struct sr_instance* sr)
+{
+    struct sr_vns* vns = (struct sr_vns*)sr->transport_state;
+    struct pollfd pfd;
+    int ret;
+
+    if(vns == 0 || !vns->shm_active)
+    { return sr_read_from_server(sr); }
+
+    sr_vns_shm_drain(sr);
+
+    pfd.fd = sr->sockfd;
+    pfd.events = POLLIN;
+    if((ret = poll(&pfd, 1, SR_SHM_POLL_MS)) < 0)
+    {
+        if(errno == EINTR)
+        { return 1; }
+        perror("poll(..):sr_vns_comm.c::sr_vns_read()");
+        return -1;
+    }
+    if(ret == 0)
+    { return 1; }
+
+    return sr_read_from_server(sr);
+} /* -- sr_vns_read -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_close(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_close(struct sr_instance* sr)
+{
+    struct sr_vns* vns = (struct sr_vns*)sr->transport_state;
+
+    if(vns && vns->shm_offered)
+    {
+        vns->shm_active = 0;
+        vns->shm_offered = 0;
+        sr_shm_destroy(&vns->shm);
+    }
+    if(vns && vns->batch)
+    {
+        free(vns->batch);
+        vns->batch = 0;
+    }
+
+    if(sr->sockfd >= 0)
+    {
+        close(sr->sockfd);
+        sr->sockfd = -1;
+    }
+} /* -- sr_vns_close -- */
+
+const struct sr_transport sr_vns_transport =
 {
-    struct pcap_pkthdr h;
-    int size;
+    "vns",
+    sr_vns_open,
+    sr_vns_read,
+    sr_vns_send,
+    sr_vns_flush,
+    sr_vns_close
+};
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_log_packet()
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   int ifindex, int dir)
+{
+    struct sr_logger* lg = 0;
 
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
+    if(!(lg = __atomic_load_n(&sr->logger, __ATOMIC_ACQUIRE)))
     {return; }
 
-    size = min(PACKET_DUMP_SIZE, len);
-
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
-
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    sr_logger_put(lg, buf, len, ifindex, dir);
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
@@ -642,26 +952,45 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
  *---------------------------------------------------------------------------*/
 
 int  sr_arp_req_not_for_us(struct sr_instance* sr,
-                           uint8_t * packet /* lent */,
-                           unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_pkt* pkt /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
-    struct sr_ethernet_hdr* e_hdr = 0;
-    struct sr_arp_hdr*       a_hdr = 0;
+    struct sr_arp_hdr* a_hdr = 0;
 
-    if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr) )
+    if ( !(pkt->flags & SR_PKT_ARP) )
     { return 0; }
 
-    assert(iface);
-
-    e_hdr = (struct sr_ethernet_hdr*)packet;
-    a_hdr = (struct sr_arp_hdr*)(packet + sizeof(struct sr_ethernet_hdr));
+    a_hdr = (struct sr_arp_hdr*)(pkt->buf + pkt->l3_off);
 
-    if ( (e_hdr->ether_type == htons(ethertype_arp)) &&
-            (a_hdr->ar_op      == htons(arp_op_request))   &&
-            (a_hdr->ar_tip     != iface->ip ) )
+    if ( (a_hdr->ar_op      == htons(arp_op_request))   &&
+            (a_hdr->ar_tip     != pkt->in_if->ip ) )
     { return 1; }
 
     return 0;
 } /* -- sr_arp_req_not_for_us -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_receive()
+ * Scope: Local
+ *
+ * A frame from the server, however it arrived.  The server hands every
+ * router on a link its ARP requests, those for somebody else are dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_receive(struct sr_instance* sr,
+                           uint8_t* buf /* lent */,
+                           unsigned int len,
+                           const char* interface /* lent */)
+{
+    struct sr_if* iface = sr_get_interface(sr, interface);
+    struct sr_pkt pkt;
+
+    if ( iface == 0 )
+    { return; }
+
+    sr_pkt_parse(&pkt, buf, len, iface);
+    if ( sr_arp_req_not_for_us(sr, &pkt) )
+    { return; }
+
+    sr_receive_pkt(sr, &pkt);
+} /* -- sr_vns_receive -- */
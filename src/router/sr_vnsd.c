@@ -0,0 +1,1239 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vnsd.c
+ *
+ * Description:
+ *
+ * Stand-in VNS server for load tests ("make sr_vnsd").  Speaks the server
+ * side of vnscommand.h to one unmodified sr over TCP: authentication,
+ * VNSHWINFO for the interfaces below, then VNSPACKET (or VNSPACKET_BATCH
+ * if the router offers it) both ways.  Behind every router interface
+ * sit simulated neighbors that answer the router's ARP requests.  One
+ * of them sends UDP at a fixed rate to a destination behind another
+ * interface, every payload carries a sequence number and the time it
+ * was sent, so frames the router forwards give the forwarded rate and
+ * the one way latency through the router.  When the run is over the
+ * router gets a VNSCLOSE and exits.
+ *
+ *     sr_vnsd [-p port] [-k auth_key] [-i iface,ip[,mac]]...
+ *             [-n iface,ip[,mac]]... [-S src] [-D dst] [-r rate]
+ *             [-T seconds] [-b bytes] [-f flows] [-t ttl] [-w ms]
+ *
+ * Without -i and -n the topology of ../IP_CONFIG and ../rtable is used:
+ *
+ *     eth1 192.168.2.1   neighbor 192.168.2.2  (server1)
+ *     eth2 172.64.3.1    neighbor 172.64.3.10  (server2)
+ *     eth3 10.0.1.1      neighbor 10.0.1.100   (client)
+ *
+ * and the client sends to server1.  -S defaults to the first neighbor,
+ * -D to the first neighbor behind another interface.
+ *
+ *     ./sr_vnsd -r 50000 -T 5 &
+ *     ./sr -r rtable
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sha1.h"
+#include "vnscommand.h"
+
+#define SR_VNSD_PORT     8888
+#define SR_VNSD_MAXIFS   (MAXHWENTRIES / 6)  /* six HWINFO entries each */
+#define SR_VNSD_MAXNBRS  256
+#define SR_VNSD_MAXFLOWS 4096
+#define SR_VNSD_MAXLEN   1514
+#define SR_VNSD_OUTMAX   (4 * 1024 * 1024)   /* bytes queued for the router
+                                                before the generator waits */
+#define SR_VNSD_BURST    4096    /* frames queued in one go at most */
+#define SR_VNSD_DRAIN    500     /* ms to wait for the last frames */
+#define SR_VNSD_TIMEOUT  10000   /* ms the router gets for each handshake
+                                    step */
+#define SR_VNSD_MAGIC    0x564e5344  /* "VNSD", starts every payload */
+#define SR_VNSD_AUTH_KEY_LEN 64
+#define SR_VNSD_SALT_LEN 20
+#define SR_VNSD_SHA1_LEN 20
+
+/* ----------------------------------------------------------------------------
+ * struct sr_vnsd_stamp
+ *
+ * Start of every generated UDP payload, host byte order since only this
+ * process reads it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_vnsd_stamp
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint64_t sent_ns;               /* CLOCK_MONOTONIC */
+} __attribute__ ((packed));
+
+struct sr_vnsd_if
+{
+    char name[sr_IFACE_NAMELEN];
+    uint32_t ip;                    /* network byte order */
+    uint8_t mac[ETHER_ADDR_LEN];
+};
+
+struct sr_vnsd_nbr
+{
+    int ifi;                        /* behind ifs[ifi] */
+    uint32_t ip;
+    uint8_t mac[ETHER_ADDR_LEN];
+    unsigned long arp_requests;     /* router asked for this neighbor */
+};
+
+struct sr_vnsd
+{
+    int fd;
+    uint32_t caps;                  /* VNS_CAP_* agreed with the router */
+
+    struct sr_vnsd_if ifs[SR_VNSD_MAXIFS];
+    int nifs;
+    struct sr_vnsd_nbr nbrs[SR_VNSD_MAXNBRS];
+    int nnbrs;
+
+    /* -- workload -- */
+    int src;                        /* sending neighbor */
+    uint32_t dst;
+    double rate;                    /* frames per second */
+    double seconds;
+    unsigned int bytes;
+    int flows;
+    int ttl;
+    uint8_t* frames;                /* one template per flow */
+
+    /* -- from the router, messages may be split anywhere -- */
+    uint8_t* in;
+    size_t in_len, in_used;
+
+    /* -- to the router -- */
+    uint8_t* out;
+    size_t out_len, out_off, out_cap;
+    size_t batch;                   /* offset of the open batch, or -1 */
+
+    /* -- results -- */
+    uint64_t start_ns;
+    uint64_t first_arp_ns;          /* router asked for the destination */
+    uint64_t first_fwd_ns;          /* first frame through */
+    unsigned long offered, sent, held, fwd, stray, arp_answered, arp_other,
+                  other;
+    unsigned long icmp[256];        /* by ICMP type */
+    uint32_t* lat;                  /* ns, by order of arrival */
+    unsigned long nlat, lat_size;
+    int closed;                     /* router went away */
+};
+
+static uint64_t sr_vnsd_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_parse_spec(..)
+ * Scope: Local
+ *
+ * "name,ip[,mac]", a missing MAC is made up from the address.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vnsd_parse_spec(const char* spec, char* name, uint32_t* ip,
+                              uint8_t* mac)
+{
+    char buf[128];
+    char* ip_str = 0;
+    char* mac_str = 0;
+    unsigned int b[ETHER_ADDR_LEN];
+    int i;
+
+    if(strlen(spec) >= sizeof(buf))
+    { return -1; }
+    strcpy(buf, spec);
+
+    if((ip_str = strchr(buf, ',')) == 0)
+    { return -1; }
+    *ip_str++ = 0;
+    if((mac_str = strchr(ip_str, ',')) != 0)
+    { *mac_str++ = 0; }
+
+    if(buf[0] == 0 || strlen(buf) >= sr_IFACE_NAMELEN ||
+       inet_pton(AF_INET, ip_str, ip) != 1)
+    { return -1; }
+    strcpy(name, buf);
+
+    if(mac_str == 0)
+    {
+        mac[0] = 0x02;
+        mac[1] = 0x00;
+        memcpy(mac + 2, ip, 4);
+        return 0;
+    }
+    if(sscanf(mac_str, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3],
+              &b[4], &b[5]) != ETHER_ADDR_LEN)
+    { return -1; }
+    for(i = 0; i < ETHER_ADDR_LEN; i++)
+    { mac[i] = b[i]; }
+    return 0;
+} /* -- sr_vnsd_parse_spec -- */
+
+static int sr_vnsd_find_if(struct sr_vnsd* d, const char* name)
+{
+    int i;
+
+    for(i = 0; i < d->nifs; i++)
+    {
+        if(strncmp(d->ifs[i].name, name, sizeof(d->ifs[i].name)) == 0)
+        { return i; }
+    }
+    return -1;
+}
+
+static int sr_vnsd_find_nbr(struct sr_vnsd* d, int ifi, uint32_t ip)
+{
+    int i;
+
+    for(i = 0; i < d->nnbrs; i++)
+    {
+        if(d->nbrs[i].ip == ip && (ifi < 0 || d->nbrs[i].ifi == ifi))
+        { return i; }
+    }
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_flush(..)
+ * Scope: Local
+ *
+ * Write as much of the output buffer as the socket takes without
+ * blocking.  Returns -1 once the router is gone.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vnsd_flush(struct sr_vnsd* d)
+{
+    ssize_t n;
+
+    while(d->out_off < d->out_len)
+    {
+        n = send(d->fd, d->out + d->out_off, d->out_len - d->out_off,
+                 MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            { break; }
+            perror("send(..):sr_vnsd.c::sr_vnsd_flush(..)");
+            d->closed = 1;
+            return -1;
+        }
+        d->out_off += n;
+    }
+
+    if(d->out_off == d->out_len)
+    { d->out_off = d->out_len = 0; }
+    return 0;
+} /* -- sr_vnsd_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_reserve(..)
+ * Scope: Local
+ *
+ * Room for len more bytes at the end of the output buffer.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint8_t* sr_vnsd_reserve(struct sr_vnsd* d, size_t len)
+{
+    if(d->out_off > 0 && d->out_len + len > d->out_cap)
+    {
+        memmove(d->out, d->out + d->out_off, d->out_len - d->out_off);
+        if(d->batch != (size_t)-1)
+        { d->batch -= d->out_off; }
+        d->out_len -= d->out_off;
+        d->out_off = 0;
+    }
+    if(d->out_len + len > d->out_cap)
+    {
+        while(d->out_len + len > d->out_cap)
+        { d->out_cap = d->out_cap ? 2 * d->out_cap : 65536; }
+        d->out = (uint8_t*)realloc(d->out, d->out_cap);
+        assert(d->out);
+    }
+    d->out_len += len;
+    return d->out + d->out_len - len;
+} /* -- sr_vnsd_reserve -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_close_batch(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_close_batch(struct sr_vnsd* d)
+{
+    c_packet_batch* hdr = 0;
+
+    if(d->batch == (size_t)-1)
+    { return; }
+    hdr = (c_packet_batch*)(d->out + d->batch);
+    hdr->mLen = htonl(d->out_len - d->batch);
+    hdr->count = htonl(hdr->count);
+    d->batch = (size_t)-1;
+} /* -- sr_vnsd_close_batch -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_queue(..)
+ * Scope: Local
+ *
+ * Queue a frame for the router as arriving on ifs[ifi].  Frames queued
+ * back to back share one VNSPACKET_BATCH if the router takes those, the
+ * batch is closed by sr_vnsd_close_batch().  Returns the frame in the
+ * output buffer, valid until the next call.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint8_t* sr_vnsd_queue(struct sr_vnsd* d, int ifi, const uint8_t* frame,
+                              unsigned int len)
+{
+    c_packet_header* ph = 0;
+    c_packet_batch* bh = 0;
+    c_batch_entry* e = 0;
+    size_t need = sizeof(c_batch_entry) + len;
+
+    if(!(d->caps & VNS_CAP_BATCH))
+    {
+        ph = (c_packet_header*)sr_vnsd_reserve(d, sizeof(c_packet_header) + len);
+        ph->mLen = htonl(sizeof(c_packet_header) + len);
+        ph->mType = htonl(VNSPACKET);
+        strncpy(ph->mInterfaceName, d->ifs[ifi].name,
+                sizeof(ph->mInterfaceName));
+        memcpy(ph + 1, frame, len);
+        return (uint8_t*)(ph + 1);
+    }
+
+    if(d->batch != (size_t)-1 && d->out_len - d->batch + need > VNS_BATCH_MAX)
+    { sr_vnsd_close_batch(d); }
+    if(d->batch == (size_t)-1)
+    {
+        bh = (c_packet_batch*)sr_vnsd_reserve(d, sizeof(c_packet_batch));
+        bh->mType = htonl(VNSPACKET_BATCH);
+        bh->count = 0;              /* host order until closed */
+        d->batch = (uint8_t*)bh - d->out;
+    }
+
+    e = (c_batch_entry*)sr_vnsd_reserve(d, need);
+    e->len = htons(len);
+    strncpy(e->mInterfaceName, d->ifs[ifi].name, sizeof(e->mInterfaceName));
+    memcpy(e->frame, frame, len);
+    ((c_packet_batch*)(d->out + d->batch))->count++;
+    return e->frame;
+} /* -- sr_vnsd_queue -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_send_msg(..)
+ * Scope: Local
+ *
+ * A control message, after whatever frames are queued.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vnsd_send_msg(struct sr_vnsd* d, const void* msg, size_t len)
+{
+    sr_vnsd_close_batch(d);
+    memcpy(sr_vnsd_reserve(d, len), msg, len);
+    return sr_vnsd_flush(d);
+} /* -- sr_vnsd_send_msg -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_next(..)
+ * Scope: Local
+ *
+ * Next complete message from the router, waiting up to timeout ms (-1
+ * for ever, 0 not at all).  The message stays valid until the next call,
+ * mLen and mType are left in network byte order.  Returns 0 if none came
+ * in time or the router is gone (d->closed).
+ *
+ *---------------------------------------------------------------------------*/
+
+static c_base* sr_vnsd_next(struct sr_vnsd* d, int timeout)
+{
+    struct pollfd pfd;
+    uint32_t len;
+    ssize_t n;
+
+    /* -- drop the previous message -- */
+    if(d->in_used)
+    {
+        memmove(d->in, d->in + d->in_used, d->in_len - d->in_used);
+        d->in_len -= d->in_used;
+        d->in_used = 0;
+    }
+
+    for(;;)
+    {
+        if(d->in_len >= sizeof(c_base))
+        {
+            len = ntohl(((c_base*)d->in)->mLen);
+            if(len < sizeof(c_base) || len > VNS_BATCH_MAX)
+            {
+                fprintf(stderr, "bad message length %u from the router\n", len);
+                d->closed = 1;
+                return 0;
+            }
+            if(d->in_len >= len)
+            {
+                d->in_used = len;
+                return (c_base*)d->in;
+            }
+        }
+        if(d->closed)
+        { return 0; }
+
+        n = recv(d->fd, d->in + d->in_len, 2 * VNS_BATCH_MAX - d->in_len,
+                 MSG_DONTWAIT);
+        if(n > 0)
+        {
+            d->in_len += n;
+            continue;
+        }
+        if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            d->closed = 1;
+            return 0;
+        }
+        if(timeout == 0)
+        { return 0; }
+
+        pfd.fd = d->fd;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, timeout) == 0)
+        { return 0; }
+    }
+} /* -- sr_vnsd_next -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_expect(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static c_base* sr_vnsd_expect(struct sr_vnsd* d, uint32_t type,
+                              uint32_t alt)
+{
+    c_base* msg = sr_vnsd_next(d, SR_VNSD_TIMEOUT);
+
+    if(msg == 0)
+    {
+        fprintf(stderr, "router %s during the handshake\n",
+                d->closed ? "went away" : "timed out");
+        return 0;
+    }
+    if(ntohl(msg->mType) != type && ntohl(msg->mType) != alt)
+    {
+        fprintf(stderr, "expected message %u from the router, got %u\n", type,
+                ntohl(msg->mType));
+        return 0;
+    }
+    return msg;
+} /* -- sr_vnsd_expect -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_auth(..)
+ * Scope: Local
+ *
+ * Same scheme as the real server: the router answers our salt with
+ * SHA1(salt + auth_key).  Without a key file every router is let in.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vnsd_auth(struct sr_vnsd* d, const char* key_file)
+{
+    uint8_t req[sizeof(c_auth_request) + SR_VNSD_SALT_LEN];
+    uint8_t status[sizeof(c_auth_status) + 64];
+    c_auth_request* ar = (c_auth_request*)req;
+    c_auth_reply* reply = 0;
+    c_auth_status* st = (c_auth_status*)status;
+    char key[SR_VNSD_AUTH_KEY_LEN + 1];
+    char user[IDSIZE + 1];
+    SHA1Context sha1;
+    FILE* fp = 0;
+    uint32_t len, ulen;
+    int ok = 1;
+    int i;
+
+    ar->mLen = htonl(sizeof(req));
+    ar->mType = htonl(VNS_AUTH_REQUEST);
+    for(i = 0; i < SR_VNSD_SALT_LEN; i++)
+    { ar->salt[i] = rand(); }
+    if(sr_vnsd_send_msg(d, req, sizeof(req)) < 0)
+    { return -1; }
+
+    if((reply = (c_auth_reply*)sr_vnsd_expect(d, VNS_AUTH_REPLY, 0)) == 0)
+    { return -1; }
+    len = ntohl(reply->mLen);
+    ulen = ntohl(reply->usernameLen);
+    if(ulen > len - sizeof(c_auth_reply) ||
+       len - sizeof(c_auth_reply) - ulen != SR_VNSD_SHA1_LEN)
+    {
+        fprintf(stderr, "malformed auth reply\n");
+        return -1;
+    }
+    snprintf(user, sizeof(user), "%.*s", (int)ulen, reply->username);
+
+    if(key_file)
+    {
+        if((fp = fopen(key_file, "r")) == 0 ||
+           fgets(key, sizeof(key), fp) != key)
+        {
+            perror(key_file);
+            if(fp)
+            { fclose(fp); }
+            return -1;
+        }
+        fclose(fp);
+
+        SHA1Reset(&sha1);
+        SHA1Input(&sha1, ar->salt, SR_VNSD_SALT_LEN);
+        SHA1Input(&sha1, (unsigned char*)key, SR_VNSD_AUTH_KEY_LEN);
+        if(!SHA1Result(&sha1))
+        { return -1; }
+        for(i = 0; i < 5; i++)
+        { sha1.Message_Digest[i] = htonl(sha1.Message_Digest[i]); }
+        ok = memcmp(reply->username + ulen, sha1.Message_Digest,
+                    SR_VNSD_SHA1_LEN) == 0;
+    }
+
+    len = sizeof(c_auth_status) +
+          snprintf((char*)st->msg, sizeof(status) - sizeof(c_auth_status),
+                   "%s %.32s", ok ? "authenticated" : "bad key for", user);
+    if(len > sizeof(status))
+    { len = sizeof(status); }
+    st->mLen = htonl(len);
+    st->mType = htonl(VNS_AUTH_STATUS);
+    st->auth_ok = ok;
+    if(sr_vnsd_send_msg(d, status, len) < 0)
+    { return -1; }
+
+    if(!ok)
+    {
+        fprintf(stderr, "router of %s failed to authenticate\n", user);
+        return -1;
+    }
+    printf("router of %s connected\n", user);
+    return 0;
+} /* -- sr_vnsd_auth -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_open(..)
+ * Scope: Local
+ *
+ * Wait for VNSOPEN, agree on batching, describe the interfaces.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vnsd_open(struct sr_vnsd* d)
+{
+    static c_hwinfo hw;
+    c_open* open = 0;
+    c_caps caps;
+    c_close cl;
+    uint32_t mask = 0xffffffff;
+    int n = 0;
+    int i;
+
+    if((open = (c_open*)sr_vnsd_expect(d, VNSOPEN, VNS_OPEN_TEMPLATE)) == 0)
+    { return -1; }
+    if(ntohl(open->mType) == VNS_OPEN_TEMPLATE)
+    {
+        memset(&cl, 0, sizeof(cl));
+        cl.mLen = htonl(sizeof(cl));
+        cl.mType = htonl(VNSCLOSE);
+        strcpy(cl.mErrorMessage, "templates are not supported here");
+        sr_vnsd_send_msg(d, &cl, sizeof(cl));
+        fprintf(stderr, "router asked for a template, not supported\n");
+        return -1;
+    }
+
+    if(ntohl(open->mLen) >= sizeof(c_open) &&
+       (ntohs(open->caps) & VNS_CAP_BATCH))
+    {
+        caps.mLen = htonl(sizeof(caps));
+        caps.mType = htonl(VNS_CAPS);
+        caps.caps = htonl(VNS_CAP_BATCH);
+        if(sr_vnsd_send_msg(d, &caps, sizeof(caps)) < 0)
+        { return -1; }
+        d->caps = VNS_CAP_BATCH;
+    }
+
+    memset(&hw, 0, sizeof(hw));
+    for(i = 0; i < d->nifs; i++)
+    {
+        hw.mHWInfo[n].mKey = htonl(HWINTERFACE);
+        strncpy(hw.mHWInfo[n++].value, d->ifs[i].name, 32);
+        hw.mHWInfo[n++].mKey = htonl(HWSPEED);
+        hw.mHWInfo[n].mKey = htonl(HWETHER);
+        memcpy(hw.mHWInfo[n++].value, d->ifs[i].mac, ETHER_ADDR_LEN);
+        hw.mHWInfo[n].mKey = htonl(HWETHIP);
+        memcpy(hw.mHWInfo[n++].value, &d->ifs[i].ip, 4);
+        hw.mHWInfo[n++].mKey = htonl(HWSUBNET);
+        hw.mHWInfo[n].mKey = htonl(HWMASK);
+        memcpy(hw.mHWInfo[n++].value, &mask, 4);
+    }
+    hw.mLen = htonl(2 * sizeof(uint32_t) + n * sizeof(c_hw_entry));
+    hw.mType = htonl(VNSHWINFO);
+    return sr_vnsd_send_msg(d, &hw, ntohl(hw.mLen));
+} /* -- sr_vnsd_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_build(..)
+ * Scope: Local
+ *
+ * One UDP frame per flow from the source neighbor to the destination,
+ * flows differ in the source port.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_build(struct sr_vnsd* d)
+{
+    struct sr_vnsd_nbr* src = &d->nbrs[d->src];
+    struct sr_ethernet_hdr* e_hdr = 0;
+    struct sr_ip_hdr* ip_hdr = 0;
+    uint8_t* udp = 0;
+    uint8_t* f = 0;
+    unsigned int udp_len;
+    int i;
+
+    d->frames = (uint8_t*)calloc(d->flows, d->bytes);
+    assert(d->frames);
+
+    udp_len = d->bytes - sizeof(struct sr_ethernet_hdr) - sizeof(struct sr_ip_hdr);
+    for(i = 0; i < d->flows; i++)
+    {
+        f = d->frames + (size_t)i * d->bytes;
+        e_hdr = (struct sr_ethernet_hdr*)f;
+        memcpy(e_hdr->ether_dhost, d->ifs[src->ifi].mac, ETHER_ADDR_LEN);
+        memcpy(e_hdr->ether_shost, src->mac, ETHER_ADDR_LEN);
+        e_hdr->ether_type = htons(ethertype_ip);
+
+        ip_hdr = (struct sr_ip_hdr*)(e_hdr + 1);
+        ip_hdr->ip_v = 4;
+        ip_hdr->ip_hl = sizeof(struct sr_ip_hdr) / 4;
+        ip_hdr->ip_len = htons(d->bytes - sizeof(struct sr_ethernet_hdr));
+        ip_hdr->ip_id = htons(i);
+        ip_hdr->ip_ttl = d->ttl;
+        ip_hdr->ip_p = ip_protocol_udp;
+        ip_hdr->ip_src = src->ip;
+        ip_hdr->ip_dst = d->dst;
+        ip_hdr->ip_sum = cksum(ip_hdr, sizeof(struct sr_ip_hdr));
+
+        /* -- UDP checksum left 0, the stamp changes every frame -- */
+        udp = (uint8_t*)(ip_hdr + 1);
+        *(uint16_t*)(udp + 0) = htons(1024 + i);
+        *(uint16_t*)(udp + 2) = htons(9);           /* discard */
+        *(uint16_t*)(udp + 4) = htons(udp_len);
+    }
+} /* -- sr_vnsd_build -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_generate(..)
+ * Scope: Local
+ *
+ * Queue the frames due by now.  Frames the router is too slow to take
+ * (the output buffer is full) are counted as held back, not sent later.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_generate(struct sr_vnsd* d, uint64_t now)
+{
+    struct sr_vnsd_stamp stamp;
+    unsigned long due;
+    uint8_t* f = 0;
+    size_t off = sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr) + 8;
+    int n = 0;
+
+    due = (unsigned long)((now - d->start_ns) / 1e9 * d->rate);
+    while(d->offered < due && n++ < SR_VNSD_BURST)
+    {
+        if(d->out_len - d->out_off > SR_VNSD_OUTMAX)
+        {
+            d->held += due - d->offered;
+            d->offered = due;
+            break;
+        }
+        f = sr_vnsd_queue(d, d->nbrs[d->src].ifi,
+                          d->frames + (d->offered % d->flows) * d->bytes,
+                          d->bytes);
+        stamp.magic = SR_VNSD_MAGIC;
+        stamp.seq = d->offered;
+        stamp.sent_ns = sr_vnsd_now();
+        memcpy(f + off, &stamp, sizeof(stamp));
+        d->offered++;
+        d->sent++;
+    }
+    sr_vnsd_close_batch(d);
+} /* -- sr_vnsd_generate -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_arp(..)
+ * Scope: Local
+ *
+ * Answer the router's ARP requests for neighbors behind ifs[ifi].
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_arp(struct sr_vnsd* d, int ifi, const uint8_t* buf,
+                        unsigned int len)
+{
+    uint8_t reply[sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr)];
+    const struct sr_arp_hdr* req =
+        (const struct sr_arp_hdr*)(buf + sizeof(struct sr_ethernet_hdr));
+    struct sr_ethernet_hdr* e_hdr = (struct sr_ethernet_hdr*)reply;
+    struct sr_arp_hdr* arp = (struct sr_arp_hdr*)(e_hdr + 1);
+    struct sr_vnsd_nbr* nbr = 0;
+    int i;
+
+    if(len < sizeof(reply) || ntohs(req->ar_op) != arp_op_request ||
+       (i = sr_vnsd_find_nbr(d, ifi, req->ar_tip)) < 0)
+    {
+        d->arp_other++;
+        return;
+    }
+    nbr = &d->nbrs[i];
+    if(nbr->arp_requests++ == 0 && nbr->ip == d->dst && d->first_arp_ns == 0)
+    { d->first_arp_ns = sr_vnsd_now(); }
+
+    memcpy(e_hdr->ether_dhost, req->ar_sha, ETHER_ADDR_LEN);
+    memcpy(e_hdr->ether_shost, nbr->mac, ETHER_ADDR_LEN);
+    e_hdr->ether_type = htons(ethertype_arp);
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(arp_op_reply);
+    memcpy(arp->ar_sha, nbr->mac, ETHER_ADDR_LEN);
+    arp->ar_sip = nbr->ip;
+    memcpy(arp->ar_tha, req->ar_sha, ETHER_ADDR_LEN);
+    arp->ar_tip = req->ar_sip;
+
+    sr_vnsd_queue(d, ifi, reply, sizeof(reply));
+    d->arp_answered++;
+} /* -- sr_vnsd_arp -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_frame(..)
+ * Scope: Local
+ *
+ * A frame the router sent out of interface iface.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_frame(struct sr_vnsd* d, const char* iface,
+                          const uint8_t* buf, unsigned int len)
+{
+    const struct sr_ethernet_hdr* e_hdr = (const struct sr_ethernet_hdr*)buf;
+    const struct sr_ip_hdr* ip_hdr =
+        (const struct sr_ip_hdr*)(buf + sizeof(struct sr_ethernet_hdr));
+    const uint8_t* l4 = 0;
+    struct sr_vnsd_stamp stamp;
+    uint64_t now;
+    int ifi;
+
+    if((ifi = sr_vnsd_find_if(d, iface)) < 0 ||
+       len < sizeof(struct sr_ethernet_hdr))
+    {
+        d->other++;
+        return;
+    }
+    if(ntohs(e_hdr->ether_type) == ethertype_arp)
+    {
+        sr_vnsd_arp(d, ifi, buf, len);
+        return;
+    }
+    if(ntohs(e_hdr->ether_type) != ethertype_ip ||
+       len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr) ||
+       len < sizeof(struct sr_ethernet_hdr) + ip_hdr->ip_hl * 4 + 8)
+    {
+        d->other++;
+        return;
+    }
+
+    l4 = (const uint8_t*)ip_hdr + ip_hdr->ip_hl * 4;
+    if(ip_hdr->ip_p == ip_protocol_icmp)
+    {
+        d->icmp[l4[0]]++;
+        return;
+    }
+    if(ip_hdr->ip_p != ip_protocol_udp ||
+       l4 + 8 + sizeof(stamp) > buf + len)
+    {
+        d->other++;
+        return;
+    }
+    memcpy(&stamp, l4 + 8, sizeof(stamp));
+    if(stamp.magic != SR_VNSD_MAGIC)
+    {
+        d->other++;
+        return;
+    }
+
+    now = sr_vnsd_now();
+    if(d->first_fwd_ns == 0)
+    { d->first_fwd_ns = now; }
+    if(sr_vnsd_find_nbr(d, ifi, ip_hdr->ip_dst) < 0 &&
+       sr_vnsd_find_nbr(d, -1, ip_hdr->ip_dst) >= 0)
+    { d->stray++; }     /* out of the wrong interface */
+    d->fwd++;
+
+    if(d->nlat == d->lat_size)
+    {
+        d->lat_size = d->lat_size ? 2 * d->lat_size : 65536;
+        d->lat = (uint32_t*)realloc(d->lat, d->lat_size * sizeof(uint32_t));
+        assert(d->lat);
+    }
+    d->lat[d->nlat++] = now - stamp.sent_ns > UINT32_MAX ?
+                        UINT32_MAX : now - stamp.sent_ns;
+} /* -- sr_vnsd_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_receive(..)
+ * Scope: Local
+ *
+ * Everything the router has sent so far.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_receive(struct sr_vnsd* d)
+{
+    c_base* msg = 0;
+    c_packet_batch* batch = 0;
+    c_batch_entry* e = 0;
+    c_shm_status st;
+    char iface[sizeof(e->mInterfaceName) + 1];
+    uint32_t len, count, off, flen, i;
+
+    while((msg = sr_vnsd_next(d, 0)) != 0)
+    {
+        len = ntohl(msg->mLen);
+        switch(ntohl(msg->mType))
+        {
+            case VNSPACKET:
+                if(len < sizeof(c_packet_header))
+                { break; }
+                snprintf(iface, sizeof(iface), "%.16s",
+                         ((c_packet_header*)msg)->mInterfaceName);
+                sr_vnsd_frame(d, iface, (uint8_t*)msg + sizeof(c_packet_header),
+                              len - sizeof(c_packet_header));
+                break;
+
+            case VNSPACKET_BATCH:
+                batch = (c_packet_batch*)msg;
+                count = len >= sizeof(c_packet_batch) ? ntohl(batch->count) : 0;
+                off = sizeof(c_packet_batch);
+                for(i = 0; i < count && off + sizeof(c_batch_entry) <= len; i++)
+                {
+                    e = (c_batch_entry*)((uint8_t*)msg + off);
+                    flen = ntohs(e->len);
+                    if(off + sizeof(c_batch_entry) + flen > len)
+                    { break; }
+                    snprintf(iface, sizeof(iface), "%.16s", e->mInterfaceName);
+                    sr_vnsd_frame(d, iface, e->frame, flen);
+                    off += sizeof(c_batch_entry) + flen;
+                }
+                break;
+
+            case VNS_SHM_OPEN:
+                /* -- frames stay on TCP, the router falls back by itself -- */
+                st.mLen = htonl(sizeof(st));
+                st.mType = htonl(VNS_SHM_STATUS);
+                st.ok = 0;
+                sr_vnsd_close_batch(d);
+                memcpy(sr_vnsd_reserve(d, sizeof(st)), &st, sizeof(st));
+                break;
+
+            case VNSCLOSE:
+                d->closed = 1;
+                return;
+
+            default:
+                break;
+        }
+    }
+} /* -- sr_vnsd_receive -- */
+
+static int sr_vnsd_cmp(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_report(..)
+ * Scope: Local
+ *
+ * One "key value..." line per item, for people and for scripts.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_report(struct sr_vnsd* d)
+{
+    uint32_t* l = d->lat;
+    unsigned long n = d->nlat;
+    double sum = 0;
+    unsigned long i;
+
+    printf("offered %.0f frames/s for %.1f s, %lu frames of %u bytes\n",
+           d->rate, d->seconds, d->offered, d->bytes);
+    printf("sent %lu held_back %lu\n", d->sent, d->held);
+    printf("forwarded %lu rate %.0f lost %ld wrong_interface %lu\n", d->fwd,
+           d->fwd / d->seconds, (long)d->sent - (long)d->fwd, d->stray);
+
+    if(n)
+    {
+        qsort(l, n, sizeof(uint32_t), sr_vnsd_cmp);
+        for(i = 0; i < n; i++)
+        { sum += l[i]; }
+        printf("latency_ns mean %.0f p50 %u p90 %u p99 %u p99.9 %u max %u\n",
+               sum / n, l[n / 2], l[n * 9 / 10], l[n * 99 / 100],
+               l[n * 999 / 1000], l[n - 1]);
+    }
+
+    /* -- how long the first frame waited for the destination's MAC -- */
+    if(d->first_arp_ns && d->first_arp_ns >= d->start_ns)
+    {
+        printf("arp_request_ns %llu\n",
+               (unsigned long long)(d->first_arp_ns - d->start_ns));
+    }
+    if(d->first_fwd_ns)
+    {
+        printf("first_forwarded_ns %llu\n",
+               (unsigned long long)(d->first_fwd_ns - d->start_ns));
+    }
+
+    printf("icmp echo_reply %lu unreachable %lu time_exceeded %lu\n",
+           d->icmp[0], d->icmp[3], d->icmp[11]);
+    printf("arp answered %lu other %lu\n", d->arp_answered, d->arp_other);
+    printf("other %lu\n", d->other);
+} /* -- sr_vnsd_report -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_run(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vnsd_run(struct sr_vnsd* d, int settle_ms)
+{
+    struct pollfd pfd;
+    struct timespec ts;
+    uint64_t now, end, stop, next;
+    c_close cl;
+
+    d->start_ns = sr_vnsd_now() + settle_ms * 1000000ull;
+    end = d->start_ns + (uint64_t)(d->seconds * 1e9);
+    stop = end + SR_VNSD_DRAIN * 1000000ull;
+
+    while(!d->closed && (now = sr_vnsd_now()) < stop)
+    {
+        if(now >= d->start_ns && now < end)
+        { sr_vnsd_generate(d, now); }
+        sr_vnsd_close_batch(d);
+        if(sr_vnsd_flush(d) < 0)
+        { break; }
+
+        /* -- sleep until the next frame is due or the router says something -- */
+        next = now < d->start_ns ? d->start_ns :
+               now < end ? d->start_ns + (uint64_t)((d->offered + 1) / d->rate * 1e9) :
+               stop;
+        if(next > now + 1000000)
+        { next = now + 1000000; }
+        ts.tv_sec = 0;
+        ts.tv_nsec = next > now ? next - now : 0;
+
+        pfd.fd = d->fd;
+        pfd.events = POLLIN | (d->out_len > d->out_off ? POLLOUT : 0);
+        if(ppoll(&pfd, 1, &ts, 0) > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+        { sr_vnsd_receive(d); }
+    }
+
+    if(d->closed)
+    {
+        fprintf(stderr, "router went away\n");
+        return;
+    }
+
+    memset(&cl, 0, sizeof(cl));
+    cl.mLen = htonl(sizeof(cl));
+    cl.mType = htonl(VNSCLOSE);
+    strcpy(cl.mErrorMessage, "load test over");
+    sr_vnsd_send_msg(d, &cl, sizeof(cl));
+
+    /* -- whatever is still queued, then let the socket go -- */
+    while(d->out_len > d->out_off && !d->closed)
+    {
+        pfd.fd = d->fd;
+        pfd.events = POLLOUT;
+        if(poll(&pfd, 1, SR_VNSD_DRAIN) <= 0 || sr_vnsd_flush(d) < 0)
+        { break; }
+    }
+} /* -- sr_vnsd_run -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vnsd_accept(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vnsd_accept(unsigned short port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+    int lfd, fd;
+
+    if((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket(..):sr_vnsd.c::sr_vnsd_accept(..)");
+        return -1;
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if(bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(lfd, 1) < 0)
+    {
+        perror("bind(..):sr_vnsd.c::sr_vnsd_accept(..)");
+        close(lfd);
+        return -1;
+    }
+
+    printf("waiting for the router on port %u\n", port);
+    fflush(stdout);
+    fd = accept(lfd, 0, 0);
+    close(lfd);
+    if(fd < 0)
+    {
+        perror("accept(..):sr_vnsd.c::sr_vnsd_accept(..)");
+        return -1;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+} /* -- sr_vnsd_accept -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-p port] [-k auth_key] [-i iface,ip[,mac]]...\n", argv0);
+    printf("           [-n iface,ip[,mac]]... [-S src] [-D dst] [-r rate]\n");
+    printf("           [-T seconds] [-b bytes] [-f flows] [-t ttl] [-w ms]\n");
+    printf("   -i router interface, -n neighbor behind one (both repeat)\n");
+    printf("   -S sending neighbor, -D destination address\n");
+    printf("   -r frames/s for -T seconds after waiting -w ms\n");
+    printf("   -k checks the router's key, by default every router is let in\n");
+}
+
+int main(int argc, char** argv)
+{
+    static struct sr_vnsd d;
+    static const char* def_ifs[] =
+    {
+        "eth1,192.168.2.1,02:00:00:00:01:01",
+        "eth2,172.64.3.1,02:00:00:00:02:01",
+        "eth3,10.0.1.1,02:00:00:00:03:01", 0
+    };
+    static const char* def_nbrs[] =
+    {
+        "eth3,10.0.1.100,02:00:00:00:03:02",
+        "eth1,192.168.2.2,02:00:00:00:01:02",
+        "eth2,172.64.3.10,02:00:00:00:02:02", 0
+    };
+    const char* if_specs[SR_VNSD_MAXIFS];
+    const char* nbr_specs[SR_VNSD_MAXNBRS];
+    const char* key_file = 0;
+    const char* src = 0;
+    const char* dst = 0;
+    char name[sr_IFACE_NAMELEN];
+    unsigned short port = SR_VNSD_PORT;
+    unsigned int min_bytes;
+    uint32_t ip;
+    int settle = 200;
+    int nif_specs = 0, nnbr_specs = 0;
+    int c, i;
+
+    d.rate = 10000;
+    d.seconds = 5;
+    d.bytes = 64;
+    d.flows = 1;
+    d.ttl = 64;
+    d.batch = (size_t)-1;
+
+    while((c = getopt(argc, argv, "hp:k:i:n:S:D:r:T:b:f:t:w:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'k':
+                key_file = optarg;
+                break;
+            case 'i':
+                if(nif_specs == SR_VNSD_MAXIFS)
+                {
+                    fprintf(stderr, "at most %d interfaces\n", SR_VNSD_MAXIFS);
+                    exit(1);
+                }
+                if_specs[nif_specs++] = optarg;
+                break;
+            case 'n':
+                if(nnbr_specs == SR_VNSD_MAXNBRS)
+                {
+                    fprintf(stderr, "at most %d neighbors\n", SR_VNSD_MAXNBRS);
+                    exit(1);
+                }
+                nbr_specs[nnbr_specs++] = optarg;
+                break;
+            case 'S':
+                src = optarg;
+                break;
+            case 'D':
+                dst = optarg;
+                break;
+            case 'r':
+                d.rate = atof(optarg);
+                break;
+            case 'T':
+                d.seconds = atof(optarg);
+                break;
+            case 'b':
+                d.bytes = atoi(optarg);
+                break;
+            case 'f':
+                d.flows = atoi(optarg);
+                break;
+            case 't':
+                d.ttl = atoi(optarg);
+                break;
+            case 'w':
+                settle = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+
+    min_bytes = sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr) + 8 +
+                sizeof(struct sr_vnsd_stamp);
+    if(d.rate <= 0 || d.seconds <= 0 || d.bytes < min_bytes ||
+       d.bytes > SR_VNSD_MAXLEN || d.flows <= 0 || d.flows > SR_VNSD_MAXFLOWS ||
+       d.ttl < 1 || d.ttl > 255 || settle < 0)
+    {
+        fprintf(stderr, "need -r > 0, -T > 0, %u <= -b <= %d, "
+                "0 < -f <= %d, 1 <= -t <= 255, -w >= 0\n", min_bytes,
+                SR_VNSD_MAXLEN, SR_VNSD_MAXFLOWS);
+        exit(1);
+    }
+
+    /* -- topology -- */
+    if(nif_specs == 0 && nnbr_specs == 0)
+    {
+        for(i = 0; def_ifs[i]; i++)
+        { if_specs[nif_specs++] = def_ifs[i]; }
+        for(i = 0; def_nbrs[i]; i++)
+        { nbr_specs[nnbr_specs++] = def_nbrs[i]; }
+    }
+    for(i = 0; i < nif_specs; i++)
+    {
+        if(sr_vnsd_parse_spec(if_specs[i], d.ifs[i].name, &d.ifs[i].ip,
+                              d.ifs[i].mac) != 0)
+        {
+            fprintf(stderr, "bad interface %s, want name,ip[,mac]\n",
+                    if_specs[i]);
+            exit(1);
+        }
+    }
+    d.nifs = nif_specs;
+    for(i = 0; i < nnbr_specs; i++)
+    {
+        if(sr_vnsd_parse_spec(nbr_specs[i], name, &d.nbrs[i].ip,
+                              d.nbrs[i].mac) != 0 ||
+           (d.nbrs[i].ifi = sr_vnsd_find_if(&d, name)) < 0)
+        {
+            fprintf(stderr, "bad neighbor %s, want iface,ip[,mac] with a "
+                    "known iface\n", nbr_specs[i]);
+            exit(1);
+        }
+    }
+    d.nnbrs = nnbr_specs;
+    if(d.nnbrs == 0)
+    {
+        fprintf(stderr, "need at least one neighbor to send from\n");
+        exit(1);
+    }
+
+    /* -- workload -- */
+    d.src = 0;
+    if(src && (inet_pton(AF_INET, src, &ip) != 1 ||
+               (d.src = sr_vnsd_find_nbr(&d, -1, ip)) < 0))
+    {
+        fprintf(stderr, "-S %s is not a neighbor\n", src);
+        exit(1);
+    }
+    if(dst)
+    {
+        if(inet_pton(AF_INET, dst, &d.dst) != 1)
+        {
+            fprintf(stderr, "bad -D %s\n", dst);
+            exit(1);
+        }
+    }
+    else
+    {
+        for(i = 0; i < d.nnbrs && d.nbrs[i].ifi == d.nbrs[d.src].ifi; i++);
+        if(i == d.nnbrs)
+        {
+            fprintf(stderr, "no neighbor behind another interface, give -D\n");
+            exit(1);
+        }
+        d.dst = d.nbrs[i].ip;
+    }
+    sr_vnsd_build(&d);
+
+    d.in = (uint8_t*)malloc(2 * VNS_BATCH_MAX);
+    assert(d.in);
+    srand(time(0) ^ getpid());
+
+    if((d.fd = sr_vnsd_accept(port)) < 0)
+    { exit(1); }
+    if(sr_vnsd_auth(&d, key_file) != 0 || sr_vnsd_open(&d) != 0)
+    { exit(1); }
+
+    sr_vnsd_run(&d, settle);
+    sr_vnsd_report(&d);
+
+    close(d.fd);
+    return d.closed ? 1 : 0;
+}
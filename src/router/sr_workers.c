@@ -0,0 +1,609 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_workers.c
+ *
+ * Description:
+ *
+ * Forwarding workers and the TX thread, see sr_workers.h.
+ *
+ * The stages are linked by SPSC rings: reader -> worker (input ring) and
+ * worker -> TX thread (one TX ring per worker).  Frames sent from other
+ * threads (the reader, the ARP sweeper) use a locked queue to the TX
+ * thread instead.
+ *
+ * A consumer that finds nothing to do marks itself sleeping and waits on
+ * a condition variable.  A producer only takes the consumer's lock when
+ * it sees that mark after pushing, so a busy stage costs its producer
+ * no more than the ring push.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "sr_workers.h"
+#include "sr_ring.h"
+#include "sr_transport.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_pkt.h"
+#include "sr_prof.h"
+#include "sr_stats.h"
+
+/* a frame on its way to a worker or to the TX thread */
+struct sr_job
+{
+    struct sr_job* next;            /* TX queue */
+    struct sr_pkt pkt;              /* to a worker: descriptor of buf */
+    unsigned int len;               /* to the TX thread */
+    int ifindex;                    /* to the TX thread */
+    uint8_t buf[0];
+};
+
+struct sr_worker
+{
+    struct sr_ring ring;            /* reader -> worker */
+    struct sr_ring tx_ring;         /* worker -> TX thread */
+    struct sr_instance* sr;
+    pthread_t thread;
+    int id;
+    int cpu;                        /* -1 if not pinned */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int sleeping;
+
+    unsigned long dispatched;       /* written by the reader */
+    unsigned long stalls;           /* written by the reader */
+    unsigned long done;             /* written by the worker */
+    unsigned long tx_pushed;        /* written by the worker */
+    unsigned long tx_stalls;        /* written by the worker */
+} __attribute__ ((aligned (SR_CACHE_LINE)));
+
+struct sr_workers
+{
+    int n;
+    struct sr_worker* w;
+    int stop;
+    unsigned long rx_bad;           /* malformed, dropped by the reader */
+
+    /* -- TX thread, fed by the workers' TX rings and by tx_head for the
+          reader and the ARP thread -- */
+    pthread_t tx_thread;
+    int tx_cpu;
+    pthread_mutex_t tx_lock;
+    pthread_cond_t tx_cond;
+    int tx_sleeping;
+    struct sr_job* tx_head;
+    struct sr_job* tx_tail;
+    unsigned long tx_queued;        /* under tx_lock */
+    unsigned long tx_done;
+    unsigned long tx_rounds;
+    int tx_stop;
+    int tx_running;
+};
+
+/* the worker running on this thread, 0 on other threads */
+static __thread struct sr_worker* sr_self = 0;
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_parse_cpu_list(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_parse_cpu_list(const char* str, int* cpus, int max)
+{
+    int n = 0, lo, hi;
+    char* end = 0;
+
+    while(*str)
+    {
+        lo = hi = (int)strtol(str, &end, 10);
+        if(end == str || lo < 0)
+        { return -1; }
+        if(*end == '-')
+        {
+            str = end + 1;
+            hi = (int)strtol(str, &end, 10);
+            if(end == str || hi < lo)
+            { return -1; }
+        }
+        for(; lo <= hi; lo++)
+        {
+            if(n == max)
+            { return -1; }
+            cpus[n++] = lo;
+        }
+        if(*end == ',')
+        { end++; }
+        else if(*end)
+        { return -1; }
+        str = end;
+    }
+
+    return n;
+} /* -- sr_parse_cpu_list -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_pin_thread(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_pin_thread(pthread_t thread, int cpu, const char* what)
+{
+#ifdef _LINUX_
+    cpu_set_t set;
+
+    if(cpu < 0)
+    { return; }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(pthread_setaffinity_np(thread, sizeof(set), &set) != 0)
+    { fprintf(stderr, "Could not pin %s to cpu %d\n", what, cpu); }
+#endif /* _LINUX_ */
+} /* -- sr_pin_thread -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_worker_next(..)
+ * Scope: Local
+ *
+ * Next frame for worker w, sleeps while the ring is empty.  Returns 0 once
+ * the workers are stopping and the ring is drained.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_job* sr_worker_next(struct sr_workers* ws,
+                                     struct sr_worker* w)
+{
+    struct sr_job* job = 0;
+
+    if((job = sr_ring_pop(&w->ring)) != 0)
+    { return job; }
+
+    pthread_mutex_lock(&w->lock);
+    __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while((job = sr_ring_pop(&w->ring)) == 0 &&
+          !__atomic_load_n(&ws->stop, __ATOMIC_ACQUIRE))
+    { pthread_cond_wait(&w->cond, &w->lock); }
+    __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+
+    return job;
+} /* -- sr_worker_next -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_worker_main(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void* sr_worker_main(void* arg)
+{
+    struct sr_worker* w = (struct sr_worker*)arg;
+    struct sr_workers* ws = w->sr->workers;
+    struct sr_job* job = 0;
+
+    sr_self = w;
+    SR_PROF_THREAD("worker", w->id);
+    while((job = sr_worker_next(ws, w)) != 0)
+    {
+        sr_handle_pkt(w->sr, &job->pkt);
+        free(job);
+        __atomic_store_n(&w->done, w->done + 1, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+} /* -- sr_worker_main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_tx_pending(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_tx_pending(struct sr_workers* ws)
+{
+    int i;
+
+    if(ws->tx_head)
+    { return 1; }
+    for(i = 0; i < ws->n; i++)
+    {
+        if(sr_ring_count(&ws->w[i].tx_ring))
+        { return 1; }
+    }
+    return 0;
+} /* -- sr_tx_pending -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_tx_round(..)
+ * Scope: Local
+ *
+ * Send everything the workers and the other threads have queued, with the
+ * transport holding frames back (sr_tx_hold), and flush once at the end.
+ * Returns the number of frames sent.
+ *
+ *---------------------------------------------------------------------------*/
+
+static unsigned long sr_tx_round(struct sr_instance* sr,
+                                 struct sr_workers* ws)
+{
+    struct sr_job* job = 0;
+    struct sr_job* next = 0;
+    unsigned long n = 0;
+    int i;
+
+    sr_tx_hold = 1;
+    for(i = 0; i < ws->n; i++)
+    {
+        while((job = sr_ring_pop(&ws->w[i].tx_ring)) != 0)
+        {
+            sr->transport->send(sr, job->buf, job->len, job->ifindex);
+            free(job);
+            n++;
+        }
+    }
+
+    pthread_mutex_lock(&ws->tx_lock);
+    job = ws->tx_head;
+    ws->tx_head = ws->tx_tail = 0;
+    pthread_mutex_unlock(&ws->tx_lock);
+    for(; job; job = next, n++)
+    {
+        next = job->next;
+        sr->transport->send(sr, job->buf, job->len, job->ifindex);
+        free(job);
+    }
+    sr_tx_hold = 0;
+
+    if(n == 0)
+    { return 0; }
+
+    if(sr->transport->flush)
+    { sr->transport->flush(sr); }
+    ws->tx_rounds++;
+    __atomic_add_fetch(&ws->tx_done, n, __ATOMIC_RELEASE);
+
+    return n;
+} /* -- sr_tx_round -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_tx_main(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static void* sr_tx_main(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    struct sr_workers* ws = sr->workers;
+
+    SR_PROF_THREAD("tx", -1);
+    while(1)
+    {
+        if(sr_tx_round(sr, ws))
+        { continue; }
+
+        pthread_mutex_lock(&ws->tx_lock);
+        __atomic_store_n(&ws->tx_sleeping, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        while(!sr_tx_pending(ws) && !ws->tx_stop)
+        { pthread_cond_wait(&ws->tx_cond, &ws->tx_lock); }
+        __atomic_store_n(&ws->tx_sleeping, 0, __ATOMIC_RELAXED);
+
+        if(ws->tx_stop && !sr_tx_pending(ws))
+        {
+            /* -- later sends go straight to the transport -- */
+            ws->tx_running = 0;
+            pthread_mutex_unlock(&ws->tx_lock);
+            break;
+        }
+        pthread_mutex_unlock(&ws->tx_lock);
+    }
+
+    return 0;
+} /* -- sr_tx_main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_workers_start(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_workers_start(struct sr_instance* sr, int n, const int* cpus,
+                     int ncpus)
+{
+    struct sr_workers* ws = 0;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(n > 0 && n <= SR_MAX_WORKERS);
+
+    ws = (struct sr_workers*)calloc(1, sizeof(struct sr_workers));
+    assert(ws);
+    if(posix_memalign((void**)&ws->w, SR_CACHE_LINE,
+                      n * sizeof(struct sr_worker)) != 0)
+    { return -1; }
+    memset(ws->w, 0, n * sizeof(struct sr_worker));
+    ws->n = n;
+    ws->tx_cpu = ncpus > 0 ? cpus[1 % ncpus] : -1;
+    pthread_mutex_init(&ws->tx_lock, 0);
+    pthread_cond_init(&ws->tx_cond, 0);
+
+    for(i = 0; i < n; i++)
+    {
+        if(sr_ring_init(&ws->w[i].ring, SR_WORKER_RING) != 0 ||
+           sr_ring_init(&ws->w[i].tx_ring, SR_WORKER_RING) != 0)
+        { return -1; }
+        ws->w[i].sr = sr;
+        ws->w[i].id = i;
+        ws->w[i].cpu = ncpus > 0 ? cpus[(2 + i) % ncpus] : -1;
+        pthread_mutex_init(&ws->w[i].lock, 0);
+        pthread_cond_init(&ws->w[i].cond, 0);
+    }
+
+    /* -- visible to sr_send_packet() before anybody may use it -- */
+    sr->workers = ws;
+
+    if(pthread_create(&ws->tx_thread, &(sr->attr), sr_tx_main, sr) != 0)
+    {
+        sr->workers = 0;
+        return -1;
+    }
+    ws->tx_running = 1;
+    sr_pin_thread(ws->tx_thread, ws->tx_cpu, "TX thread");
+
+    for(i = 0; i < n; i++)
+    {
+        if(pthread_create(&ws->w[i].thread, &(sr->attr), sr_worker_main,
+                          &ws->w[i]) != 0)
+        {
+            perror("pthread_create(..):sr_workers.c::sr_workers_start(..)");
+            exit(1);
+        }
+        sr_pin_thread(ws->w[i].thread, ws->w[i].cpu, "worker");
+    }
+
+    if(ncpus > 0)
+    { sr_pin_thread(pthread_self(), cpus[0], "reader"); }
+
+    printf("Forwarding on %d worker%s\n", n, n > 1 ? "s" : "");
+    return 0;
+} /* -- sr_workers_start -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_workers_sync(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_workers_sync(struct sr_instance* sr)
+{
+    struct sr_workers* ws = sr->workers;
+    unsigned long queued;
+    int i;
+
+    if(ws == 0)
+    { return; }
+
+    for(i = 0; i < ws->n; i++)
+    {
+        while(__atomic_load_n(&ws->w[i].done, __ATOMIC_ACQUIRE) !=
+              ws->w[i].dispatched)
+        { sched_yield(); }
+    }
+
+    /* -- the workers are idle, nothing but the ARP thread adds to the TX
+          queues now -- */
+    pthread_mutex_lock(&ws->tx_lock);
+    queued = ws->tx_queued;
+    pthread_mutex_unlock(&ws->tx_lock);
+    for(i = 0; i < ws->n; i++)
+    { queued += __atomic_load_n(&ws->w[i].tx_pushed, __ATOMIC_ACQUIRE); }
+    while(__atomic_load_n(&ws->tx_done, __ATOMIC_ACQUIRE) < queued)
+    { sched_yield(); }
+} /* -- sr_workers_sync -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_workers_stop(..)
+ * Scope: Global
+ *
+ * The state itself is not freed, the ARP thread may still be sending.
+ * Frames sent after this point go straight to the transport.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_workers_stop(struct sr_instance* sr)
+{
+    struct sr_workers* ws = sr->workers;
+    int i;
+
+    if(ws == 0)
+    { return; }
+
+    __atomic_store_n(&ws->stop, 1, __ATOMIC_RELEASE);
+    for(i = 0; i < ws->n; i++)
+    {
+        pthread_mutex_lock(&ws->w[i].lock);
+        pthread_cond_signal(&ws->w[i].cond);
+        pthread_mutex_unlock(&ws->w[i].lock);
+    }
+    for(i = 0; i < ws->n; i++)
+    { pthread_join(ws->w[i].thread, 0); }
+
+    pthread_mutex_lock(&ws->tx_lock);
+    ws->tx_stop = 1;
+    pthread_cond_signal(&ws->tx_cond);
+    pthread_mutex_unlock(&ws->tx_lock);
+    pthread_join(ws->tx_thread, 0);
+
+    sr_workers_print_stats(sr, stdout);
+} /* -- sr_workers_stop -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_workers_print_stats(..)
+ * Scope: Global
+ *
+ * Where the pipeline waits: a stage whose input ring runs full (and stalls
+ * its producer) is the bottleneck, one whose input is mostly empty is not.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_workers_print_stats(struct sr_instance* sr, FILE* fp)
+{
+    struct sr_workers* ws = sr->workers;
+    struct sr_worker* w = 0;
+    char name[32];
+    unsigned long rounds;
+    int i;
+
+    if(ws == 0)
+    { return; }
+
+    fprintf(fp, "reader: %lu malformed frames dropped\n", ws->rx_bad);
+    for(i = 0; i < ws->n; i++)
+    {
+        w = &ws->w[i];
+        fprintf(fp, "worker %d: %lu frames handled, %lu sent, reader stalled "
+                "%lu times, worker stalled %lu times\n", i,
+                __atomic_load_n(&w->done, __ATOMIC_RELAXED),
+                __atomic_load_n(&w->tx_pushed, __ATOMIC_RELAXED),
+                w->stalls, __atomic_load_n(&w->tx_stalls, __ATOMIC_RELAXED));
+        snprintf(name, sizeof(name), "  rx ring %d", i);
+        sr_ring_print_stats(&w->ring, name, fp);
+        snprintf(name, sizeof(name), "  tx ring %d", i);
+        sr_ring_print_stats(&w->tx_ring, name, fp);
+    }
+    rounds = __atomic_load_n(&ws->tx_rounds, __ATOMIC_RELAXED);
+    fprintf(fp, "tx thread: %lu frames in %lu rounds (%.1f per round), "
+            "%lu from other threads\n",
+            __atomic_load_n(&ws->tx_done, __ATOMIC_RELAXED), rounds,
+            rounds ? (double)__atomic_load_n(&ws->tx_done, __ATOMIC_RELAXED)
+                     / rounds : 0.0,
+            ws->tx_queued);
+} /* -- sr_workers_print_stats -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_workers_dispatch(..)
+ * Scope: Global
+ *
+ * Only the thread running the transport's read loop may call this.  Frames
+ * the router would only throw away (runts, unknown ethertypes, broken IP
+ * headers) are dropped here, the rest go to the worker their flow hash
+ * picks.  When the worker's ring is full the reader waits for it, which
+ * pushes back on the transport (TCP window, kernel ring, replay speed).
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_workers_dispatch(struct sr_instance* sr, const struct sr_pkt* pkt)
+{
+    struct sr_workers* ws = sr->workers;
+    struct sr_worker* w = 0;
+    struct sr_job* job = 0;
+
+    if(!(pkt->flags & (SR_PKT_IP | SR_PKT_ARP)))
+    {
+        ws->rx_bad++;
+        sr_stats_drop(pkt->flags & SR_PKT_SHORT ? SR_DROP_SHORT
+                                                : SR_DROP_BAD_HDR);
+        return;
+    }
+    w = &ws->w[pkt->hash % ws->n];
+
+    job = (struct sr_job*)malloc(sizeof(struct sr_job) + pkt->len);
+    assert(job);
+    job->pkt = *pkt;
+    job->pkt.buf = job->buf;
+    memcpy(job->buf, pkt->buf, pkt->len);
+
+    if(sr_ring_push(&w->ring, job) != 0)
+    {
+        w->stalls++;
+        while(sr_ring_push(&w->ring, job) != 0)
+        { sched_yield(); }
+    }
+    w->dispatched++;
+
+    /* -- pairs with the fence in sr_worker_next() -- */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&w->sleeping, __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+} /* -- sr_workers_dispatch -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_workers_send(..)
+ * Scope: Global
+ *
+ * Workers push onto their own TX ring, anybody else goes through the
+ * locked queue.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_workers_send(struct sr_instance* sr, uint8_t* buf,
+                    unsigned int len, int ifindex)
+{
+    struct sr_workers* ws = sr->workers;
+    struct sr_worker* w = sr_self;
+    struct sr_job* job = 0;
+
+    job = (struct sr_job*)malloc(sizeof(struct sr_job) + len);
+    assert(job);
+    job->next = 0;
+    job->len = len;
+    job->ifindex = ifindex;
+    memcpy(job->buf, buf, len);
+
+    if(w && w->sr == sr)
+    {
+        if(sr_ring_push(&w->tx_ring, job) != 0)
+        {
+            w->tx_stalls++;
+            while(sr_ring_push(&w->tx_ring, job) != 0)
+            { sched_yield(); }
+        }
+        __atomic_store_n(&w->tx_pushed, w->tx_pushed + 1, __ATOMIC_RELEASE);
+
+        /* -- pairs with the fence in sr_tx_main() -- */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&ws->tx_sleeping, __ATOMIC_RELAXED))
+        {
+            pthread_mutex_lock(&ws->tx_lock);
+            pthread_cond_signal(&ws->tx_cond);
+            pthread_mutex_unlock(&ws->tx_lock);
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock(&ws->tx_lock);
+    if(!ws->tx_running)
+    {
+        pthread_mutex_unlock(&ws->tx_lock);
+        free(job);
+        return sr->transport->send(sr, buf, len, ifindex);
+    }
+    if(ws->tx_tail)
+    { ws->tx_tail->next = job; }
+    else
+    { ws->tx_head = job; }
+    if(ws->tx_sleeping)
+    { pthread_cond_signal(&ws->tx_cond); }
+    ws->tx_tail = job;
+    ws->tx_queued++;
+    pthread_mutex_unlock(&ws->tx_lock);
+
+    return 0;
+} /* -- sr_workers_send -- */
@@ -0,0 +1,61 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_workers.h
+ *
+ * Description:
+ *
+ * Optional forwarding pipeline (-w).  The thread running the transport's
+ * read loop parses each received frame and copies it onto the input ring
+ * of one worker, picked by the flow hash (sr_pkt.h) so frames of a flow
+ * stay in order.  Workers run sr_handle_pkt() against the shared routing
+ * table and ARP cache and push what they send onto their own TX ring.
+ * One TX thread owns the transport's send side.  Socket reads, forwarding
+ * and socket writes thus overlap instead of running back to back.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_WORKERS_H
+#define SR_WORKERS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_MAX_WORKERS    64
+#define SR_MAX_CPUS       256
+#define SR_WORKER_RING    1024    /* frames waiting per worker */
+
+struct sr_instance;
+struct sr_pkt;
+
+/* Parse a cpu list such as "0,2-5" into cpus. Returns the count or -1. */
+int  sr_parse_cpu_list(const char* str, int* cpus, int max);
+
+/* Start n workers and the TX thread.  With ncpus > 0 the calling thread is
+   pinned to cpus[0], the TX thread to cpus[1] and the workers to the
+   following entries, wrapping around the list. */
+int  sr_workers_start(struct sr_instance* sr, int n, const int* cpus,
+                      int ncpus);
+
+/* Let the workers and the TX thread finish what is queued, then stop them. */
+void sr_workers_stop(struct sr_instance* sr);
+
+/* Wait until every dispatched frame has been handled and sent. */
+void sr_workers_sync(struct sr_instance* sr);
+
+/* Reader side: copy a received frame to its worker. */
+void sr_workers_dispatch(struct sr_instance* sr, const struct sr_pkt* pkt);
+
+/* Queue a checked frame for the TX thread, 0 on success. */
+int  sr_workers_send(struct sr_instance* sr, uint8_t* buf,
+                     unsigned int len, int ifindex);
+
+/* Per stage frame counts, ring occupancy and stalls. */
+void sr_workers_print_stats(struct sr_instance* sr, FILE* fp);
+
+#endif /* -- SR_WORKERS_H -- */
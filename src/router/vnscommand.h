@@ -38,7 +38,8 @@ typedef struct
     uint32_t mLen;
     uint32_t mType;        /* = VNSOPEN */
     uint16_t topoID;       /* Id of the topology we want to run on */
-    uint16_t pad;          /* unused */
+    uint16_t caps;         /* VNS_CAP_* the client understands (was padding,
+                              old servers ignore it) */
     char     mVirtualHostID[IDSIZE]; /* Id of the simulated router (e.g.
                                         'VNS-A'); */
     char     mUID[IDSIZE]; /* User id (e.g. "appenz"), for information only */
@@ -194,5 +195,70 @@ typedef struct
 
 }__attribute__ ((__packed__)) c_auth_status;
 
+/* ******* Shared memory rings (see sr_shm.h) ******** */
+#define VNS_SHM_OPEN     1024
+#define VNS_SHM_STATUS   2048
+#define VNS_SHM_DOORBELL 4096
+
+/* client offers a memfd holding the rings, the server maps
+   /proc/<pid>/fd/<fd> */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint32_t pid;
+    uint32_t fd;
+    uint32_t size;
+}__attribute__ ((__packed__)) c_shm_open;
+
+/* server accepts (ok = 1, frames move to the rings) or declines */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint8_t  ok;
+    char     msg[0];
+}__attribute__ ((__packed__)) c_shm_status;
+
+/* frames were pushed onto an empty ring */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint32_t ring;
+}__attribute__ ((__packed__)) c_shm_doorbell;
+
+
+/* ******* Capabilities and batched packets ******** */
+#define VNS_CAPS         8192
+#define VNSPACKET_BATCH 16384
+
+#define VNS_CAP_BATCH   0x0001  /* VNSPACKET_BATCH in both directions */
+
+#define VNS_BATCH_MAX   65536   /* largest VNSPACKET_BATCH, whole message */
+
+/* server's answer to the caps in c_open, the bits both ends support */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint32_t caps;
+}__attribute__ ((__packed__)) c_caps;
+
+/* many frames in one message, count entries follow the header back to back */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint32_t count;
+}__attribute__ ((__packed__)) c_packet_batch;
+
+typedef struct
+{
+    uint16_t len;          /* frame length */
+    char     mInterfaceName[16];
+    uint8_t  frame[0];
+}__attribute__ ((__packed__)) c_batch_entry;
+
 
 #endif  /* __VNSCOMMAND_H */